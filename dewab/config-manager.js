@@ -8,7 +8,9 @@ class ConfigManager {
         this.config = {
             supabaseUrl: null,
             supabaseAnonKey: null,
-            geminiApiKey: null
+            geminiApiKey: null,
+            commandSigningKey: null, // Optional: HMAC key shared with devices that require signed commands
+            commandShards: 0 // Optional: number of command channels, as set with Dewab::setCommandShards on the devices
         };
         this.listeners = [];
         this._loadConfigFromLocalStorage(); // Load config on instantiation
@@ -105,7 +107,7 @@ class ConfigManager {
      * @returns {string[]} Array of missing key names
      */
     getMissingKeys() {
-        return Object.keys(this.config).filter(key => !this.config[key]);
+        return ['supabaseUrl', 'supabaseAnonKey', 'geminiApiKey'].filter(key => !this.config[key]);
     }
 
     /**
@@ -42,6 +42,16 @@ export class DeviceProxy {
         }
     }
 
+    /**
+     * Answer the device's dewab.call() requests for an event, e.g. to serve a
+     * setpoint or forward the question to the Gemini agent
+     * @param {string} event - Event the device calls
+     * @param {Function} handler - async (payload) => result, sent back to the device
+     */
+    handleCalls(event, handler) {
+        this._getClient().onCall(event, handler);
+    }
+
     /**
      * Get device state
      * @param {string} [sensorName] - Optional specific sensor/input name
@@ -1,14 +1,71 @@
 import { getSupabaseClient } from '../supabase/supabase-client.js';
 import { eventBus, EVENT_TYPES } from '../event-bus.js';
+import { configManager } from '../config-manager.js';
 
 const ARDUINO_COMMANDS_CHANNEL = "arduino-commands";
 const ARDUINO_STATE_UPDATE_EVENT = "ARDUINO_STATE_UPDATE";
+const COMPRESSED_PAYLOAD_MARKER = "deflate-raw";
+
+/**
+ * Command channel of a device. With commandShards > 1 the fleet is spread
+ * over "dewab-cmd-<shard>" channels, shard = FNV-1a(UTF-8 device name) mod
+ * shards, the same hash as Dewab::commandShard on the Arduino side.
+ * @param {string} deviceName - Device name as passed to the Dewab constructor
+ * @param {number} [shards=0] - Shard count; 0 or 1 is the single legacy channel
+ * @returns {string} Channel name without the "realtime:" prefix
+ */
+export function commandChannelName(deviceName, shards = 0) {
+    if (!shards || shards <= 1) {
+        return ARDUINO_COMMANDS_CHANNEL;
+    }
+    let hash = 2166136261;
+    for (const byte of new TextEncoder().encode(deviceName)) {
+        hash = Math.imul(hash ^ byte, 16777619) >>> 0;
+    }
+    return `dewab-cmd-${hash % shards}`;
+}
+
+/**
+ * Expands a payload the device deflated before sending (see
+ * SupabaseRealtimeClient::setCompression on the Arduino side).
+ * Payloads that were sent uncompressed are returned unchanged.
+ * @param {Object} payload - Broadcast payload as received
+ * @returns {Promise<Object>} The original payload
+ */
+export async function inflateDevicePayload(payload) {
+    if (!payload || payload._z !== COMPRESSED_PAYLOAD_MARKER) {
+        return payload;
+    }
+    const bytes = Uint8Array.from(atob(payload.d), c => c.charCodeAt(0));
+    const stream = new Blob([bytes]).stream().pipeThrough(new DecompressionStream('deflate-raw'));
+    return JSON.parse(await new Response(stream).text());
+}
+
+/**
+ * Applies a delta state update (sent with "delta": true while the device is
+ * low on memory) to the last full state. Each category holds only the
+ * fields that changed; top-level values such as reason are replaced.
+ * @param {Object|null} state - Last known state
+ * @param {Object} delta - Delta update as received
+ * @returns {Object} The merged state
+ */
+export function mergeStateDelta(state, delta) {
+    const merged = { ...(state || {}) };
+    for (const [key, value] of Object.entries(delta)) {
+        if (key === 'delta') continue;
+        const isCategory = value && typeof value === 'object' && !Array.isArray(value);
+        merged[key] = isCategory ? { ...(merged[key] || {}), ...value } : value;
+    }
+    return merged;
+}
 
 export class SupabaseDeviceClient {
     constructor(targetDeviceName) {
         this.targetDeviceName = targetDeviceName;
         this.latestDeviceState = null;
         this.channel = null;
+        this.stateCallback = null;
+        this.callHandlers = new Map();
 
         console.log(`SupabaseDeviceClient initialized for device: ${this.targetDeviceName}`);
     }
@@ -21,6 +78,14 @@ export class SupabaseDeviceClient {
         return getSupabaseClient();
     }
 
+    /**
+     * The device's command channel under the current commandShards setting
+     * @private
+     */
+    _channelName() {
+        return commandChannelName(this.targetDeviceName, configManager.get('commandShards'));
+    }
+
     // Method to send a command to the device via Supabase
     async sendCommand(commandType, payload) {
         if (!this.targetDeviceName) {
@@ -28,13 +93,14 @@ export class SupabaseDeviceClient {
             this._emitSystemMessage("Target device not specified.");
             return;
         }
-        const fullPayload = {
-            ...payload,
-            target_device_name: this.targetDeviceName,
-        };
         try {
+            const fullPayload = await this._signCommand(commandType, {
+                ...payload,
+                target_device_name: this.targetDeviceName,
+            });
             const supabaseClient = this._getSupabaseClient();
-            const channel = supabaseClient.channel(ARDUINO_COMMANDS_CHANNEL, {
+            const channelName = this._channelName();
+            const channel = supabaseClient.channel(channelName, {
                 config: {
                     broadcast: {
                         ack: true,
@@ -48,7 +114,7 @@ export class SupabaseDeviceClient {
                 payload: fullPayload,
             });
 
-            console.log(`Command '${commandType}' sent to ${this.targetDeviceName} via broadcast on '${ARDUINO_COMMANDS_CHANNEL}' with payload:`, fullPayload);
+            console.log(`Command '${commandType}' sent to ${this.targetDeviceName} via broadcast on '${channelName}' with payload:`, fullPayload);
             return { status: 'success', message: 'Command sent successfully' };
         } catch (error) {
             console.error(`Error sending command '${commandType}' to ${this.targetDeviceName}:`, error);
@@ -56,10 +122,39 @@ export class SupabaseDeviceClient {
         }
     }
 
+    /**
+     * Wraps a command payload in an HMAC-SHA256 signature when a
+     * commandSigningKey is configured (see Dewab::setCommandSigningKey on
+     * the Arduino side). The device verifies the exact signed string.
+     * @private
+     * @param {string} commandType - Command name
+     * @param {Object} payload - Command payload including target_device_name
+     * @returns {Promise<Object>} The payload to broadcast
+     */
+    async _signCommand(commandType, payload) {
+        const signingKey = configManager.get('commandSigningKey');
+        if (!signingKey) {
+            return payload;
+        }
+        const encoder = new TextEncoder();
+        const body = JSON.stringify({
+            command: commandType,
+            target: this.targetDeviceName,
+            nonce: crypto.getRandomValues(new Uint32Array(1))[0],
+            ts: Math.floor(Date.now() / 1000),
+            args: payload,
+        });
+        const key = await crypto.subtle.importKey('raw', encoder.encode(signingKey), { name: 'HMAC', hash: 'SHA-256' }, false, ['sign']);
+        const mac = new Uint8Array(await crypto.subtle.sign('HMAC', key, encoder.encode(body)));
+        const sig = Array.from(mac, b => b.toString(16).padStart(2, '0')).join('');
+        return { target_device_name: this.targetDeviceName, signed: body, sig };
+    }
+
     // Method to subscribe to device updates
     subscribeToDeviceUpdates(callback) {
         if (this.channel) {
-            console.warn(`[SupabaseDeviceClient] Already subscribed to channel for ${this.targetDeviceName}.`);
+            // Already subscribed, e.g. to answer calls; only the state callback is new
+            if (callback) this.stateCallback = callback;
             return this.channel;
         }
 
@@ -70,31 +165,43 @@ export class SupabaseDeviceClient {
             return null;
         }
         const supabaseClient = this._getSupabaseClient();
-        this.channel = supabaseClient.channel(ARDUINO_COMMANDS_CHANNEL);
+        const channelName = this._channelName();
+        this.stateCallback = callback;
+        this.channel = supabaseClient.channel(channelName);
 
         this.channel
-            .on('broadcast', { event: '*' }, (message) => {
+            .on('broadcast', { event: '*' }, async (message) => {
                 // Listen for all broadcast events and filter manually.
                 // The Supabase JS SDK provides the nested event name at the top level.
                 console.log('[SupabaseDeviceClient] Raw broadcast received:', message);
 
                 const eventName = message.event;
-                const payload = message.payload;
+                let payload;
+                try {
+                    payload = await inflateDevicePayload(message.payload);
+                } catch (error) {
+                    console.error(`[SupabaseDeviceClient] Failed to inflate '${eventName}' payload:`, error);
+                    return;
+                }
 
                 if (eventName === ARDUINO_STATE_UPDATE_EVENT && payload) {
                     if (payload.device_name === this.targetDeviceName) {
-                        this.latestDeviceState = payload; // Store the latest state
-                        callback(payload);
+                        // Devices low on memory send only the fields that changed
+                        this.latestDeviceState = payload.delta ? mergeStateDelta(this.latestDeviceState, payload) : payload;
+                        this.stateCallback?.(this.latestDeviceState);
                     }
+                } else if (payload?.call_id !== undefined && payload.device_name === this.targetDeviceName &&
+                           this.callHandlers.has(eventName)) {
+                    this._answerCall(eventName, payload);
                 }
             })
             .subscribe((status) => {
-                console.log(`SupabaseDeviceClient: Supabase channel '${ARDUINO_COMMANDS_CHANNEL}' subscription status: ${status}`);
+                console.log(`SupabaseDeviceClient: Supabase channel '${channelName}' subscription status: ${status}`);
                 if (status === 'SUBSCRIBED') {
-                    console.log(`Successfully subscribed to ${ARDUINO_COMMANDS_CHANNEL} for ${ARDUINO_STATE_UPDATE_EVENT} for device ${this.targetDeviceName}`);
+                    console.log(`Successfully subscribed to ${channelName} for ${ARDUINO_STATE_UPDATE_EVENT} for device ${this.targetDeviceName}`);
                 } else {
                     if (status === 'CHANNEL_ERROR' || status === 'TIMED_OUT') {
-                        console.error(`Subscription to ${ARDUINO_COMMANDS_CHANNEL} failed. Status: ${status}`);
+                        console.error(`Subscription to ${channelName} failed. Status: ${status}`);
                         this._emitSystemMessage(`Subscription to device updates failed: ${status}.`);
                     }
                 }
@@ -103,6 +210,39 @@ export class SupabaseDeviceClient {
         return this.channel;
     }
 
+    /**
+     * Answers dewab.call() requests of `event` from this device (see
+     * Dewab::call on the Arduino side). The handler gets the call's payload
+     * and returns, or resolves to, the result; it is sent back as a
+     * CALL_RESULT broadcast. A thrown error is sent as an error reply.
+     * @param {string} event - Event the device calls, e.g. 'GET_SETPOINT'
+     * @param {Function} handler - async (payload) => result
+     */
+    onCall(event, handler) {
+        this.callHandlers.set(event, handler);
+        if (!this.channel) {
+            this.subscribeToDeviceUpdates(null);
+        }
+    }
+
+    /**
+     * @private
+     * @param {string} event - Called event
+     * @param {Object} payload - Call payload with call_id and device_name
+     */
+    async _answerCall(event, payload) {
+        const { call_id: callId, device_name: deviceName, ...args } = payload;
+        let reply;
+        try {
+            const result = await this.callHandlers.get(event)(args);
+            reply = { call_id: callId, status: 'success', result: result ?? null };
+        } catch (error) {
+            console.error(`[SupabaseDeviceClient] Call '${event}' from ${deviceName} failed:`, error);
+            reply = { call_id: callId, status: 'error', message: error.message || 'Call failed' };
+        }
+        await this.sendCommand('CALL_RESULT', reply);
+    }
+
     async disconnect() {
         if (this.channel) {
             console.log(`[SupabaseDeviceClient] Unsubscribing from channel for ${this.targetDeviceName}`);
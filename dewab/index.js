@@ -36,6 +36,8 @@ class Dewab {
      * @param {string} [config.supabaseUrl] - Your Supabase project URL.
      * @param {string} [config.supabaseAnonKey] - Your Supabase anonymous key.
      * @param {string} [config.geminiApiKey] - Your Gemini API key.
+     * @param {string} [config.commandSigningKey] - HMAC key for devices that only accept signed commands.
+     * @param {number} [config.commandShards] - Command channel count of a sharded fleet (Dewab::setCommandShards).
      * @param {object} [config.geminiModelConfig] - Overrides for default Gemini model configuration.
      * @param {HTMLElement} [config.chatLogElement] - The HTML element for displaying chat messages.
      * @param {HTMLInputElement} [config.chatInputElement] - The HTML input element for chat.
@@ -67,6 +69,12 @@ class Dewab {
         if (this._config.supabaseAnonKey) {
             apiConfig.supabaseAnonKey = this._config.supabaseAnonKey;
         }
+        if (this._config.commandSigningKey) {
+            apiConfig.commandSigningKey = this._config.commandSigningKey;
+        }
+        if (this._config.commandShards) {
+            apiConfig.commandShards = this._config.commandShards;
+        }
 
         if (Object.keys(apiConfig).length > 0) {
             configManager.setConfig(apiConfig);
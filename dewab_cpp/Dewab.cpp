@@ -1,45 +1,1583 @@
 #include <Arduino.h>
 #include <ArduinoJson.h>
+#include <base64.h>
+#include <mbedtls/md.h>
+#include <esp_wifi.h>
+#include <stdarg.h>
+#include <time.h>
+#include <soc/soc_caps.h>
+// Counter peripherals differ per chip: the C3 has no MCPWM, the C2 no PCNT either
+#if SOC_PCNT_SUPPORTED
+#if ESP_ARDUINO_VERSION_MAJOR >= 3
+#include <driver/pulse_cnt.h>
+#else
+#include <driver/pcnt.h>
+#endif
+#endif
+#if SOC_MCPWM_SUPPORTED
+#if ESP_ARDUINO_VERSION_MAJOR >= 3
+#include <driver/mcpwm_cap.h>
+#else
+#include <driver/mcpwm.h>
+#endif
+#endif
 #include "Dewab.h"
 
+// =================================================================
+// DewabClock Implementation
+// =================================================================
+DewabClock* DewabClock::system() {
+    static SystemClock clock;
+    return &clock;
+}
+
+unsigned long SystemClock::millis() {
+    return ::millis();
+}
+
+void SystemClock::delay(unsigned long ms) {
+    ::delay(ms);
+}
+
+// =================================================================
+// DewabLog Implementation
+// =================================================================
+DewabLogLevel DewabLog::_level = DEWAB_LOG_DEBUG;
+DewabLogLevel DewabLog::_ceiling = DEWAB_LOG_DEBUG;
+DewabLogSink DewabLog::_sink = nullptr;
+DewabLogLevel DewabLog::_sinkLevel = DEWAB_LOG_NONE;
+
+void DewabLog::setLevel(DewabLogLevel level) {
+    _level = level;
+}
+
+DewabLogLevel DewabLog::level() {
+    return _level;
+}
+
+void DewabLog::setCeiling(DewabLogLevel ceiling) {
+    _ceiling = ceiling;
+}
+
+void DewabLog::setSink(DewabLogSink sink, DewabLogLevel level) {
+    _sink = sink;
+    _sinkLevel = sink ? level : DEWAB_LOG_NONE;
+}
+
+void DewabLog::setSinkLevel(DewabLogLevel level) {
+    _sinkLevel = _sink ? level : DEWAB_LOG_NONE;
+}
+
+DewabLogLevel DewabLog::sinkLevel() {
+    return _sinkLevel;
+}
+
+bool DewabLog::enabled(DewabLogLevel level) {
+    return level <= _ceiling && (level <= _level || level <= _sinkLevel);
+}
+
+void DewabLog::write(DewabLogLevel level, const char* tag, const char* format, ...) {
+    if (!enabled(level)) return;
+    char line[maxLineBytes];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+    if (level <= _level) Serial.println(line);
+    if (level <= _sinkLevel) _sink(level, tag, line);
+}
+
 // =================================================================
 // WifiManager Implementation
 // (Previously in WifiManager.cpp)
 // =================================================================
-WifiManager::WifiManager(const char* ssid, const char* password)
-    : _ssid(ssid), _password(password) {}
+WifiManager::WifiManager(const char* ssid, const char* password)
+    : _ssid(ssid), _password(password) {}
+
+void WifiManager::connect() {
+    DewabLog::write(DEWAB_LOG_INFO, "wifi", "Connecting to WiFi: %s", _ssid);
+
+    WiFi.begin(_ssid, _password);
+
+    unsigned long startTime = _clock->millis();
+    while (WiFi.status() != WL_CONNECTED) {
+        _clock->delay(500);
+        if (_clock->millis() - startTime > 10000) { // 10 second timeout for WiFi
+            DewabLog::write(DEWAB_LOG_ERROR, "wifi", "WiFi connection to %s failed (timeout after 10s)", _ssid);
+            return;
+        }
+    }
+    DewabLog::write(DEWAB_LOG_INFO, "wifi", "WiFi connected (IP: %s)", WiFi.localIP().toString().c_str());
+}
+
+void WifiManager::setClock(DewabClock* clock) {
+    _clock = clock;
+}
+
+bool WifiManager::isConnected() {
+    return (WiFi.status() == WL_CONNECTED);
+}
+
+void WifiManager::loop() {
+    if (!isConnected()) {
+        unsigned long currentTime = _clock->millis();
+        if (currentTime - _lastReconnectAttempt > _reconnectInterval) {
+            DewabLog::write(DEWAB_LOG_WARN, "wifi", "WiFi disconnected, reconnecting to %s", _ssid);
+            connect();
+            _lastReconnectAttempt = currentTime;
+        }
+    }
+}
+
+
+// =================================================================
+// DeflateEncoder Implementation
+// =================================================================
+namespace {
+
+// Writes deflate's LSB-first bit stream into a fixed buffer
+struct DeflateBitWriter {
+    uint8_t* out;
+    size_t capacity;
+    size_t pos = 0;
+    uint32_t acc = 0;
+    int count = 0;
+    bool overflow = false;
+
+    DeflateBitWriter(uint8_t* buffer, size_t cap) : out(buffer), capacity(cap) {}
+
+    void put(uint32_t bits, int n) {
+        acc |= bits << count;
+        count += n;
+        while (count >= 8) {
+            if (pos < capacity) out[pos++] = acc & 0xFF;
+            else overflow = true;
+            acc >>= 8;
+            count -= 8;
+        }
+    }
+
+    // Huffman codes are stored most-significant bit first
+    void putCode(uint32_t code, int n) {
+        uint32_t reversed = 0;
+        for (int i = 0; i < n; i++) {
+            reversed = (reversed << 1) | (code & 1);
+            code >>= 1;
+        }
+        put(reversed, n);
+    }
+
+    void align() {
+        if (count > 0) put(0, 8 - count);
+    }
+};
+
+const uint16_t kLengthBase[29] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+                                  35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+const uint8_t kLengthExtra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+                                  3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+const uint16_t kDistanceBase[30] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+                                    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
+                                    8193, 12289, 16385, 24577};
+const uint8_t kDistanceExtra[30] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+                                    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+const int kHashBits = 10;
+const uint16_t kNoPosition = 0xFFFF;
+
+// Fixed literal/length code (RFC 1951, 3.2.6)
+void putLiteral(DeflateBitWriter& w, unsigned symbol) {
+    if (symbol < 144)      w.putCode(0x30 + symbol, 8);
+    else if (symbol < 256) w.putCode(0x190 + (symbol - 144), 9);
+    else if (symbol < 280) w.putCode(symbol - 256, 7);
+    else                   w.putCode(0xC0 + (symbol - 280), 8);
+}
+
+void putMatch(DeflateBitWriter& w, size_t length, size_t distance) {
+    int l = 28;
+    while (kLengthBase[l] > length) l--;
+    putLiteral(w, 257 + l);
+    w.put(length - kLengthBase[l], kLengthExtra[l]);
+
+    int d = 29;
+    while (kDistanceBase[d] > distance) d--;
+    w.putCode(d, 5);
+    w.put(distance - kDistanceBase[d], kDistanceExtra[d]);
+}
+
+inline uint32_t hash3(const uint8_t* p) {
+    return ((p[0] << 16 | p[1] << 8 | p[2]) * 2654435761u) >> (32 - kHashBits);
+}
+
+} // namespace
+
+size_t DeflateEncoder::compress(const uint8_t* in, size_t length, uint8_t* out, size_t outCapacity, uint16_t window) {
+    if (length == 0 || length >= kNoPosition) {
+        return 0; // Positions are tracked in 16 bits
+    }
+    if (window == 0 || window > 32768) {
+        window = 32768;
+    }
+
+    uint16_t head[1 << kHashBits];
+    for (auto& h : head) h = kNoPosition;
+
+    DeflateBitWriter w(out, outCapacity);
+    w.put(1, 1); // BFINAL
+    w.put(1, 2); // BTYPE = fixed Huffman
+
+    size_t i = 0;
+    while (i < length && !w.overflow) {
+        size_t matchLength = 0;
+        size_t distance = 0;
+
+        if (i + 3 <= length) {
+            uint32_t h = hash3(in + i);
+            uint16_t candidate = head[h];
+            head[h] = i;
+            if (candidate != kNoPosition && i - candidate <= window) {
+                size_t maxLength = length - i < 258 ? length - i : 258;
+                size_t l = 0;
+                while (l < maxLength && in[candidate + l] == in[i + l]) l++;
+                if (l >= 3) {
+                    matchLength = l;
+                    distance = i - candidate;
+                }
+            }
+        }
+
+        if (matchLength) {
+            putMatch(w, matchLength, distance);
+            for (size_t k = i + 1; k < i + matchLength && k + 3 <= length; k++) {
+                head[hash3(in + k)] = k;
+            }
+            i += matchLength;
+        } else {
+            putLiteral(w, in[i]);
+            i++;
+        }
+    }
+
+    putLiteral(w, 256); // End of block
+    w.align();
+    return w.overflow ? 0 : w.pos;
+}
+
+
+// =================================================================
+// HeapMonitor Implementation
+// =================================================================
+HeapMonitor::Scope::Scope(HeapMonitor* monitor, DewabHeapSite site)
+    : _monitor(monitor), _site(site), _freeAtStart(monitor ? heap_caps_get_free_size(MALLOC_CAP_8BIT) : 0),
+      _startedMicros(micros()) {}
+
+HeapMonitor::Scope::~Scope() {
+    if (!_monitor) {
+        return;
+    }
+    uint32_t elapsed = micros() - _startedMicros;
+    int32_t net = (int32_t)_freeAtStart - (int32_t)heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    HeapSiteStats& stats = _monitor->_sites[_site];
+    stats.calls++;
+    stats.netBytes += net;
+    stats.totalMicros += elapsed;
+    if (net > stats.maxNetBytes) stats.maxNetBytes = net;
+    if (elapsed > stats.maxMicros) stats.maxMicros = elapsed;
+}
+
+HeapSnapshot HeapMonitor::snapshot() {
+    multi_heap_info_t info;
+    heap_caps_get_info(&info, MALLOC_CAP_8BIT);
+
+    HeapSnapshot s;
+    s.freeBytes = info.total_free_bytes;
+    s.largestFreeBlock = info.largest_free_block;
+    s.minFreeBytes = info.minimum_free_bytes;
+    s.allocatedBlocks = info.allocated_blocks;
+    s.minStackFree = uxTaskGetStackHighWaterMark(NULL);
+    return s;
+}
+
+void HeapMonitor::setClock(DewabClock* clock) {
+    _clock = clock;
+}
+
+void HeapMonitor::loop() {
+    checkPressure();
+    if (_lastSampleAt != 0 && _clock->millis() - _lastSampleAt < _sampleInterval) {
+        return;
+    }
+    _last = snapshot();
+    _last.takenAt = _clock->millis();
+    _lastSampleAt = _last.takenAt ? _last.takenAt : 1;
+
+    if (_baselineMessages == 0) {
+        if (_messages >= _warmupMessages) {
+            _baseline = _last;
+            _baselineMessages = _messages;
+            DewabLog::write(DEWAB_LOG_INFO, "heap", "Heap baseline after %lu messages: %lu free, %lu blocks",
+                          (unsigned long)_messages, (unsigned long)_baseline.freeBytes, (unsigned long)_baseline.allocatedBlocks);
+        }
+        return;
+    }
+
+    if (!_budgetExceeded && blocksPerMessage() > _budgetBlocksPerMessage) {
+        _budgetExceeded = true;
+        DewabLog::write(DEWAB_LOG_WARN, "heap", "Heap budget exceeded: %.3f blocks/message retained (budget %.3f)",
+                      blocksPerMessage(), _budgetBlocksPerMessage);
+    }
+}
+
+void HeapMonitor::countMessage() {
+    _messages++;
+}
+
+void HeapMonitor::setMessageBudget(float blocksPerMessage, uint32_t warmupMessages) {
+    _budgetBlocksPerMessage = blocksPerMessage;
+    _warmupMessages = warmupMessages;
+    _baselineMessages = 0;
+    _budgetExceeded = false;
+}
+
+bool HeapMonitor::budgetExceeded() const {
+    return _budgetExceeded;
+}
+
+float HeapMonitor::blocksPerMessage() const {
+    // Needs enough traffic since the baseline for the ratio to mean anything
+    uint32_t messages = _messages - _baselineMessages;
+    if (_baselineMessages == 0 || messages < _warmupMessages) {
+        return 0.0f;
+    }
+    return ((float)_last.allocatedBlocks - (float)_baseline.allocatedBlocks) / messages;
+}
+
+const HeapSnapshot& HeapMonitor::lastSample() const {
+    return _last;
+}
+
+const HeapSiteStats& HeapMonitor::siteStats(DewabHeapSite site) const {
+    return _sites[site];
+}
+
+const char* HeapMonitor::siteName(DewabHeapSite site) {
+    switch (site) {
+        case DEWAB_HEAP_SITE_RX:        return "rx";
+        case DEWAB_HEAP_SITE_COMMAND:   return "command";
+        case DEWAB_HEAP_SITE_BROADCAST: return "broadcast";
+        case DEWAB_HEAP_SITE_HEARTBEAT: return "heartbeat";
+        case DEWAB_HEAP_SITE_STATE:     return "state";
+        default:                        return "unknown";
+    }
+}
+
+void HeapMonitor::report(JsonDocument& doc) const {
+    doc["uptime_ms"] = _clock->millis();
+    doc["free_bytes"] = _last.freeBytes;
+    doc["largest_free_block"] = _last.largestFreeBlock;
+    doc["min_free_bytes"] = _last.minFreeBytes;
+    doc["min_stack_free"] = _last.minStackFree;
+    doc["allocated_blocks"] = _last.allocatedBlocks;
+    doc["fragmentation"] = serialized(String(_last.fragmentation(), 3));
+    doc["messages"] = _messages;
+    doc["blocks_per_message"] = serialized(String(blocksPerMessage(), 4));
+    doc["budget_blocks_per_message"] = serialized(String(_budgetBlocksPerMessage, 4));
+    doc["budget_exceeded"] = _budgetExceeded;
+
+    JsonObject pressure = doc["pressure"].to<JsonObject>();
+    pressure["level"] = levelName(_level);
+    pressure["low_watermark"] = _lowWatermark;
+    pressure["critical_watermark"] = _criticalWatermark;
+    pressure["low_entries"] = _pressure.lowEntries;
+    pressure["critical_entries"] = _pressure.criticalEntries;
+    pressure["recoveries"] = _pressure.recoveries;
+    pressure["degraded_ms"] = _pressure.degradedMs + (_level != DEWAB_MEMORY_NORMAL ? _clock->millis() - _pressure.changedAt : 0);
+    pressure["refused_commands"] = _pressure.refusedCommands;
+    pressure["delta_updates"] = _pressure.deltaUpdates;
+
+    JsonObject sites = doc["sites"].to<JsonObject>();
+    for (int i = 0; i < DEWAB_HEAP_SITE_COUNT; i++) {
+        JsonObject site = sites[siteName((DewabHeapSite)i)].to<JsonObject>();
+        site["calls"] = _sites[i].calls;
+        site["net_bytes"] = _sites[i].netBytes;
+        site["max_net_bytes"] = _sites[i].maxNetBytes;
+        site["mean_micros"] = _sites[i].calls ? _sites[i].totalMicros / _sites[i].calls : 0;
+        site["max_micros"] = _sites[i].maxMicros;
+    }
+}
+
+void HeapMonitor::setWatermarks(uint32_t lowBytes, uint32_t criticalBytes, uint32_t recoverMargin) {
+    _lowWatermark = lowBytes;
+    _criticalWatermark = criticalBytes;
+    _recoverMargin = recoverMargin;
+}
+
+DewabMemoryLevel HeapMonitor::pressureLevel() const {
+    return _level;
+}
+
+MemoryPressureStats& HeapMonitor::pressureStats() {
+    return _pressure;
+}
+
+const char* HeapMonitor::levelName(DewabMemoryLevel level) {
+    switch (level) {
+        case DEWAB_MEMORY_LOW: return "low";
+        case DEWAB_MEMORY_CRITICAL: return "critical";
+        default: return "normal";
+    }
+}
+
+void HeapMonitor::checkPressure() {
+    uint32_t freeBytes = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    DewabMemoryLevel level = _level;
+    if (freeBytes < _criticalWatermark) {
+        level = DEWAB_MEMORY_CRITICAL;
+    } else if (freeBytes < _lowWatermark) {
+        // Leaving CRITICAL needs the margin too
+        if (_level == DEWAB_MEMORY_NORMAL || freeBytes >= _criticalWatermark + _recoverMargin) level = DEWAB_MEMORY_LOW;
+    } else if (_level == DEWAB_MEMORY_NORMAL || freeBytes >= _lowWatermark + _recoverMargin) {
+        level = DEWAB_MEMORY_NORMAL;
+    } else if (_level == DEWAB_MEMORY_CRITICAL && freeBytes >= _criticalWatermark + _recoverMargin) {
+        level = DEWAB_MEMORY_LOW;
+    }
+    if (level == _level) return;
+
+    unsigned long now = _clock->millis();
+    if (_level != DEWAB_MEMORY_NORMAL) {
+        _pressure.degradedMs += now - _pressure.changedAt;
+    }
+    if (level == DEWAB_MEMORY_CRITICAL) {
+        _pressure.criticalEntries++;
+    } else if (level == DEWAB_MEMORY_LOW && _level == DEWAB_MEMORY_NORMAL) {
+        _pressure.lowEntries++;
+    } else if (level == DEWAB_MEMORY_NORMAL) {
+        _pressure.recoveries++;
+    }
+    DewabLog::write(level == DEWAB_MEMORY_NORMAL ? DEWAB_LOG_INFO : DEWAB_LOG_WARN, "heap",
+                    "Memory pressure %s -> %s (%lu bytes free)", levelName(_level), levelName(level), (unsigned long)freeBytes);
+    _level = level;
+    _pressure.changedAt = now;
+}
+
+void HeapMonitor::resetSiteStats() {
+    for (int i = 0; i < DEWAB_HEAP_SITE_COUNT; i++) {
+        _sites[i] = HeapSiteStats();
+    }
+}
+
+
+// =================================================================
+// TrafficRecorder Implementation
+// =================================================================
+static const uint8_t kCaptureMagic[4] = {'D', 'W', 'R', '1'};
+
+TrafficRecorder::~TrafficRecorder() {
+    end();
+}
+
+bool TrafficRecorder::begin(size_t capacity, size_t maxFrameBytes) {
+    end();
+    _ring = (uint8_t*)malloc(capacity);
+    if (!_ring) {
+        DewabLog::write(DEWAB_LOG_ERROR, "recorder", "Traffic recorder: cannot allocate %u bytes", (unsigned)capacity);
+        return false;
+    }
+    _capacity = capacity;
+    _maxFrameBytes = maxFrameBytes;
+    clear();
+    return true;
+}
+
+void TrafficRecorder::end() {
+    free(_ring);
+    _ring = nullptr;
+    _capacity = 0;
+    clear();
+}
+
+bool TrafficRecorder::isEnabled() const {
+    return _ring != nullptr;
+}
+
+void TrafficRecorder::setClock(DewabClock* clock) {
+    _clock = clock;
+}
+
+void TrafficRecorder::setPaused(bool paused) {
+    _paused = paused;
+}
+
+void TrafficRecorder::clear() {
+    _head = 0;
+    _used = 0;
+    _records = 0;
+    _dropped = 0;
+}
+
+void TrafficRecorder::record(Direction direction, const uint8_t* data, size_t length) {
+    if (!_ring || _paused) {
+        return;
+    }
+    size_t stored = length < _maxFrameBytes ? length : _maxFrameBytes;
+    if (stored > 0xFFFF) stored = 0xFFFF;
+    size_t needed = headerSize + stored;
+    if (needed > _capacity) {
+        _dropped++;
+        return;
+    }
+    while (_capacity - _used < needed) {
+        dropOldest();
+    }
+
+    uint32_t now = _clock->millis();
+    uint16_t original = length > 0xFFFF ? 0xFFFF : length;
+    uint8_t header[headerSize] = {
+        (uint8_t)now, (uint8_t)(now >> 8), (uint8_t)(now >> 16), (uint8_t)(now >> 24),
+        (uint8_t)direction,
+        (uint8_t)stored, (uint8_t)(stored >> 8),
+        (uint8_t)original, (uint8_t)(original >> 8)
+    };
+    writeBytes(header, headerSize);
+    writeBytes(data, stored);
+    _records++;
+}
+
+void TrafficRecorder::writeBytes(const uint8_t* data, size_t length) {
+    size_t tail = (_head + _used) % _capacity;
+    size_t first = _capacity - tail < length ? _capacity - tail : length;
+    memcpy(_ring + tail, data, first);
+    memcpy(_ring, data + first, length - first);
+    _used += length;
+}
+
+void TrafficRecorder::dropOldest() {
+    uint16_t stored = _ring[(_head + 5) % _capacity] | (_ring[(_head + 6) % _capacity] << 8);
+    size_t size = headerSize + stored;
+    _head = (_head + size) % _capacity;
+    _used -= size;
+    _records--;
+    _dropped++;
+}
+
+size_t TrafficRecorder::captureSize() const {
+    return _ring ? sizeof(kCaptureMagic) + _used : 0;
+}
+
+size_t TrafficRecorder::read(size_t offset, uint8_t* dest, size_t length) const {
+    size_t total = captureSize();
+    if (offset >= total) {
+        return 0;
+    }
+    if (length > total - offset) {
+        length = total - offset;
+    }
+    for (size_t i = 0; i < length; i++, offset++) {
+        dest[i] = offset < sizeof(kCaptureMagic)
+            ? kCaptureMagic[offset]
+            : _ring[(_head + offset - sizeof(kCaptureMagic)) % _capacity];
+    }
+    return length;
+}
+
+
+// =================================================================
+// Tracer Implementation
+// =================================================================
+static const uint8_t kTraceMagic[4] = {'D', 'W', 'T', '1'};
+
+Tracer::Scope::Scope(Tracer* tracer, DewabTraceSpan span, uint32_t arg, bool dropIfEmpty)
+    : _tracer(tracer), _span(span), _arg(arg), _dropIfEmpty(dropIfEmpty) {
+    if (_tracer) _tracer->record(_span, 'B', _arg);
+}
+
+Tracer::Scope::~Scope() {
+    if (!_tracer || (_dropIfEmpty && _tracer->dropIfLast(_span))) return;
+    _tracer->record(_span, 'E', _arg);
+}
+
+Tracer::~Tracer() {
+    end();
+}
+
+bool Tracer::begin(size_t maxEvents) {
+    end();
+    _events = (Event*)malloc(maxEvents * sizeof(Event));
+    if (!_events) {
+        DewabLog::write(DEWAB_LOG_ERROR, "trace", "Tracer: cannot allocate %u events", (unsigned)maxEvents);
+        return false;
+    }
+    _capacity = maxEvents;
+    clear();
+    return true;
+}
+
+void Tracer::end() {
+    free(_events);
+    _events = nullptr;
+    _capacity = 0;
+    clear();
+}
+
+bool Tracer::isEnabled() const {
+    return _events != nullptr;
+}
+
+void Tracer::record(DewabTraceSpan span, char phase, uint32_t arg) {
+    if (!_events || _paused) {
+        return;
+    }
+    Event& event = _events[(_head + _used) % _capacity];
+    event.cycles = ESP.getCycleCount();
+    event.span = span;
+    event.phase = phase;
+    event.arg = arg > 0xFFFF ? 0xFFFF : arg;
+    if (_used < _capacity) {
+        _used++;
+    } else {
+        _head = (_head + 1) % _capacity;
+        _overwritten++;
+    }
+}
+
+bool Tracer::dropIfLast(DewabTraceSpan span) {
+    if (!_events || _paused || _used < 2) {
+        return false;
+    }
+    const Event& last = _events[(_head + _used - 1) % _capacity];
+    const Event& previous = _events[(_head + _used - 2) % _capacity];
+    if (last.span != span || last.phase != 'B' || last.cycles - previous.cycles >= (1u << 30)) {
+        return false;
+    }
+    _used--;
+    return true;
+}
+
+void Tracer::setPaused(bool paused) {
+    _paused = paused;
+}
+
+void Tracer::clear() {
+    _head = 0;
+    _used = 0;
+    _overwritten = 0;
+}
+
+size_t Tracer::captureSize() const {
+    return _events ? headerSize + _used * eventSize : 0;
+}
+
+size_t Tracer::read(size_t offset, uint8_t* dest, size_t length) const {
+    size_t total = captureSize();
+    if (offset >= total) {
+        return 0;
+    }
+    if (length > total - offset) {
+        length = total - offset;
+    }
+    uint32_t header[2] = { ESP.getCpuFreqMHz(), _overwritten };
+    for (size_t i = 0; i < length; i++, offset++) {
+        if (offset < sizeof(kTraceMagic)) {
+            dest[i] = kTraceMagic[offset];
+        } else if (offset < headerSize) {
+            size_t at = offset - sizeof(kTraceMagic);
+            dest[i] = (uint8_t)(header[at / 4] >> (8 * (at % 4)));
+        } else {
+            size_t at = offset - headerSize;
+            const Event& event = _events[(_head + at / eventSize) % _capacity];
+            uint8_t bytes[eventSize] = {
+                (uint8_t)event.cycles, (uint8_t)(event.cycles >> 8), (uint8_t)(event.cycles >> 16), (uint8_t)(event.cycles >> 24),
+                event.span, event.phase, (uint8_t)event.arg, (uint8_t)(event.arg >> 8)
+            };
+            dest[i] = bytes[at % eventSize];
+        }
+    }
+    return length;
+}
+
+const char* Tracer::spanName(DewabTraceSpan span) {
+    switch (span) {
+        case DEWAB_TRACE_LOOP: return "loop";
+        case DEWAB_TRACE_WS_LOOP: return "ws_loop";
+        case DEWAB_TRACE_PARSE: return "parse";
+        case DEWAB_TRACE_DISPATCH: return "dispatch";
+        case DEWAB_TRACE_HANDLER: return "handler";
+        case DEWAB_TRACE_SERIALIZE: return "serialize";
+        case DEWAB_TRACE_SEND: return "send";
+        case DEWAB_TRACE_HEARTBEAT: return "heartbeat";
+        case DEWAB_TRACE_REST: return "rest";
+        case DEWAB_TRACE_STATE: return "state";
+        default: return "unknown";
+    }
+}
+
+
+// =================================================================
+// PcSampler Implementation
+// =================================================================
+static const uint8_t kProfileMagic[4] = {'D', 'W', 'P', '1'};
+static const int kSamplerProbes = 8;
+
+PcSampler* PcSampler::_active = nullptr;
+
+PcSampler::~PcSampler() {
+    end();
+}
+
+bool PcSampler::begin(size_t slots) {
+    end();
+#if !defined(__XTENSA__) && !defined(__riscv)
+    DewabLog::write(DEWAB_LOG_ERROR, "profiler", "PC sampler: unsupported CPU architecture");
+    return false;
+#endif
+    size_t rounded = 64;
+    while (rounded < slots) rounded <<= 1;
+    // The ISR touches the table, so it must not live in PSRAM
+    _pcs = (uint32_t*)heap_caps_malloc(rounded * sizeof(uint32_t), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    _counts = (uint32_t*)heap_caps_malloc(rounded * sizeof(uint32_t), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    if (!_pcs || !_counts) {
+        DewabLog::write(DEWAB_LOG_ERROR, "profiler", "PC sampler: cannot allocate %u slots", (unsigned)rounded);
+        end();
+        return false;
+    }
+    _slots = rounded;
+    memset(_pcs, 0, _slots * sizeof(uint32_t));
+    memset(_counts, 0, _slots * sizeof(uint32_t));
+    _entries = 0;
+    return true;
+}
+
+void PcSampler::end() {
+    stop();
+    heap_caps_free(_pcs);
+    heap_caps_free(_counts);
+    _pcs = nullptr;
+    _counts = nullptr;
+    _slots = 0;
+    _entries = 0;
+}
+
+bool PcSampler::isEnabled() const {
+    return _pcs != nullptr;
+}
+
+void PcSampler::setClock(DewabClock* clock) {
+    _clock = clock;
+}
+
+bool PcSampler::start(unsigned long windowMs, uint32_t hz) {
+    if (!isEnabled() || _active || hz == 0) {
+        return false;
+    }
+    memset(_pcs, 0, _slots * sizeof(uint32_t));
+    memset(_counts, 0, _slots * sizeof(uint32_t));
+    _entries = 0;
+    _samples = 0;
+    _lost = 0;
+    _hz = hz;
+    _windowMs = windowMs;
+    _startedAt = _clock->millis();
+    _active = this;
+
+    // The timer interrupt is allocated on the calling core, i.e. the loop() core
+#if ESP_ARDUINO_VERSION_MAJOR >= 3
+    _timer = timerBegin(1000000);
+    timerAttachInterrupt(_timer, &PcSampler::onTimer);
+    timerAlarm(_timer, 1000000 / hz, true, 0);
+#else
+    _timer = timerBegin(0, 80, true); // 1 MHz from the 80 MHz APB clock
+    timerAttachInterrupt(_timer, &PcSampler::onTimer, true);
+    timerAlarmWrite(_timer, 1000000 / hz, true);
+    timerAlarmEnable(_timer);
+#endif
+    DewabLog::write(DEWAB_LOG_INFO, "profiler", "PC sampler started: %lu Hz for %lu ms", (unsigned long)hz, windowMs);
+    return true;
+}
+
+void PcSampler::stop() {
+    if (!_timer) {
+        return;
+    }
+    timerEnd(_timer);
+    _timer = nullptr;
+    _active = nullptr;
+
+    // Compact the used slots to the front so the profile can be read out directly
+    _entries = 0;
+    for (size_t i = 0; i < _slots; i++) {
+        if (_counts[i] == 0) continue;
+        _pcs[_entries] = _pcs[i];
+        _counts[_entries] = _counts[i];
+        if (i != _entries) _counts[i] = 0;
+        _entries++;
+    }
+    DewabLog::write(DEWAB_LOG_INFO, "profiler", "PC sampler stopped: %lu samples, %u PCs, %lu lost",
+                    (unsigned long)_samples, (unsigned)_entries, (unsigned long)_lost);
+}
+
+bool PcSampler::isRunning() const {
+    return _timer != nullptr;
+}
+
+void PcSampler::loop() {
+    if (_timer && _clock->millis() - _startedAt >= _windowMs) {
+        stop();
+    }
+}
+
+void IRAM_ATTR PcSampler::onTimer() {
+    PcSampler* self = _active;
+    if (!self) return;
+    // On interrupt entry the FreeRTOS port saves the task's context on its
+    // stack and stores that stack pointer in pxTopOfStack, the first field of
+    // the TCB the task handle points to. The PC's place in it is per port.
+    uint32_t* frame = *(uint32_t**)xTaskGetCurrentTaskHandle();
+#if defined(__XTENSA__)
+    uint32_t pc = frame[1]; // XtExcFrame: exit, pc, ...
+#else
+    uint32_t pc = frame[0]; // RvExcFrame: mepc, ra, ...
+#endif
+
+    self->_samples++;
+    size_t mask = self->_slots - 1;
+    size_t slot = ((pc >> 2) * 2654435761u) & mask;
+    for (int probe = 0; probe < kSamplerProbes; probe++, slot = (slot + 1) & mask) {
+        if (self->_counts[slot] == 0) {
+            self->_pcs[slot] = pc;
+        } else if (self->_pcs[slot] != pc) {
+            continue;
+        }
+        self->_counts[slot]++;
+        return;
+    }
+    self->_lost++;
+}
+
+size_t PcSampler::captureSize() const {
+    return isEnabled() && !_timer ? headerSize + _entries * entrySize : 0;
+}
+
+size_t PcSampler::read(size_t offset, uint8_t* dest, size_t length) const {
+    size_t total = captureSize();
+    if (offset >= total) {
+        return 0;
+    }
+    if (length > total - offset) {
+        length = total - offset;
+    }
+    uint32_t header[3] = { _hz, _samples, _lost };
+    for (size_t i = 0; i < length; i++, offset++) {
+        uint32_t word;
+        size_t at;
+        if (offset < sizeof(kProfileMagic)) {
+            dest[i] = kProfileMagic[offset];
+            continue;
+        } else if (offset < headerSize) {
+            at = offset - sizeof(kProfileMagic);
+            word = header[at / 4];
+        } else {
+            at = offset - headerSize;
+            size_t entry = at / entrySize;
+            word = (at % entrySize) < 4 ? _pcs[entry] : _counts[entry];
+        }
+        dest[i] = (uint8_t)(word >> (8 * (at % 4)));
+    }
+    return length;
+}
+
+
+// =================================================================
+// CounterInputs Implementation
+// =================================================================
+static const int16_t kCounterHighLimit = 32767;
+static const uint32_t kGlitchFilterNs = 1000;
+static portMUX_TYPE sCaptureLock = portMUX_INITIALIZER_UNLOCKED;
+
+#define DEWAB_PCNT_DRIVER_V5 (SOC_PCNT_SUPPORTED && ESP_ARDUINO_VERSION_MAJOR >= 3)
+#define DEWAB_PCNT_DRIVER_LEGACY (SOC_PCNT_SUPPORTED && ESP_ARDUINO_VERSION_MAJOR < 3)
+#define DEWAB_MCPWM_DRIVER_V5 (SOC_MCPWM_SUPPORTED && ESP_ARDUINO_VERSION_MAJOR >= 3)
+#define DEWAB_MCPWM_DRIVER_LEGACY (SOC_MCPWM_SUPPORTED && ESP_ARDUINO_VERSION_MAJOR < 3)
+
+#if DEWAB_MCPWM_DRIVER_V5
+static bool IRAM_ATTR onCaptureEvent(mcpwm_cap_channel_handle_t, const mcpwm_capture_event_data_t* edata, void* capture) {
+    CounterInputs::onEdge((CounterInputs::Capture*)capture, edata->cap_edge == MCPWM_CAP_EDGE_POS, edata->cap_value);
+    return false;
+}
+#elif DEWAB_MCPWM_DRIVER_LEGACY
+static bool IRAM_ATTR onCaptureEvent(mcpwm_unit_t, mcpwm_capture_channel_id_t, const cap_event_data_t* edata, void* capture) {
+    CounterInputs::onEdge((CounterInputs::Capture*)capture, edata->cap_edge == MCPWM_POS_EDGE, edata->cap_value);
+    return false;
+}
+#endif
+
+CounterInputs::~CounterInputs() {
+    end();
+}
+
+void CounterInputs::setClock(DewabClock* clock) {
+    _clock = clock;
+}
+
+void CounterInputs::setStallTimeout(unsigned long stallTimeoutMs) {
+    _stallTimeoutMs = stallTimeoutMs;
+}
+
+// Remembers pins whose setup failed, so a state update does not retry the
+// driver and log the error again each time
+static bool failedBefore(const int* pins, size_t count, int pin) {
+    for (size_t i = 0; i < count; i++) {
+        if (pins[i] == pin) return true;
+    }
+    return false;
+}
+
+static void rememberFailure(int* pins, size_t& count, size_t capacity, int pin) {
+    if (count < capacity) pins[count++] = pin;
+}
+
+bool CounterInputs::beginCount(int pin) {
+    if (findCounter(pin)) {
+        return true;
+    }
+    if (failedBefore(_failedCounters, _failedCounterCount, pin)) {
+        return false;
+    }
+    if (!setUpCounter(pin)) {
+        rememberFailure(_failedCounters, _failedCounterCount, maxFailedPins, pin);
+        return false;
+    }
+    return true;
+}
+
+bool CounterInputs::beginCapture(int pin) {
+    if (findCapture(pin)) {
+        return true;
+    }
+    if (failedBefore(_failedCaptures, _failedCaptureCount, pin)) {
+        return false;
+    }
+    if (!setUpCapture(pin)) {
+        rememberFailure(_failedCaptures, _failedCaptureCount, maxFailedPins, pin);
+        return false;
+    }
+    return true;
+}
+
+bool CounterInputs::setUpCounter(int pin) {
+#if !SOC_PCNT_SUPPORTED
+    DewabLog::write(DEWAB_LOG_ERROR, "counter", "No pulse counter (PCNT) on this chip for pin %d", pin);
+    return false;
+#else
+    if (_counterCount >= maxCounters) {
+        DewabLog::write(DEWAB_LOG_ERROR, "counter", "No free pulse counter for pin %d", pin);
+        return false;
+    }
+    Counter& counter = _counters[_counterCount];
+    counter.number = (int)_counterCount;
+    counter.overflows = 0;
+#if DEWAB_PCNT_DRIVER_V5
+    // accum_count makes the driver add each high-limit overflow to the count it reports
+    pcnt_unit_config_t unitConfig = {};
+    unitConfig.low_limit = -1;
+    unitConfig.high_limit = kCounterHighLimit;
+    unitConfig.flags.accum_count = 1;
+    pcnt_unit_handle_t unit = nullptr;
+    if (pcnt_new_unit(&unitConfig, &unit) != ESP_OK) {
+        DewabLog::write(DEWAB_LOG_ERROR, "counter", "Cannot allocate a PCNT unit for pin %d", pin);
+        return false;
+    }
+    pcnt_glitch_filter_config_t filter = {};
+    filter.max_glitch_ns = kGlitchFilterNs;
+    pcnt_chan_config_t channelConfig = {};
+    channelConfig.edge_gpio_num = pin;
+    channelConfig.level_gpio_num = -1;
+    pcnt_channel_handle_t channel = nullptr;
+    if (pcnt_unit_set_glitch_filter(unit, &filter) != ESP_OK ||
+        pcnt_new_channel(unit, &channelConfig, &channel) != ESP_OK ||
+        pcnt_channel_set_edge_action(channel, PCNT_CHANNEL_EDGE_ACTION_INCREASE, PCNT_CHANNEL_EDGE_ACTION_HOLD) != ESP_OK ||
+        pcnt_unit_add_watch_point(unit, kCounterHighLimit) != ESP_OK ||
+        pcnt_unit_enable(unit) != ESP_OK) {
+        DewabLog::write(DEWAB_LOG_ERROR, "counter", "Cannot set up the PCNT unit for pin %d", pin);
+        if (channel) pcnt_del_channel(channel);
+        pcnt_del_unit(unit);
+        return false;
+    }
+    pcnt_unit_clear_count(unit);
+    pcnt_unit_start(unit);
+    counter.unit = unit;
+    counter.channel = channel;
+#else
+    pcnt_unit_t unit = (pcnt_unit_t)_counterCount;
+    pcnt_config_t config = {};
+    config.pulse_gpio_num = pin;
+    config.ctrl_gpio_num = PCNT_PIN_NOT_USED;
+    config.channel = PCNT_CHANNEL_0;
+    config.unit = unit;
+    config.pos_mode = PCNT_COUNT_INC;
+    config.neg_mode = PCNT_COUNT_DIS;
+    config.lctrl_mode = PCNT_MODE_KEEP;
+    config.hctrl_mode = PCNT_MODE_KEEP;
+    config.counter_h_lim = kCounterHighLimit;
+    config.counter_l_lim = -1;
+    if (pcnt_unit_config(&config) != ESP_OK) {
+        DewabLog::write(DEWAB_LOG_ERROR, "counter", "Cannot set up PCNT unit %d for pin %d", (int)unit, pin);
+        return false;
+    }
+    // The filter is given in APB clock cycles (80 MHz), at most 1023
+    pcnt_set_filter_value(unit, kGlitchFilterNs * 80 / 1000);
+    pcnt_filter_enable(unit);
+    pcnt_event_enable(unit, PCNT_EVT_H_LIM);
+    pcnt_isr_service_install(0); // Fails harmlessly once installed
+    pcnt_isr_handler_add(unit, &CounterInputs::onOverflow, &counter);
+    pcnt_counter_pause(unit);
+    pcnt_counter_clear(unit);
+    pcnt_counter_resume(unit);
+#endif
+    counter.pin = pin;
+    _counterCount++;
+    DewabLog::write(DEWAB_LOG_INFO, "counter", "Counting pulses on pin %d", pin);
+    return true;
+#endif
+}
+
+bool CounterInputs::setUpCapture(int pin) {
+#if !SOC_MCPWM_SUPPORTED
+    DewabLog::write(DEWAB_LOG_ERROR, "counter", "No MCPWM capture on this chip for pin %d", pin);
+    return false;
+#else
+    if (_captureCount >= maxCaptures || _captureCount / 3 >= SOC_MCPWM_GROUPS) {
+        DewabLog::write(DEWAB_LOG_ERROR, "counter", "No free capture channel for pin %d", pin);
+        return false;
+    }
+    Capture& capture = _captures[_captureCount];
+    capture.rise = capture.fall = capture.period = capture.high = capture.edges = 0;
+    capture.seenEdges = 0;
+    capture.seenAt = _clock->millis();
+    int group = _captureCount / 3;
+#if DEWAB_MCPWM_DRIVER_V5
+    if (!_captureTimers[group]) {
+        mcpwm_capture_timer_config_t timerConfig = {};
+        timerConfig.group_id = group;
+        timerConfig.clk_src = MCPWM_CAPTURE_CLK_SRC_DEFAULT;
+        mcpwm_cap_timer_handle_t timer = nullptr;
+        if (mcpwm_new_capture_timer(&timerConfig, &timer) != ESP_OK) {
+            DewabLog::write(DEWAB_LOG_ERROR, "counter", "Cannot allocate the MCPWM%d capture timer", group);
+            return false;
+        }
+        mcpwm_capture_timer_enable(timer);
+        mcpwm_capture_timer_start(timer);
+        mcpwm_capture_timer_get_resolution(timer, &_captureHz);
+        _captureTimers[group] = timer;
+    }
+    mcpwm_capture_channel_config_t channelConfig = {};
+    channelConfig.gpio_num = pin;
+    channelConfig.prescale = 1;
+    channelConfig.flags.pos_edge = true;
+    channelConfig.flags.neg_edge = true;
+    mcpwm_cap_channel_handle_t channel = nullptr;
+    mcpwm_capture_event_callbacks_t callbacks = {};
+    callbacks.on_cap = onCaptureEvent;
+    if (mcpwm_new_capture_channel((mcpwm_cap_timer_handle_t)_captureTimers[group], &channelConfig, &channel) != ESP_OK ||
+        mcpwm_capture_channel_register_event_callbacks(channel, &callbacks, &capture) != ESP_OK ||
+        mcpwm_capture_channel_enable(channel) != ESP_OK) {
+        DewabLog::write(DEWAB_LOG_ERROR, "counter", "Cannot set up a capture channel for pin %d", pin);
+        if (channel) mcpwm_del_capture_channel(channel);
+        return false;
+    }
+    capture.channel = channel;
+#else
+    // The legacy capture timer always runs from the APB clock
+    int index = _captureCount % 3;
+    mcpwm_unit_t unit = (mcpwm_unit_t)group;
+    mcpwm_gpio_init(unit, (mcpwm_io_signals_t)(MCPWM_CAP_0 + index), pin);
+    mcpwm_capture_config_t config = {};
+    config.cap_edge = MCPWM_BOTH_EDGE;
+    config.cap_prescale = 1;
+    config.capture_cb = onCaptureEvent;
+    config.user_data = &capture;
+    if (mcpwm_capture_enable_channel(unit, (mcpwm_capture_channel_id_t)index, &config) != ESP_OK) {
+        DewabLog::write(DEWAB_LOG_ERROR, "counter", "Cannot set up a capture channel for pin %d", pin);
+        return false;
+    }
+    _captureHz = APB_CLK_FREQ;
+#endif
+    capture.pin = pin;
+    _captureCount++;
+    DewabLog::write(DEWAB_LOG_INFO, "counter", "Capturing edges on pin %d", pin);
+    return true;
+#endif
+}
+
+void CounterInputs::end() {
+#if DEWAB_PCNT_DRIVER_V5
+    for (size_t i = 0; i < _counterCount; i++) {
+        pcnt_unit_handle_t unit = (pcnt_unit_handle_t)_counters[i].unit;
+        pcnt_unit_stop(unit);
+        pcnt_unit_disable(unit);
+        pcnt_del_channel((pcnt_channel_handle_t)_counters[i].channel);
+        pcnt_del_unit(unit);
+        _counters[i].unit = nullptr;
+        _counters[i].channel = nullptr;
+    }
+#elif DEWAB_PCNT_DRIVER_LEGACY
+    for (size_t i = 0; i < _counterCount; i++) {
+        pcnt_counter_pause((pcnt_unit_t)i);
+        pcnt_isr_handler_remove((pcnt_unit_t)i);
+    }
+#endif
+#if DEWAB_MCPWM_DRIVER_V5
+    for (size_t i = 0; i < _captureCount; i++) {
+        mcpwm_cap_channel_handle_t channel = (mcpwm_cap_channel_handle_t)_captures[i].channel;
+        mcpwm_capture_channel_disable(channel);
+        mcpwm_del_capture_channel(channel);
+        _captures[i].channel = nullptr;
+    }
+    for (void*& timer : _captureTimers) {
+        if (!timer) continue;
+        mcpwm_capture_timer_stop((mcpwm_cap_timer_handle_t)timer);
+        mcpwm_capture_timer_disable((mcpwm_cap_timer_handle_t)timer);
+        mcpwm_del_capture_timer((mcpwm_cap_timer_handle_t)timer);
+        timer = nullptr;
+    }
+#elif DEWAB_MCPWM_DRIVER_LEGACY
+    for (size_t i = 0; i < _captureCount; i++) {
+        mcpwm_capture_disable_channel((mcpwm_unit_t)(i / 3), (mcpwm_capture_channel_id_t)(i % 3));
+    }
+#endif
+    for (Counter& counter : _counters) counter.pin = -1;
+    for (Capture& capture : _captures) capture.pin = -1;
+    _counterCount = 0;
+    _captureCount = 0;
+    _failedCounterCount = 0;
+    _failedCaptureCount = 0;
+}
+
+const CounterInputs::Counter* CounterInputs::findCounter(int pin) const {
+    for (size_t i = 0; i < _counterCount; i++) {
+        if (_counters[i].pin == pin) return &_counters[i];
+    }
+    return nullptr;
+}
+
+CounterInputs::Capture* CounterInputs::findCapture(int pin) {
+    for (size_t i = 0; i < _captureCount; i++) {
+        if (_captures[i].pin == pin) return &_captures[i];
+    }
+    return nullptr;
+}
+
+uint32_t CounterInputs::count(int pin) const {
+    const Counter* counter = findCounter(pin);
+    if (!counter) {
+        return 0;
+    }
+#if DEWAB_PCNT_DRIVER_V5
+    int value = 0;
+    pcnt_unit_get_count((pcnt_unit_handle_t)counter->unit, &value);
+    return (uint32_t)value;
+#elif DEWAB_PCNT_DRIVER_LEGACY
+    // Retry if an overflow lands between the two reads
+    int32_t overflows;
+    int16_t value;
+    do {
+        overflows = counter->overflows;
+        pcnt_get_counter_value((pcnt_unit_t)counter->number, &value);
+    } while (overflows != counter->overflows);
+    return (uint32_t)overflows * kCounterHighLimit + (uint16_t)value;
+#else
+    return 0;
+#endif
+}
+
+bool CounterInputs::isStalled(Capture& capture) {
+    uint32_t edges = capture.edges;
+    unsigned long now = _clock->millis();
+    if (edges != capture.seenEdges) {
+        capture.seenEdges = edges;
+        capture.seenAt = now;
+        return false;
+    }
+    return now - capture.seenAt >= _stallTimeoutMs;
+}
+
+float CounterInputs::frequency(int pin) {
+    Capture* capture = findCapture(pin);
+    if (!capture || isStalled(*capture)) {
+        return 0;
+    }
+    portENTER_CRITICAL(&sCaptureLock);
+    uint32_t period = capture->period;
+    portEXIT_CRITICAL(&sCaptureLock);
+    return period ? (float)_captureHz / period : 0;
+}
+
+float CounterInputs::dutyCycle(int pin) {
+    Capture* capture = findCapture(pin);
+    if (!capture) {
+        return 0;
+    }
+    if (isStalled(*capture)) {
+        return digitalRead(pin) ? 100 : 0;
+    }
+    portENTER_CRITICAL(&sCaptureLock);
+    uint32_t period = capture->period;
+    uint32_t high = capture->high;
+    portEXIT_CRITICAL(&sCaptureLock);
+    return period ? 100.0f * high / period : 0;
+}
+
+void IRAM_ATTR CounterInputs::onEdge(Capture* capture, bool rising, uint32_t ticks) {
+    portENTER_CRITICAL_ISR(&sCaptureLock);
+    if (rising) {
+        // A cycle is complete at the second rising edge. A missed falling
+        // edge leaves `fall` before `rise`; the wrapped difference is clamped.
+        if (capture->edges > 0) {
+            uint32_t period = ticks - capture->rise;
+            uint32_t high = capture->fall - capture->rise;
+            capture->period = period;
+            capture->high = high < period ? high : period;
+        }
+        capture->rise = ticks;
+        capture->edges++;
+    } else {
+        capture->fall = ticks;
+    }
+    portEXIT_CRITICAL_ISR(&sCaptureLock);
+}
+
+void IRAM_ATTR CounterInputs::onOverflow(void* counter) {
+#if DEWAB_PCNT_DRIVER_LEGACY
+    Counter* self = (Counter*)counter;
+    uint32_t status = 0;
+    pcnt_get_event_status((pcnt_unit_t)self->number, &status);
+    if (status & PCNT_EVT_H_LIM) {
+        self->overflows++;
+    }
+#endif
+}
+
+
+// =================================================================
+// LogStreamer Implementation
+// =================================================================
+LogStreamer::~LogStreamer() {
+    end();
+}
+
+bool LogStreamer::begin(DewabLogLevel level, size_t maxRecords) {
+    end();
+    _records = (Record*)malloc(maxRecords * sizeof(Record));
+    if (!_records) {
+        DewabLog::write(DEWAB_LOG_ERROR, "log", "Log streamer: cannot allocate %u records", (unsigned)maxRecords);
+        return false;
+    }
+    _capacity = maxRecords;
+    _count = 0;
+    _baseLevel = level;
+    _raised = false;
+    _lastBatchAt = _clock->millis();
+    DewabLog::setSink([this](DewabLogLevel l, const char* tag, const char* text) { add(l, tag, text); }, level);
+    return true;
+}
+
+void LogStreamer::end() {
+    if (_records) DewabLog::setSink(nullptr, DEWAB_LOG_NONE);
+    free(_records);
+    _records = nullptr;
+    _capacity = 0;
+    _count = 0;
+}
+
+bool LogStreamer::isEnabled() const {
+    return _records != nullptr;
+}
+
+void LogStreamer::setClock(DewabClock* clock) {
+    _clock = clock;
+}
+
+void LogStreamer::raiseLevel(DewabLogLevel level, unsigned long durationMs) {
+    if (!isEnabled()) return;
+    _raised = true;
+    _raisedUntil = _clock->millis() + (durationMs < maxRaiseMs ? durationMs : maxRaiseMs);
+    DewabLog::setSinkLevel(level);
+}
+
+DewabLogLevel LogStreamer::level() const {
+    return DewabLog::sinkLevel();
+}
+
+unsigned long LogStreamer::raisedForMs() const {
+    return _raised ? _raisedUntil - _clock->millis() : 0;
+}
+
+bool LogStreamer::setSampling(const char* tag, uint16_t oneIn) {
+    TagSampling* freeSlot = nullptr;
+    for (size_t i = 0; i < samplingSlots; i++) {
+        if (strcmp(_sampling[i].tag, tag) == 0) {
+            _sampling[i].oneIn = oneIn;
+            _sampling[i].seen = 0;
+            return true;
+        }
+        if (!freeSlot && _sampling[i].tag[0] == '\0') freeSlot = &_sampling[i];
+    }
+    if (!freeSlot) return false;
+    strlcpy(freeSlot->tag, tag, tagBytes);
+    freeSlot->oneIn = oneIn;
+    freeSlot->seen = 0;
+    return true;
+}
+
+void LogStreamer::setPaused(bool paused) {
+    _paused = paused;
+}
+
+void LogStreamer::add(DewabLogLevel level, const char* tag, const char* text) {
+    if (_paused) return;
+    for (size_t i = 0; i < samplingSlots; i++) {
+        if (_sampling[i].tag[0] != '\0' && strcmp(_sampling[i].tag, tag) == 0) {
+            TagSampling& sampling = _sampling[i];
+            if (sampling.oneIn == 0 || sampling.seen++ % sampling.oneIn != 0) {
+                _stats.sampledOut++;
+                return;
+            }
+            break;
+        }
+    }
+    if (_count >= _capacity) {
+        _stats.dropped++;
+        return;
+    }
+    Record& record = _records[_count++];
+    record.at = _clock->millis();
+    record.level = level;
+    strlcpy(record.tag, tag, tagBytes);
+    strlcpy(record.text, text, textBytes);
+    _stats.queued++;
+}
+
+void LogStreamer::loop() {
+    if (_raised && (long)(_clock->millis() - _raisedUntil) >= 0) {
+        _raised = false;
+        DewabLog::setSinkLevel(_baseLevel);
+        DewabLog::write(DEWAB_LOG_INFO, "log", "Log streaming back to %s", levelName(_baseLevel));
+    }
+}
+
+bool LogStreamer::batchDue() const {
+    if (_count == 0) return false;
+    unsigned long sinceLast = _clock->millis() - _lastBatchAt;
+    return sinceLast >= flushInterval || (_count * 2 >= _capacity && sinceLast >= minFlushGap);
+}
+
+void LogStreamer::takeBatch(JsonDocument& doc) {
+    JsonArray records = doc["records"].to<JsonArray>();
+    for (size_t i = 0; i < _count; i++) {
+        JsonObject record = records.add<JsonObject>();
+        record["t"] = _records[i].at;
+        record["level"] = levelName(_records[i].level);
+        record["tag"] = _records[i].tag;
+        record["msg"] = _records[i].text;
+    }
+    doc["dropped"] = _stats.dropped;
+    doc["sampled_out"] = _stats.sampledOut;
+    _stats.sent += _count;
+    _stats.batches++;
+    _count = 0;
+    _lastBatchAt = _clock->millis();
+}
+
+const LogStreamStats& LogStreamer::stats() const {
+    return _stats;
+}
+
+const char* LogStreamer::levelName(DewabLogLevel level) {
+    switch (level) {
+        case DEWAB_LOG_ERROR: return "error";
+        case DEWAB_LOG_WARN: return "warn";
+        case DEWAB_LOG_INFO: return "info";
+        case DEWAB_LOG_DEBUG: return "debug";
+        default: return "none";
+    }
+}
+
+DewabLogLevel LogStreamer::levelFromName(const char* name, DewabLogLevel fallback) {
+    if (!name) return fallback;
+    for (int level = DEWAB_LOG_NONE; level <= DEWAB_LOG_DEBUG; level++) {
+        if (strcmp(name, levelName((DewabLogLevel)level)) == 0) return (DewabLogLevel)level;
+    }
+    return fallback;
+}
+
+
+// =================================================================
+// EnergyMonitor Implementation
+// =================================================================
+void EnergyMonitor::setPowerModel(const DewabPowerModel& model) {
+    _model = model;
+}
 
-void WifiManager::connect() {
-    Serial.printf("Connecting to WiFi: %s", _ssid);
+const DewabPowerModel& EnergyMonitor::powerModel() const {
+    return _model;
+}
 
-    WiFi.begin(_ssid, _password);
+void EnergyMonitor::setClock(DewabClock* clock) {
+    _clock = clock;
+}
 
-    unsigned long startTime = millis();
-    while (WiFi.status() != WL_CONNECTED) {
-        delay(500);
-        if (millis() - startTime > 10000) { // 10 second timeout for WiFi
-            Serial.println(" - FAILED (timeout after 10s)");
-            return;
-        }
+// Frames over one TCP segment go out as several packets, each with its own overhead
+uint32_t EnergyMonitor::airtimeMicros(size_t bytes) const {
+    const size_t segment = 1400;
+    size_t packets = bytes ? (bytes + segment - 1) / segment : 1;
+    float bits = (float)(bytes + packets * _model.packetOverheadBytes) * 8.0f;
+    return (uint32_t)(bits / _model.phyRateMbps) + packets * _model.packetOverheadMicros;
+}
+
+float EnergyMonitor::stateMa(DewabPowerState state) const {
+    switch (state) {
+        case DEWAB_POWER_PS_NONE:      return _model.psNoneMa;
+        case DEWAB_POWER_PS_MIN_MODEM: return _model.psMinModemMa;
+        case DEWAB_POWER_PS_MAX_MODEM: return _model.psMaxModemMa;
+        default:                       return _model.disconnectedMa;
     }
-    Serial.printf(" - CONNECTED (IP: %s)\n", WiFi.localIP().toString().c_str());
 }
 
-bool WifiManager::isConnected() {
-    return (WiFi.status() == WL_CONNECTED);
+// Extra current while the radio is busy, over what the current power state draws anyway
+float EnergyMonitor::incrementalMa(float activeMa) const {
+    float baseline = stateMa(_state);
+    return activeMa > baseline ? activeMa - baseline : 0.0f;
 }
 
-void WifiManager::loop() {
-    if (!isConnected()) {
-        unsigned long currentTime = millis();
-        if (currentTime - _lastReconnectAttempt > _reconnectInterval) {
-            Serial.printf("WiFi disconnected, reconnecting to %s...", _ssid);
-            connect();
-            _lastReconnectAttempt = currentTime;
-        }
+void EnergyMonitor::countTx(DewabFrameType type, size_t bytes) {
+    uint32_t airtime = airtimeMicros(bytes);
+    TrafficEnergy& tx = _tx[type];
+    tx.frames++;
+    tx.bytes += bytes;
+    tx.airtimeMicros += airtime;
+    tx.chargeMaMs += incrementalMa(_model.txMa) * airtime / 1000.0f;
+}
+
+void EnergyMonitor::countRx(size_t bytes) {
+    uint32_t airtime = airtimeMicros(bytes);
+    _rx.frames++;
+    _rx.bytes += bytes;
+    _rx.airtimeMicros += airtime;
+    _rx.chargeMaMs += incrementalMa(_model.rxMa) * airtime / 1000.0f;
+}
+
+void EnergyMonitor::countTlsHandshake() {
+    _tlsHandshakes++;
+    _tlsChargeMaMs += incrementalMa(_model.tlsHandshakeMa) * _model.tlsHandshakeMs;
+}
+
+void EnergyMonitor::addCpuMicros(uint32_t micros) {
+    _cpuMicros += micros;
+}
+
+void EnergyMonitor::loop(bool wifiConnected) {
+    unsigned long now = _clock->millis();
+    if (_lastLoopAt != 0) {
+        // The elapsed interval is charged to the state seen at its start
+        _residencyMs[_state] += now - _lastLoopAt;
+    }
+    _lastLoopAt = now ? now : 1;
+
+    wifi_ps_type_t ps = WIFI_PS_NONE;
+    if (!wifiConnected) {
+        _state = DEWAB_POWER_DISCONNECTED;
+    } else if (esp_wifi_get_ps(&ps) != ESP_OK || ps == WIFI_PS_NONE) {
+        _state = DEWAB_POWER_PS_NONE;
+    } else {
+        _state = ps == WIFI_PS_MAX_MODEM ? DEWAB_POWER_PS_MAX_MODEM : DEWAB_POWER_PS_MIN_MODEM;
+    }
+}
+
+float EnergyMonitor::windowMs() const {
+    float window = 0.0f;
+    for (int i = 0; i < DEWAB_POWER_STATE_COUNT; i++) {
+        window += _residencyMs[i];
+    }
+    return window;
+}
+
+// Share of the daily charge (mAh/day) of `chargeMaMs` spent over the window
+float EnergyMonitor::perDay(float chargeMaMs) const {
+    float window = windowMs();
+    return window > 0.0f ? chargeMaMs / window * 24.0f : 0.0f;
+}
+
+float EnergyMonitor::averageMa() const {
+    return mAhPerDay() / 24.0f;
+}
+
+float EnergyMonitor::mAhPerDay() const {
+    float charge = _rx.chargeMaMs + _tlsChargeMaMs + _cpuMicros / 1000.0f * _model.cpuBusyMa;
+    for (int i = 0; i < DEWAB_POWER_STATE_COUNT; i++) {
+        charge += _residencyMs[i] * stateMa((DewabPowerState)i);
+    }
+    for (int i = 0; i < DEWAB_FRAME_TYPE_COUNT; i++) {
+        charge += _tx[i].chargeMaMs;
+    }
+    return perDay(charge);
+}
+
+void EnergyMonitor::report(JsonDocument& doc) const {
+    static const char* stateNames[DEWAB_POWER_STATE_COUNT] = { "disconnected", "ps_none", "ps_min_modem", "ps_max_modem" };
+
+    float baseline = 0.0f;
+    JsonObject residency = doc["residency_ms"].to<JsonObject>();
+    for (int i = 0; i < DEWAB_POWER_STATE_COUNT; i++) {
+        residency[stateNames[i]] = _residencyMs[i];
+        baseline += _residencyMs[i] * stateMa((DewabPowerState)i);
+    }
+
+    TrafficEnergy txTotal;
+    JsonObject byType = doc["tx_by_type"].to<JsonObject>();
+    for (int i = 0; i < DEWAB_FRAME_TYPE_COUNT; i++) {
+        if (_tx[i].frames == 0) continue;
+        JsonObject type = byType[SupabaseRealtimeClient::frameTypeName((DewabFrameType)i)].to<JsonObject>();
+        type["frames"] = _tx[i].frames;
+        type["bytes"] = _tx[i].bytes;
+        type["airtime_ms"] = _tx[i].airtimeMicros / 1000;
+        type["mah_per_day"] = serialized(String(perDay(_tx[i].chargeMaMs), 3));
+        txTotal.frames += _tx[i].frames;
+        txTotal.bytes += _tx[i].bytes;
+        txTotal.airtimeMicros += _tx[i].airtimeMicros;
+        txTotal.chargeMaMs += _tx[i].chargeMaMs;
     }
+
+    doc["window_ms"] = (uint32_t)windowMs();
+    doc["avg_ma"] = serialized(String(averageMa(), 2));
+    doc["mah_per_day"] = serialized(String(mAhPerDay(), 1));
+    doc["tx_frames"] = txTotal.frames;
+    doc["tx_bytes"] = txTotal.bytes;
+    doc["tx_airtime_ms"] = txTotal.airtimeMicros / 1000;
+    doc["rx_frames"] = _rx.frames;
+    doc["rx_bytes"] = _rx.bytes;
+    doc["rx_airtime_ms"] = _rx.airtimeMicros / 1000;
+    doc["tls_handshakes"] = _tlsHandshakes;
+    doc["cpu_busy_ms"] = (uint32_t)(_cpuMicros / 1000);
+
+    JsonObject breakdown = doc["mah_per_day_by_source"].to<JsonObject>();
+    breakdown["baseline"] = serialized(String(perDay(baseline), 1));
+    breakdown["tx"] = serialized(String(perDay(txTotal.chargeMaMs), 2));
+    breakdown["rx"] = serialized(String(perDay(_rx.chargeMaMs), 2));
+    breakdown["tls"] = serialized(String(perDay(_tlsChargeMaMs), 2));
+    breakdown["cpu"] = serialized(String(perDay(_cpuMicros / 1000.0f * _model.cpuBusyMa), 2));
 }
 
+void EnergyMonitor::reset() {
+    for (int i = 0; i < DEWAB_POWER_STATE_COUNT; i++) {
+        _residencyMs[i] = 0;
+    }
+    for (int i = 0; i < DEWAB_FRAME_TYPE_COUNT; i++) {
+        _tx[i] = TrafficEnergy();
+    }
+    _rx = TrafficEnergy();
+    _tlsHandshakes = 0;
+    _tlsChargeMaMs = 0.0f;
+    _cpuMicros = 0;
+}
 
 // =================================================================
 // SupabaseRealtimeClient Implementation
@@ -47,7 +1585,10 @@ void WifiManager::loop() {
 // =================================================================
 SupabaseRealtimeClient::SupabaseRealtimeClient(const char* projectRef, const char* apiKey)
     : _projectRef(projectRef), _apiKey(apiKey) {
-    buildWebSocketUrl();
+    buildUrls(DewabEndpoint());
+    // Like the WebSocket, the REST client does not pin a certificate
+    _restClient.setInsecure();
+    setAccessToken(_apiKey);
 }
 
 SupabaseRealtimeClient::~SupabaseRealtimeClient() {
@@ -56,32 +1597,269 @@ SupabaseRealtimeClient::~SupabaseRealtimeClient() {
     }
 }
 
-void SupabaseRealtimeClient::buildWebSocketUrl() {
-    _wsHost = String(_projectRef) + ".supabase.co";
-    _wsPath = "/realtime/v1/websocket?apikey=" + String(_apiKey) + "&vsn=1.0.0";
-    Serial.printf("WebSocket URL built: %s%s\n", _wsHost.c_str(), _wsPath.c_str());
+bool SupabaseRealtimeClient::setEndpoint(const DewabEndpoint& endpoint) {
+    return setEndpoints(&endpoint, 1);
+}
+
+bool SupabaseRealtimeClient::setEndpoints(const DewabEndpoint* endpoints, size_t count) {
+    if (count == 0 || count > maxEndpoints) {
+        DewabLog::write(DEWAB_LOG_ERROR, "realtime", "Endpoint count %u not in 1..%u", (unsigned)count, (unsigned)maxEndpoints);
+        return false;
+    }
+    // Every endpoint must fit the URL buffers; the first one is built last and stays
+    for (size_t i = count; i-- > 0;) {
+        if (!buildUrls(endpoints[i])) {
+            buildUrls(_endpoints[_activeEndpoint]);
+            return false;
+        }
+    }
+    if (_webSocketStarted) {
+        DewabLog::write(DEWAB_LOG_WARN, "realtime", "Endpoint changed after connect(); used from the next connect()");
+    }
+    for (size_t i = 0; i < count; i++) {
+        _endpoints[i] = endpoints[i];
+        _endpointHealth[i] = EndpointHealth();
+        _probeAddresses[i] = IPAddress();
+    }
+    _endpointCount = count;
+    _activeEndpoint = 0;
+    _pendingEndpoint = SIZE_MAX;
+    _nextProbe = 0;
+    return true;
+}
+
+void SupabaseRealtimeClient::setFailover(uint8_t failuresBeforeSwitch, unsigned long probeIntervalMs) {
+    _failoverAfter = failuresBeforeSwitch ? failuresBeforeSwitch : 1;
+    _probeInterval = probeIntervalMs;
+}
+
+size_t SupabaseRealtimeClient::activeEndpoint() const {
+    return _activeEndpoint;
+}
+
+const EndpointHealth& SupabaseRealtimeClient::endpointHealth(size_t index) const {
+    return _endpointHealth[index < _endpointCount ? index : 0];
+}
+
+void SupabaseRealtimeClient::endpointReport(JsonDocument& doc) const {
+    doc["active"] = _activeEndpoint;
+    doc["switches"] = _endpointSwitches;
+    JsonArray list = doc["endpoints"].to<JsonArray>();
+    for (size_t i = 0; i < _endpointCount; i++) {
+        char host[hostCapacity];
+        endpointHost(_endpoints[i], host, sizeof(host));
+        const EndpointHealth& health = _endpointHealth[i];
+        JsonObject entry = list.add<JsonObject>();
+        entry["host"] = host;
+        entry["port"] = _endpoints[i].port;
+        entry["tls"] = _endpoints[i].tls;
+        entry["connects"] = health.connects;
+        entry["failures"] = health.failures;
+        entry["consecutive_failures"] = health.consecutiveFailures;
+        entry["connect_ms"] = health.connectMs;
+        entry["rtt_ms"] = health.rttMs;
+        entry["probe_ms"] = health.probeMs;
+    }
+}
+
+int SupabaseRealtimeClient::endpointHost(const DewabEndpoint& endpoint, char* dest, size_t size) const {
+    return endpoint.host ? snprintf(dest, size, "%s", endpoint.host)
+                         : snprintf(dest, size, "%s.supabase.co", _projectRef.c_str());
+}
+
+bool SupabaseRealtimeClient::buildUrls(const DewabEndpoint& endpoint) {
+    char host[hostCapacity];
+    char path[pathCapacity];
+    char restUrl[restUrlCapacity];
+    int hostLength = endpointHost(endpoint, host, sizeof(host));
+    int pathLength = snprintf(path, sizeof(path), "%s?apikey=%s&vsn=1.0.0%s%s", endpoint.path, _apiKey.c_str(),
+                              endpoint.query ? "&" : "", endpoint.query ? endpoint.query : "");
+    // The default port is left out of the REST URL, as HTTPClient would
+    bool defaultPort = endpoint.port == (endpoint.tls ? 443 : 80);
+    int restLength = defaultPort
+        ? snprintf(restUrl, sizeof(restUrl), "%s://%s%s", endpoint.tls ? "https" : "http", host, endpoint.restPath)
+        : snprintf(restUrl, sizeof(restUrl), "%s://%s:%u%s", endpoint.tls ? "https" : "http", host, endpoint.port, endpoint.restPath);
+    if (hostLength >= (int)sizeof(host) || pathLength >= (int)sizeof(path) || restLength >= (int)sizeof(restUrl)) {
+        DewabLog::write(DEWAB_LOG_ERROR, "realtime", "Endpoint too long (host %d/%u, path %d/%u, REST URL %d/%u bytes)",
+                        hostLength, (unsigned)sizeof(host) - 1, pathLength, (unsigned)sizeof(path) - 1, restLength, (unsigned)sizeof(restUrl) - 1);
+        if (_errorCallback) _errorCallback("Endpoint URL does not fit its buffer.");
+        return false;
+    }
+
+    memcpy(_wsHost, host, hostLength + 1);
+    memcpy(_wsPath, path, pathLength + 1);
+    memcpy(_restUrl, restUrl, restLength + 1);
+    _wsPort = endpoint.port;
+    _tls = endpoint.tls;
+    DewabLog::write(DEWAB_LOG_INFO, "realtime", "WebSocket URL built: %s://%s:%u%s", _tls ? "wss" : "ws", _wsHost, _wsPort, _wsPath);
+    return true;
 }
 
 void SupabaseRealtimeClient::connect() {
     if (_connected) {
-        Serial.println("WebSocket already connected");
+        DewabLog::write(DEWAB_LOG_DEBUG, "realtime", "WebSocket already connected");
         if (_errorCallback) _errorCallback("Already connected or connecting.");
         return;
     }
     webSocket.onEvent(std::bind(&SupabaseRealtimeClient::webSocketEvent, this, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
-    
-    Serial.printf("Connecting to WebSocket: %s%s\n", _wsHost.c_str(), _wsPath.c_str());
-    webSocket.beginSSL(_wsHost.c_str(), _wsPort, _wsPath.c_str());
+    startWebSocket();
+    _webSocketStarted = true;
+    _lastProbe = _clock->millis();
+}
+
+void SupabaseRealtimeClient::startWebSocket() {
+    DewabLog::write(DEWAB_LOG_INFO, "realtime", "Connecting to WebSocket: %s:%u%s", _wsHost, _wsPort, _wsPath);
+    if (_tls) {
+        webSocket.beginSSL(_wsHost, _wsPort, _wsPath);
+    } else {
+        webSocket.begin(_wsHost, _wsPort, _wsPath);
+    }
+    _attemptStarted = _clock->millis();
+    _heartbeatPending = false;
 }
 
 void SupabaseRealtimeClient::loop() {
-    webSocket.loop();
+    // The token also authorizes REST broadcasts, so refresh it in both modes
+    if (_tokenRefreshAt != 0 && (long)(_clock->millis() - _tokenRefreshAt) >= 0) {
+        refreshAccessToken();
+    }
+
+    if (!_webSocketStarted) {
+        return; // REST-only publishing, nothing to service
+    }
+    {
+        Tracer::Scope traceScope(_tracer, DEWAB_TRACE_WS_LOOP, 0, true);
+        webSocket.loop();
+    }
+    unsigned long currentTime = _clock->millis();
     if (_connected) {
-        unsigned long currentTime = millis();
         if (currentTime - _lastHeartbeatSent >= _heartbeatInterval) {
+            if (_heartbeatPending) {
+                noteEndpointFailure("missed heartbeat");
+            }
             sendHeartbeat();
         }
+    } else if (currentTime - _attemptStarted >= _connectTimeout) {
+        // WebSocketsClient retries failed TCP connects without an event
+        _attemptStarted = currentTime;
+        noteEndpointFailure("connect timeout");
+    }
+
+    if (_pendingEndpoint != SIZE_MAX) {
+        size_t index = _pendingEndpoint;
+        _pendingEndpoint = SIZE_MAX;
+        switchEndpoint(index);
+    } else if (_connected && _endpointCount > 1 && _probeInterval && currentTime - _lastProbe >= _probeInterval) {
+        if (probeNextEndpoint()) {
+            _lastProbe = currentTime;
+        }
+    }
+}
+
+void SupabaseRealtimeClient::noteEndpointFailure(const char* reason) {
+    EndpointHealth& health = _endpointHealth[_activeEndpoint];
+    health.failures++;
+    if (health.consecutiveFailures < 255) health.consecutiveFailures++;
+    health.lastFailure = _clock->millis();
+    DewabLog::write(DEWAB_LOG_WARN, "realtime", "Endpoint %s: %s (%u in a row)", _wsHost, reason, health.consecutiveFailures);
+    if (_endpointCount > 1 && health.consecutiveFailures >= _failoverAfter) {
+        _pendingEndpoint = nextHealthyEndpoint();
+    }
+}
+
+size_t SupabaseRealtimeClient::nextHealthyEndpoint() const {
+    unsigned long now = _clock->millis();
+    for (size_t step = 1; step < _endpointCount; step++) {
+        size_t index = (_activeEndpoint + step) % _endpointCount;
+        const EndpointHealth& health = _endpointHealth[index];
+        if (health.consecutiveFailures < _failoverAfter || now - health.lastFailure >= _failoverCooldown) {
+            return index;
+        }
+    }
+    // All of them are failing: keep going round in order
+    return (_activeEndpoint + 1) % _endpointCount;
+}
+
+void SupabaseRealtimeClient::switchEndpoint(size_t index) {
+    if (index == _activeEndpoint || !buildUrls(_endpoints[index])) {
+        return;
+    }
+    DewabLog::write(DEWAB_LOG_WARN, "realtime", "Switching to endpoint %u (%s)", (unsigned)index, _wsHost);
+    if (_connected) {
+        _switching = true;
+        webSocket.disconnect();
+        _switching = false;
+    }
+    _activeEndpoint = index;
+    _endpointSwitches++;
+    _topicJoinRefs.clear();
+    startWebSocket();
+}
+
+// Returns false if this pass only resolved the host; the probe follows in the next one
+bool SupabaseRealtimeClient::probeNextEndpoint() {
+    size_t index = _nextProbe;
+    char host[hostCapacity];
+    endpointHost(_endpoints[index], host, sizeof(host));
+
+    // The connect timeout does not cover DNS, so a lookup gets a pass of its own
+    IPAddress& address = _probeAddresses[index];
+    bool resolved = (uint32_t)address != 0;
+    if (!resolved && WiFi.hostByName(host, address) == 1) {
+        return false;
+    }
+    _nextProbe = (_nextProbe + 1) % _endpointCount;
+
+    bool reachable = false;
+    uint32_t elapsed = 0;
+    if (resolved) {
+        WiFiClient probe;
+        unsigned long started = _clock->millis();
+        reachable = probe.connect(address, _endpoints[index].port, _probeTimeoutMs);
+        elapsed = _clock->millis() - started;
+        probe.stop();
+    }
+
+    EndpointHealth& health = _endpointHealth[index];
+    if (!reachable) {
+        DewabLog::write(DEWAB_LOG_INFO, "realtime", "Probe of %s failed", host);
+        address = IPAddress(); // The host may have moved; look it up again next time
+        if (index != _activeEndpoint) {
+            health.failures++;
+            if (health.consecutiveFailures < 255) health.consecutiveFailures++;
+            health.lastFailure = _clock->millis();
+        } else {
+            health.probeMs = 0; // Unmeasured, so any healthy candidate can take over
+        }
+        return true;
+    }
+    health.probeMs = health.probeMs ? (health.probeMs * 3 + elapsed) / 4 : elapsed;
+    if (index != _activeEndpoint) {
+        health.consecutiveFailures = 0;
+    }
+    if (_nextProbe != 0) {
+        return true; // Decide once per round, when all endpoints have a fresh probe
+    }
+
+    // An active endpoint without a probe time (never probed, or its last probe failed) loses to any measured one
+    uint32_t current = _endpointHealth[_activeEndpoint].probeMs;
+    if (current == 0) current = UINT32_MAX;
+    size_t best = _activeEndpoint;
+    uint32_t bestMs = current;
+    for (size_t i = 0; i < _endpointCount; i++) {
+        const EndpointHealth& candidate = _endpointHealth[i];
+        if (candidate.probeMs && candidate.consecutiveFailures == 0 && candidate.probeMs < bestMs) {
+            best = i;
+            bestMs = candidate.probeMs;
+        }
     }
+    // Only move for a clear win, a reconnect costs more than a few ms
+    if (best != _activeEndpoint && bestMs + bestMs / 4 + 5 < current) {
+        DewabLog::write(DEWAB_LOG_INFO, "realtime", "Endpoint %u is faster (%u vs %s ms)", (unsigned)best,
+                        (unsigned)bestMs, current == UINT32_MAX ? "unmeasured" : String(current).c_str());
+        switchEndpoint(best);
+    }
+    return true;
 }
 
 bool SupabaseRealtimeClient::isConnected() {
@@ -108,6 +1886,132 @@ void SupabaseRealtimeClient::onChannelJoined(ChannelJoinedCallback callback) {
     _channelJoinedCallback = callback;
 }
 
+void SupabaseRealtimeClient::onRefused(BroadcastCallback callback) {
+    _refusedCallback = callback;
+}
+
+void SupabaseRealtimeClient::onTokenRefresh(TokenRefreshCallback callback) {
+    _tokenRefreshCallback = callback;
+}
+
+void SupabaseRealtimeClient::setAccessToken(const String& token, unsigned long validForMs) {
+    _accessToken = token;
+
+    unsigned long lifetime = validForMs ? validForMs : jwtLifetimeMs(token);
+    if (lifetime == 0) {
+        _tokenRefreshAt = 0; // Non-expiring key, nothing to schedule
+    } else {
+        unsigned long lead = lifetime > 2 * _tokenRefreshMargin ? _tokenRefreshMargin : lifetime / 2;
+        _tokenRefreshAt = _clock->millis() + (lifetime - lead);
+        if (_tokenRefreshAt == 0) _tokenRefreshAt = 1;
+        DewabLog::write(DEWAB_LOG_INFO, "realtime", "Access token valid for %lus, refresh in %lus", lifetime / 1000, (lifetime - lead) / 1000);
+    }
+
+    pushAccessToken();
+}
+
+void SupabaseRealtimeClient::refreshAccessToken() {
+    if (!_tokenRefreshCallback) {
+        // Nothing can produce a new token; retrying would only repeat this error
+        DewabLog::write(DEWAB_LOG_ERROR, "realtime", "Access token expires and no onTokenRefresh callback is set");
+        if (_errorCallback) _errorCallback("Access token expires and cannot be refreshed.");
+        _tokenRefreshAt = 0;
+        return;
+    }
+    String token = _tokenRefreshCallback();
+    if (token.isEmpty()) {
+        DewabLog::write(DEWAB_LOG_WARN, "realtime", "Access token refresh failed, retrying");
+        if (_errorCallback) _errorCallback("Access token refresh failed.");
+        _tokenRefreshAt = _clock->millis() + _tokenRetryInterval;
+        return;
+    }
+    setAccessToken(token);
+}
+
+// Sends the current token to every joined channel (Phoenix "access_token" event)
+void SupabaseRealtimeClient::pushAccessToken() {
+    if (!_connected) {
+        return; // Picked up by the next phx_join
+    }
+
+    for (const auto& joined : _topicJoinRefs) {
+        JsonDocument doc;
+        doc["topic"] = joined.first;
+        doc["event"] = "access_token";
+        doc["payload"]["access_token"] = _accessToken;
+        doc["ref"] = getNextMessageRef();
+        doc["join_ref"] = joined.second;
+
+        String msg;
+        serializeJson(doc, msg);
+        if (sendFrame(msg, DEWAB_FRAME_ACCESS_TOKEN, joined.first.c_str(), "access_token")) {
+            DewabLog::write(DEWAB_LOG_DEBUG, "realtime", "Access token pushed: %s", joined.first.c_str());
+        } else {
+            DewabLog::write(DEWAB_LOG_WARN, "realtime", "Access token push failed: %s", joined.first.c_str());
+            if (_errorCallback) _errorCallback(String("WebSocket sendTXT failed for access_token: ") + joined.first);
+        }
+    }
+}
+
+// Remaining lifetime of a JWT: exp minus now once the clock is synced,
+// otherwise exp minus iat. 0 if the token is not a JWT or does not expire
+// within the millis() horizon; 1 if it has already expired.
+unsigned long SupabaseRealtimeClient::jwtLifetimeMs(const String& token) {
+    int first = token.indexOf('.');
+    int second = first < 0 ? -1 : token.indexOf('.', first + 1);
+    if (second < 0) {
+        return 0;
+    }
+
+    // base64url-decode the claims segment
+    String claims;
+    uint32_t bits = 0;
+    int bitCount = 0;
+    for (int i = first + 1; i < second; i++) {
+        char c = token[i];
+        int v;
+        if (c >= 'A' && c <= 'Z') v = c - 'A';
+        else if (c >= 'a' && c <= 'z') v = c - 'a' + 26;
+        else if (c >= '0' && c <= '9') v = c - '0' + 52;
+        else if (c == '-' || c == '+') v = 62;
+        else if (c == '_' || c == '/') v = 63;
+        else continue;
+        bits = (bits << 6) | v;
+        bitCount += 6;
+        if (bitCount >= 8) {
+            bitCount -= 8;
+            claims += (char)((bits >> bitCount) & 0xFF);
+        }
+    }
+
+    JsonDocument doc;
+    if (deserializeJson(doc, claims)) {
+        return 0;
+    }
+    if (!doc["exp"].is<long>()) {
+        return 0;
+    }
+    // Without a synced clock the token is assumed to be freshly issued.
+    // Lifetimes beyond the millis() horizon (e.g. the 10-year anon key) are
+    // treated as non-expiring.
+    time_t now = time(nullptr);
+    long lifetime;
+    if (now > 1600000000) {
+        lifetime = doc["exp"].as<long>() - (long)now;
+        if (lifetime <= 0) {
+            return 1;
+        }
+    } else if (doc["iat"].is<long>()) {
+        lifetime = doc["exp"].as<long>() - doc["iat"].as<long>();
+    } else {
+        return 0;
+    }
+    if (lifetime <= 0 || lifetime > 2000000L) {
+        return 0;
+    }
+    return (unsigned long)lifetime * 1000;
+}
+
 String SupabaseRealtimeClient::getNextMessageRef() {
     return String(_messageRefCounter++);
 }
@@ -116,6 +2020,8 @@ void SupabaseRealtimeClient::sendHeartbeat() {
     if (!_connected) {
         return;
     }
+    HeapMonitor::Scope heapScope(_heapMonitor, DEWAB_HEAP_SITE_HEARTBEAT);
+    Tracer::Scope traceScope(_tracer, DEWAB_TRACE_HEARTBEAT);
 
     String ref = getNextMessageRef();
     
@@ -128,33 +2034,35 @@ void SupabaseRealtimeClient::sendHeartbeat() {
     String msg;
     size_t written = serializeJson(doc, msg);
     if (written == 0) {
-        Serial.println("Heartbeat serialization failed");
+        DewabLog::write(DEWAB_LOG_ERROR, "realtime", "Heartbeat serialization failed");
         if (_errorCallback) _errorCallback("Failed to serialize heartbeat JSON.");
         return;
     }
-    Serial.printf("Heartbeat sent (ref: %s)\n", ref.c_str());
+    DewabLog::write(DEWAB_LOG_DEBUG, "realtime", "Heartbeat sent (ref: %s)", ref.c_str());
     
-    if (webSocket.sendTXT(msg)) {
-        _lastHeartbeatSent = millis();
+    if (_heapMonitor) _heapMonitor->countMessage();
+    if (sendFrame(msg, DEWAB_FRAME_HEARTBEAT, "phoenix", "heartbeat")) {
+        _lastHeartbeatSent = _clock->millis();
+        _heartbeatPending = true;
     } else {
-        Serial.println("Heartbeat send failed");
+        DewabLog::write(DEWAB_LOG_ERROR, "realtime", "Heartbeat send failed");
         if (_errorCallback) _errorCallback("WebSocket sendTXT failed for heartbeat.");
     }
 }
 
 void SupabaseRealtimeClient::joinChannel(const String& topic) {
     if (!_connected) {
-        Serial.println("Cannot join channel: not connected");
+        DewabLog::write(DEWAB_LOG_WARN, "realtime", "Cannot join channel: not connected");
         if (_errorCallback) _errorCallback("Cannot join channel: Not connected.");
         return;
     }
-    Serial.printf("Joining channel: %s\n", topic.c_str());
+    DewabLog::write(DEWAB_LOG_INFO, "realtime", "Joining channel: %s", topic.c_str());
     _joinChannel(topic.c_str());
 }
 
 void SupabaseRealtimeClient::_joinChannel(const char* channelTopic) {
     if (!_connected) {
-        Serial.printf("Cannot join %s: not connected\n", channelTopic);
+        DewabLog::write(DEWAB_LOG_WARN, "realtime", "Cannot join %s: not connected", channelTopic);
         return;
     }
 
@@ -166,7 +2074,7 @@ void SupabaseRealtimeClient::_joinChannel(const char* channelTopic) {
     doc["join_ref"] = ref;
 
     JsonObject payloadObj = doc["payload"].to<JsonObject>();
-    payloadObj["access_token"] = _apiKey;
+    payloadObj["access_token"] = _accessToken;
         
     JsonObject config = payloadObj["config"].to<JsonObject>();
     JsonObject broadcastConf = config["broadcast"].to<JsonObject>();
@@ -178,77 +2086,373 @@ void SupabaseRealtimeClient::_joinChannel(const char* channelTopic) {
     String msg;
     size_t written = serializeJson(doc, msg);
     if (written == 0) {
-        Serial.printf("Join serialization failed for: %s\n", channelTopic);
+        DewabLog::write(DEWAB_LOG_ERROR, "realtime", "Join serialization failed for: %s", channelTopic);
         if (_errorCallback) _errorCallback(String("Failed to serialize join JSON for topic: ") + channelTopic);
         return;
     }
-    Serial.printf("Channel join sent: %s (ref: %s)\n", channelTopic, ref.c_str());
+    DewabLog::write(DEWAB_LOG_DEBUG, "realtime", "Channel join sent: %s (ref: %s)", channelTopic, ref.c_str());
 
-    if (!webSocket.sendTXT(msg)) {
-        Serial.printf("Join send failed for: %s\n", channelTopic);
+    if (!sendFrame(msg, DEWAB_FRAME_JOIN, channelTopic, "phx_join")) {
+        DewabLog::write(DEWAB_LOG_ERROR, "realtime", "Join send failed for: %s", channelTopic);
         if (_errorCallback) _errorCallback(String("WebSocket sendTXT failed for join: ") + channelTopic);
     }
 }
 
 bool SupabaseRealtimeClient::broadcast(const String& topic, const String& event, const JsonDocument& payload) {
+    HeapMonitor::Scope heapScope(_heapMonitor, DEWAB_HEAP_SITE_BROADCAST);
     if (!_connected) {
-        Serial.println("Cannot broadcast: not connected");
+        DewabLog::write(DEWAB_LOG_WARN, "realtime", "Cannot broadcast: not connected");
         if (_errorCallback) _errorCallback("Cannot broadcast: Not connected.");
         return false;
     }
 
     auto it = _topicJoinRefs.find(topic);
     if (it == _topicJoinRefs.end()) {
-        Serial.printf("Cannot broadcast: not joined to %s\n", topic.c_str());
+        DewabLog::write(DEWAB_LOG_WARN, "realtime", "Cannot broadcast: not joined to %s", topic.c_str());
         if (_errorCallback) _errorCallback(String("Cannot broadcast: Not joined to topic ") + topic);
         return false;
     }
     String joinRef = it->second;
     String messageRef = getNextMessageRef();
 
+    JsonDocument compressed;
+    bool deflated = compressPayload(event, payload, compressed);
     JsonDocument doc;
+    buildBroadcastEnvelope(doc, topic, event, deflated ? compressed.as<JsonVariantConst>() : payload.as<JsonVariantConst>(), messageRef, joinRef);
+
+    String msgStr;
+    size_t written;
+    {
+        Tracer::Scope traceScope(_tracer, DEWAB_TRACE_SERIALIZE);
+        written = serializeJson(doc, msgStr);
+        traceScope.setArg(written);
+    }
+    if (written == 0) {
+        DewabLog::write(DEWAB_LOG_ERROR, "realtime", "Broadcast serialization failed for: %s", event.c_str());
+        if (_errorCallback) _errorCallback(String("Failed to serialize broadcast JSON for event: ") + event);
+        return false;
+    }
+
+    DewabLog::write(DEWAB_LOG_DEBUG, "realtime", "Broadcasting: %s -> %s (ref: %s)", topic.c_str(), event.c_str(), messageRef.c_str());
+    if (_heapMonitor) _heapMonitor->countMessage();
+
+    if (sendFrame(msgStr, frameTypeFor(event), topic.c_str(), event.c_str())) {
+        return true;
+    } else {
+        DewabLog::write(DEWAB_LOG_ERROR, "realtime", "Broadcast send failed for: %s", event.c_str());
+        if (_errorCallback) _errorCallback(String("WebSocket sendTXT failed for broadcast: ") + event);
+        return false;
+    }
+}
+
+void SupabaseRealtimeClient::buildBroadcastEnvelope(JsonDocument& doc, const String& topic, const String& event,
+                                                    JsonVariantConst payload, const String& ref, const String& joinRef) {
     doc["topic"] = topic;
     doc["event"] = "broadcast";
-    
+
     JsonObject nestedPayload = doc["payload"].to<JsonObject>();
     nestedPayload["type"] = "broadcast";
     nestedPayload["event"] = event;
-    nestedPayload["payload"] = payload.as<JsonObjectConst>();
+    nestedPayload["payload"] = payload;
 
-    doc["ref"] = messageRef;
+    doc["ref"] = ref;
     doc["join_ref"] = joinRef;
+}
 
-    String msgStr;
-    size_t written = serializeJson(doc, msgStr);
+bool SupabaseRealtimeClient::queueRestBroadcast(const String& topic, const String& event, const JsonDocument& payload) {
+    bool dropped = false;
+    if (pendingRestBroadcasts() >= _restBatchLimit && !flushRestBroadcasts()) {
+        // A failed flush keeps its batch; the newest update matters more than the oldest unsent one
+        JsonArray kept = _restBatch["messages"].as<JsonArray>();
+        while (kept.size() >= _restBatchLimit) {
+            String oldest = kept[0]["event"].as<const char*>();
+            DewabLog::write(DEWAB_LOG_WARN, "realtime", "REST batch full, dropping oldest: %s", oldest.c_str());
+            if (_errorCallback) _errorCallback(String("REST batch full, dropped broadcast: ") + oldest);
+            kept.remove(0);
+            dropped = true;
+        }
+    }
+
+    JsonArray messages = _restBatch["messages"].is<JsonArray>() ? _restBatch["messages"].as<JsonArray>() : _restBatch["messages"].to<JsonArray>();
+    JsonObject message = messages.add<JsonObject>();
+    // The REST endpoint takes the bare channel name, without the "realtime:" prefix
+    message["topic"] = topic.startsWith("realtime:") ? topic.substring(9) : topic;
+    message["event"] = event;
+    JsonDocument compressed;
+    message["payload"] = compressPayload(event, payload, compressed) ? compressed.as<JsonObjectConst>() : payload.as<JsonObjectConst>();
+
+    DewabLog::write(DEWAB_LOG_DEBUG, "realtime", "REST broadcast queued: %s -> %s (%u pending)", topic.c_str(), event.c_str(), (unsigned)pendingRestBroadcasts());
+    return !dropped;
+}
+
+bool SupabaseRealtimeClient::flushRestBroadcasts() {
+    size_t count = pendingRestBroadcasts();
+    if (count == 0) {
+        return true;
+    }
+    Tracer::Scope traceScope(_tracer, DEWAB_TRACE_REST);
+
+    // The batch is only cleared once the POST succeeded, so a failed flush is retried
+    String body;
+    size_t written = serializeJson(_restBatch, body);
     if (written == 0) {
-        Serial.printf("Broadcast serialization failed for: %s\n", event.c_str());
-        if (_errorCallback) _errorCallback(String("Failed to serialize broadcast JSON for event: ") + event);
+        _restBatch.clear();
+        DewabLog::write(DEWAB_LOG_ERROR, "realtime", "REST batch serialization failed");
+        if (_errorCallback) _errorCallback("Failed to serialize REST broadcast batch.");
+        return false;
+    }
+
+    WiFiClient& restClient = _tls ? _restClient : _restPlainClient;
+    if (!_restHttp.begin(restClient, _restUrl)) {
+        DewabLog::write(DEWAB_LOG_ERROR, "realtime", "REST begin failed: %s", _restUrl);
+        if (_errorCallback) _errorCallback(String("REST broadcast: could not open ") + _restUrl);
+        return false;
+    }
+    // Keep the connection open so the next flush skips the (TLS) handshake
+    _restHttp.setReuse(true);
+    _restHttp.addHeader("Content-Type", "application/json");
+    _restHttp.addHeader("apikey", _apiKey);
+    _restHttp.addHeader("Authorization", "Bearer " + _accessToken);
+
+    bool reused = restClient.connected();
+    int status = _restHttp.POST(body);
+    int responseSize = _restHttp.getSize();
+    _restHttp.end();
+
+    // Counted once per delivered batch, so retries of a failed POST do not inflate the stats
+    if (status < 200 || status >= 300) {
+        DewabLog::write(DEWAB_LOG_WARN, "realtime", "REST broadcast failed: %d (%u messages kept for retry)", status, (unsigned)count);
+        if (_errorCallback) _errorCallback(String("REST broadcast failed: ") + (status < 0 ? HTTPClient::errorToString(status) : String(status)));
         return false;
     }
+    // Request line and headers are roughly the size of the token plus 300 bytes
+    countFrame(DEWAB_FRAME_REST, body.length() + _accessToken.length() + _apiKey.length() + 300);
+    if (_energyMonitor) {
+        if (_tls && !reused) _energyMonitor->countTlsHandshake();
+        _energyMonitor->countRx(200 + (responseSize > 0 ? responseSize : 0));
+    }
+    for (JsonObjectConst message : _restBatch["messages"].as<JsonArrayConst>()) {
+        accountTraffic(message["topic"], message["event"], false, measureJson(message));
+    }
+    _restBatch.clear();
+    DewabLog::write(DEWAB_LOG_DEBUG, "realtime", "REST broadcast sent: %u messages, %u bytes", (unsigned)count, (unsigned)body.length());
+    return true;
+}
 
-    Serial.printf("Broadcasting: %s -> %s (ref: %s)\n", topic.c_str(), event.c_str(), messageRef.c_str());
+size_t SupabaseRealtimeClient::pendingRestBroadcasts() {
+    return _restBatch["messages"].is<JsonArray>() ? _restBatch["messages"].size() : 0;
+}
 
-    if (webSocket.sendTXT(msgStr)) {
-        return true;
+void SupabaseRealtimeClient::setRestBatchLimit(size_t limit) {
+    _restBatchLimit = limit ? limit : 1;
+}
+
+void SupabaseRealtimeClient::setHeapMonitor(HeapMonitor* monitor) {
+    _heapMonitor = monitor;
+}
+
+void SupabaseRealtimeClient::setTracer(Tracer* tracer) {
+    _tracer = tracer;
+}
+
+void SupabaseRealtimeClient::setClock(DewabClock* clock) {
+    _clock = clock;
+}
+
+void SupabaseRealtimeClient::setTrafficRecorder(TrafficRecorder* recorder) {
+    _recorder = recorder;
+}
+
+void SupabaseRealtimeClient::setEnergyMonitor(EnergyMonitor* monitor) {
+    _energyMonitor = monitor;
+}
+
+// Every outgoing WebSocket frame goes through here
+bool SupabaseRealtimeClient::sendFrame(String& frame, DewabFrameType type, const char* topic, const char* event) {
+    if (_recorder) _recorder->record(TrafficRecorder::OUTBOUND, (const uint8_t*)frame.c_str(), frame.length());
+    countFrame(type, frame.length());
+    accountTraffic(topic, event, false, frame.length());
+    Tracer::Scope traceScope(_tracer, DEWAB_TRACE_SEND, frame.length());
+    return webSocket.sendTXT(frame);
+}
+
+void SupabaseRealtimeClient::countFrame(DewabFrameType type, size_t bytes) {
+    FrameSizeStats& stats = _frameStats[type];
+    stats.count++;
+    stats.totalBytes += bytes;
+    stats.lastBytes = bytes;
+    if (bytes > stats.maxBytes) stats.maxBytes = bytes;
+    if (_energyMonitor) _energyMonitor->countTx(type, bytes);
+}
+
+DewabFrameType SupabaseRealtimeClient::frameTypeFor(const String& event) {
+    if (event.endsWith("_ACK")) return DEWAB_FRAME_ACK;
+    if (event.endsWith("_ERROR")) return DEWAB_FRAME_ERROR;
+    if (event.endsWith("_CHUNK")) return DEWAB_FRAME_CHUNK;
+    if (event == "ARDUINO_STATE_UPDATE") return DEWAB_FRAME_STATE;
+    return DEWAB_FRAME_BROADCAST;
+}
+
+const FrameSizeStats& SupabaseRealtimeClient::frameStats(DewabFrameType type) const {
+    return _frameStats[type];
+}
+
+void SupabaseRealtimeClient::resetFrameStats() {
+    for (int i = 0; i < DEWAB_FRAME_TYPE_COUNT; i++) {
+        _frameStats[i] = FrameSizeStats();
+    }
+}
+
+// Unknown topic or event (e.g. unparsable frames) and a full table go to "other"
+void SupabaseRealtimeClient::accountTraffic(const char* topic, const char* event, bool inbound, size_t bytes) {
+    BandwidthEntry* entry = &_bandwidthOther;
+    if (topic && event) {
+        size_t i = 0;
+        while (i < _bandwidthUsed && !(_bandwidth[i].event == event && _bandwidth[i].topic == topic)) {
+            i++;
+        }
+        if (i < _bandwidthUsed) {
+            entry = &_bandwidth[i];
+        } else if (_bandwidthUsed < bandwidthSlots) {
+            entry = &_bandwidth[_bandwidthUsed++];
+            entry->topic = topic;
+            entry->event = event;
+        }
+    }
+    if (inbound) {
+        entry->messagesIn++;
+        entry->bytesIn += bytes;
     } else {
-        Serial.printf("Broadcast send failed for: %s\n", event.c_str());
-        if (_errorCallback) _errorCallback(String("WebSocket sendTXT failed for broadcast: ") + event);
+        entry->messagesOut++;
+        entry->bytesOut += bytes;
+    }
+}
+
+void SupabaseRealtimeClient::bandwidthReport(JsonDocument& doc) const {
+    BandwidthEntry total;
+    JsonArray entries = doc["entries"].to<JsonArray>();
+    for (size_t i = 0; i <= _bandwidthUsed; i++) {
+        const BandwidthEntry& e = i < _bandwidthUsed ? _bandwidth[i] : _bandwidthOther;
+        if (e.messagesIn == 0 && e.messagesOut == 0) continue;
+        JsonObject row = entries.add<JsonObject>();
+        row["topic"] = i < _bandwidthUsed ? e.topic.c_str() : "other";
+        row["event"] = i < _bandwidthUsed ? e.event.c_str() : "other";
+        row["messages_in"] = e.messagesIn;
+        row["bytes_in"] = e.bytesIn;
+        row["messages_out"] = e.messagesOut;
+        row["bytes_out"] = e.bytesOut;
+        total.messagesIn += e.messagesIn;
+        total.bytesIn += e.bytesIn;
+        total.messagesOut += e.messagesOut;
+        total.bytesOut += e.bytesOut;
+    }
+    doc["window_ms"] = _clock->millis() - _bandwidthSince;
+    doc["messages_in"] = total.messagesIn;
+    doc["bytes_in"] = total.bytesIn;
+    doc["messages_out"] = total.messagesOut;
+    doc["bytes_out"] = total.bytesOut;
+}
+
+void SupabaseRealtimeClient::resetBandwidth() {
+    for (size_t i = 0; i < _bandwidthUsed; i++) {
+        _bandwidth[i] = BandwidthEntry();
+    }
+    _bandwidthUsed = 0;
+    _bandwidthOther = BandwidthEntry();
+    _bandwidthSince = _clock->millis();
+}
+
+const char* SupabaseRealtimeClient::frameTypeName(DewabFrameType type) {
+    switch (type) {
+        case DEWAB_FRAME_HEARTBEAT:    return "heartbeat";
+        case DEWAB_FRAME_JOIN:         return "join";
+        case DEWAB_FRAME_ACCESS_TOKEN: return "access_token";
+        case DEWAB_FRAME_STATE:        return "state";
+        case DEWAB_FRAME_ACK:          return "ack";
+        case DEWAB_FRAME_ERROR:        return "error";
+        case DEWAB_FRAME_CHUNK:        return "chunk";
+        case DEWAB_FRAME_BROADCAST:    return "broadcast";
+        case DEWAB_FRAME_REST:         return "rest";
+        default:                       return "unknown";
+    }
+}
+
+void SupabaseRealtimeClient::setCompression(bool enabled, size_t threshold, uint16_t window) {
+    _compressionEnabled = enabled;
+    _compressionThreshold = threshold;
+    _compressionWindow = window;
+}
+
+const CompressionStats& SupabaseRealtimeClient::compressionStats() const {
+    return _compressionStats;
+}
+
+// Replaces a large payload by its deflated envelope. Returns false when the
+// payload should be sent as is.
+bool SupabaseRealtimeClient::compressPayload(const String& event, const JsonDocument& payload, JsonDocument& envelope) {
+    // Only the dashboard library inflates; replies, chunk uploads and logs stay
+    // plain so the tools can still match request_id and device_name
+    if (!_compressionEnabled || event != "ARDUINO_STATE_UPDATE") {
         return false;
     }
+    size_t rawLength = measureJson(payload);
+    if (rawLength < _compressionThreshold) {
+        _compressionStats.framesSkipped++;
+        return false;
+    }
+
+    unsigned long started = micros();
+    String raw;
+    raw.reserve(rawLength + 1);
+    serializeJson(payload, raw);
+
+    // Base64 grows the output by 4/3, so anything above 3/4 of the input is a loss
+    size_t capacity = rawLength * 3 / 4;
+    uint8_t* deflated = (uint8_t*)malloc(capacity);
+    size_t deflatedLength = deflated ? DeflateEncoder::compress((const uint8_t*)raw.c_str(), rawLength, deflated, capacity, _compressionWindow) : 0;
+    if (deflatedLength == 0) {
+        free(deflated);
+        _compressionStats.framesSkipped++;
+        _compressionStats.cpuMicros += micros() - started;
+        return false;
+    }
+    String encoded = base64::encode(deflated, deflatedLength);
+    free(deflated);
+
+    envelope["_z"] = "deflate-raw";
+    if (payload["device_name"].is<const char*>()) {
+        envelope["device_name"] = payload["device_name"];
+    }
+    envelope["n"] = rawLength;
+    envelope["d"] = encoded;
+
+    _compressionStats.framesCompressed++;
+    _compressionStats.bytesIn += rawLength;
+    _compressionStats.bytesOut += encoded.length();
+    _compressionStats.cpuMicros += micros() - started;
+    DewabLog::write(DEWAB_LOG_DEBUG, "realtime", "Payload compressed: %u -> %u bytes", (unsigned)rawLength, (unsigned)encoded.length());
+    return true;
 }
 
 void SupabaseRealtimeClient::webSocketEvent(WStype_t type, uint8_t * payloadArg, size_t length) {
     switch (type) {
         case WStype_DISCONNECTED:
             _connected = false;
-            Serial.println("WebSocket disconnected");
+            DewabLog::write(DEWAB_LOG_WARN, "realtime", "WebSocket disconnected");
+            if (!_switching) {
+                _attemptStarted = _clock->millis();
+                noteEndpointFailure("disconnected");
+            }
             if (_disconnectedCallback) _disconnectedCallback();
             break;
         case WStype_CONNECTED:
             _connected = true;
-            _lastHeartbeatSent = millis(); 
+            _lastHeartbeatSent = _clock->millis(); 
             _messageRefCounter = 1; 
-            Serial.printf("WebSocket connected: %s\n", (char*)payloadArg); 
+            _endpointHealth[_activeEndpoint].connects++;
+            _endpointHealth[_activeEndpoint].connectMs = _clock->millis() - _attemptStarted;
+            if (_energyMonitor && _tls) _energyMonitor->countTlsHandshake();
+            DewabLog::write(DEWAB_LOG_INFO, "realtime", "WebSocket connected: %s", (char*)payloadArg); 
             sendHeartbeat();
             
             if (_connectedCallback) {
@@ -256,13 +2460,41 @@ void SupabaseRealtimeClient::webSocketEvent(WStype_t type, uint8_t * payloadArg,
             }
             break;
         case WStype_TEXT:
-            Serial.printf("WebSocket received (%d bytes)\n", length);
+            DewabLog::write(DEWAB_LOG_DEBUG, "realtime", "WebSocket received (%d bytes)", length);
             {
+                HeapMonitor::Scope heapScope(_heapMonitor, DEWAB_HEAP_SITE_RX);
+                if (_heapMonitor) _heapMonitor->countMessage();
+                if (_recorder) _recorder->record(TrafficRecorder::INBOUND, payloadArg, length);
+                if (_energyMonitor) _energyMonitor->countRx(length);
+                if (_maxFrameBytes && length > _maxFrameBytes) {
+                    _rxStats.oversize++;
+                    accountTraffic(nullptr, nullptr, true, length);
+                    DewabLog::write(DEWAB_LOG_WARN, "realtime", "Frame dropped: %u bytes exceeds limit of %u", (unsigned)length, (unsigned)_maxFrameBytes);
+                    if (_errorCallback) _errorCallback("Inbound frame exceeds size limit.");
+                    return;
+                }
+                if (_refuseAbove && length > _refuseAbove) {
+                    refuseFrame(payloadArg, length);
+                    return;
+                }
+
+                unsigned long started = micros();
+                uint32_t freeBefore = heap_caps_get_free_size(MALLOC_CAP_8BIT);
                 JsonDocument doc; 
-                DeserializationError error = deserializeJson(doc, payloadArg, length);
+                DeserializationError error;
+                {
+                    Tracer::Scope traceScope(_tracer, DEWAB_TRACE_PARSE, length);
+                    error = deserializeJson(doc, payloadArg, length, DeserializationOption::NestingLimit(_maxNesting));
+                }
+                // Another task may free memory meanwhile; that is not negative parse cost
+                int32_t heapDrop = (int32_t)freeBefore - (int32_t)heap_caps_get_free_size(MALLOC_CAP_8BIT);
+                uint32_t parseBytes = heapDrop > 0 ? (uint32_t)heapDrop : 0;
 
                 if (error) {
-                    Serial.printf("JSON parse failed: %s\n", error.c_str());
+                    _rxStats.parseErrors++;
+                    accountTraffic(nullptr, nullptr, true, length);
+                    finishRxFrame(started, payloadArg, length, parseBytes);
+                    DewabLog::write(DEWAB_LOG_WARN, "realtime", "JSON parse failed: %s", error.c_str());
                     if (_errorCallback) _errorCallback(String("JSON Deserialization failed: ") + error.c_str());
                     return;
                 }
@@ -271,6 +2503,8 @@ void SupabaseRealtimeClient::webSocketEvent(WStype_t type, uint8_t * payloadArg,
                 const char* event = doc["event"].as<const char*>();
                 JsonObjectConst jsonPayload = doc["payload"].as<JsonObjectConst>();
                 const char* msgRef = doc["ref"].as<const char*>();
+                const char* userEvent = event && strcmp(event, "broadcast") == 0 ? jsonPayload["event"].as<const char*>() : nullptr;
+                accountTraffic(topic, userEvent ? userEvent : event, true, length);
 
                 bool handled = false; 
 
@@ -280,12 +2514,12 @@ void SupabaseRealtimeClient::webSocketEvent(WStype_t type, uint8_t * payloadArg,
                             if (jsonPayload["status"] == "ok") {
                                 if (msgRef) { 
                                     _topicJoinRefs[topic] = String(msgRef); 
-                                    Serial.printf("Channel joined: %s (ref: %s)\n", topic, msgRef);
+                                    DewabLog::write(DEWAB_LOG_INFO, "realtime", "Channel joined: %s (ref: %s)", topic, msgRef);
                                     if (_channelJoinedCallback) {
                                         _channelJoinedCallback(topic, String(msgRef));
                                     }
                                 } else {
-                                    Serial.printf("Channel joined: %s (no ref)\n", topic);
+                                    DewabLog::write(DEWAB_LOG_INFO, "realtime", "Channel joined: %s (no ref)", topic);
                                     if (_channelJoinedCallback) {
                                         _channelJoinedCallback(topic, "");
                                     }
@@ -297,9 +2531,16 @@ void SupabaseRealtimeClient::webSocketEvent(WStype_t type, uint8_t * payloadArg,
 
                 if (topic && strcmp(topic, "phoenix") == 0 && event && strcmp(event, "phx_reply") == 0) {
                     if (jsonPayload && jsonPayload["status"] == "ok") {
-                        Serial.println("Phoenix heartbeat OK"); 
+                        DewabLog::write(DEWAB_LOG_DEBUG, "realtime", "Phoenix heartbeat OK"); 
+                        if (_heartbeatPending) {
+                            EndpointHealth& health = _endpointHealth[_activeEndpoint];
+                            uint32_t rtt = _clock->millis() - _lastHeartbeatSent;
+                            health.rttMs = health.rttMs ? (health.rttMs * 3 + rtt) / 4 : rtt;
+                            health.consecutiveFailures = 0;
+                            _heartbeatPending = false;
+                        }
                     } else {
-                        Serial.println("Phoenix heartbeat failed");
+                        DewabLog::write(DEWAB_LOG_WARN, "realtime", "Phoenix heartbeat failed");
                          if (_errorCallback) _errorCallback("Phoenix reply not OK.");
                     }
                     handled = true; 
@@ -313,12 +2554,13 @@ void SupabaseRealtimeClient::webSocketEvent(WStype_t type, uint8_t * payloadArg,
                         }
                     } else {
                        String reason = jsonPayload["response"].is<JsonVariant>() && jsonPayload["response"]["reason"].is<JsonVariant>() ? jsonPayload["response"]["reason"].as<String>() : "unknown reason";
-                       Serial.printf("Channel join failed: %s (%s)\n", topic, reason.c_str());
+                       DewabLog::write(DEWAB_LOG_ERROR, "realtime", "Channel join failed: %s (%s)", topic, reason.c_str());
                        if (_errorCallback) _errorCallback(String("Join failed for ") + topic + ": " + reason);
                     }
                     handled = true; 
                 }
                 else if (topic && event && strcmp(event, "broadcast") == 0 && _broadcastCallback) {
+                    Tracer::Scope traceScope(_tracer, DEWAB_TRACE_DISPATCH);
                     if (jsonPayload && 
                         jsonPayload["type"].as<String>() == "broadcast" && 
                         jsonPayload["event"].is<const char*>() &&
@@ -326,12 +2568,12 @@ void SupabaseRealtimeClient::webSocketEvent(WStype_t type, uint8_t * payloadArg,
                         
                         String userEvent = jsonPayload["event"].as<String>();
                         JsonObjectConst userPayload = jsonPayload["payload"].as<JsonObjectConst>();
-                        Serial.printf("Broadcast received: %s -> %s\n", topic, userEvent.c_str());
+                        DewabLog::write(DEWAB_LOG_DEBUG, "realtime", "Broadcast received: %s -> %s", topic, userEvent.c_str());
                         _broadcastCallback(topic, userEvent, userPayload);
                     } else {
-                        Serial.printf("Broadcast (raw or parse error): %s, Event: %s\n", topic, event);
+                        DewabLog::write(DEWAB_LOG_DEBUG, "realtime", "Broadcast (raw or parse error): %s, Event: %s", topic, event);
                         if (jsonPayload && jsonPayload["type"].is<const char*>()) {
-                             Serial.printf("  -> Received type: %s\n", jsonPayload["type"].as<const char*>());
+                             DewabLog::write(DEWAB_LOG_DEBUG, "realtime", "  -> Received type: %s", jsonPayload["type"].as<const char*>());
                         }
                         _broadcastCallback(topic, event, jsonPayload);
                     }
@@ -339,24 +2581,25 @@ void SupabaseRealtimeClient::webSocketEvent(WStype_t type, uint8_t * payloadArg,
                 }
 
                 if (!handled) { 
-                    Serial.printf("Unhandled message: %s/%s\n", topic ? topic : "null", event ? event : "null");
+                    DewabLog::write(DEWAB_LOG_DEBUG, "realtime", "Unhandled message: %s/%s", topic ? topic : "null", event ? event : "null");
                 }
+                finishRxFrame(started, payloadArg, length, parseBytes);
             }
             break;
         case WStype_BIN:
-            Serial.println("WebSocket received binary data");
+            DewabLog::write(DEWAB_LOG_DEBUG, "realtime", "WebSocket received binary data");
             break;
         case WStype_ERROR:
-            Serial.printf("WebSocket error: %s\n", (char*)payloadArg);
+            DewabLog::write(DEWAB_LOG_ERROR, "realtime", "WebSocket error: %s", (char*)payloadArg);
              if (_errorCallback) {
                 _errorCallback(String("WebSocket Error: ") + (char*)payloadArg);
             }
             break;
         case WStype_PONG:
-            Serial.println("WebSocket PONG received");
+            DewabLog::write(DEWAB_LOG_DEBUG, "realtime", "WebSocket PONG received");
             break;
         case WStype_PING:
-            Serial.println("WebSocket PING received");
+            DewabLog::write(DEWAB_LOG_DEBUG, "realtime", "WebSocket PING received");
             break;
         case WStype_FRAGMENT_TEXT_START:
         case WStype_FRAGMENT_BIN_START:
@@ -368,6 +2611,67 @@ void SupabaseRealtimeClient::webSocketEvent(WStype_t type, uint8_t * payloadArg,
     }
 }
 
+void SupabaseRealtimeClient::finishRxFrame(unsigned long started, const uint8_t* frame, size_t length, uint32_t parseBytes) {
+    uint32_t elapsed = micros() - started;
+    _rxStats.frames++;
+    _rxStats.lastMicros = elapsed;
+    _rxStats.lastBytes = length;
+    _rxStats.lastParseBytes = parseBytes;
+    if (parseBytes > _rxStats.maxParseBytes) {
+        _rxStats.maxParseBytes = parseBytes;
+    }
+    if (elapsed > _rxStats.maxMicros) {
+        _rxStats.maxMicros = elapsed;
+        size_t keep = length < RxStats::slowFrameKeep ? length : RxStats::slowFrameKeep;
+        _rxStats.slowestFrame = String((const char*)frame, keep);
+        DewabLog::write(DEWAB_LOG_INFO, "realtime", "Slowest frame so far: %lu us, %u bytes", (unsigned long)elapsed, (unsigned)length);
+    }
+}
+
+void SupabaseRealtimeClient::setInputLimits(size_t maxFrameBytes, uint8_t maxNesting) {
+    _maxFrameBytes = maxFrameBytes;
+    _maxNesting = maxNesting;
+}
+
+const RxStats& SupabaseRealtimeClient::rxStats() const {
+    return _rxStats;
+}
+
+void SupabaseRealtimeClient::setRefuseAbove(size_t bytes) {
+    _refuseAbove = bytes;
+}
+
+// Parses only what a reply needs, so the document stays small whatever the frame size
+void SupabaseRealtimeClient::refuseFrame(uint8_t* frame, size_t length) {
+    JsonDocument filter;
+    filter["topic"] = true;
+    filter["event"] = true;
+    filter["payload"]["event"] = true;
+    filter["payload"]["payload"]["target_device_name"] = true;
+    filter["payload"]["payload"]["device_name"] = true;
+    filter["payload"]["payload"]["request_id"] = true;
+
+    JsonDocument doc;
+    DeserializationError error = deserializeJson(doc, frame, length, DeserializationOption::Filter(filter),
+                                                 DeserializationOption::NestingLimit(_maxNesting));
+    _rxStats.refused++;
+    const char* topic = doc["topic"].as<const char*>();
+    const char* event = doc["event"].as<const char*>();
+    const char* userEvent = doc["payload"]["event"].as<const char*>();
+    bool broadcast = !error && topic && event && strcmp(event, "broadcast") == 0 && userEvent;
+    accountTraffic(topic, broadcast ? userEvent : event, true, length);
+    DewabLog::write(DEWAB_LOG_WARN, "realtime", "Frame refused: %u bytes over %u (%s)", (unsigned)length, (unsigned)_refuseAbove,
+                    broadcast ? userEvent : "not a broadcast");
+
+    if (broadcast && _refusedCallback) {
+        _refusedCallback(topic, userEvent, doc["payload"]["payload"].as<JsonObjectConst>());
+    }
+}
+
+void SupabaseRealtimeClient::resetRxStats() {
+    _rxStats = RxStats();
+}
+
 // =================================================================
 // Dewab Implementation
 // =================================================================
@@ -380,15 +2684,20 @@ Dewab::Dewab(const char* deviceName,
       _wifiManager(wifiSsid, wifiPassword), // Initialize WifiManager
       _supabaseClient(supabaseRef, supabaseKey) // Initialize SupabaseRealtimeClient
 {
+    _supabaseClient.setHeapMonitor(&_heapMonitor);
+    _supabaseClient.setTracer(&_tracer);
+    _supabaseClient.setTrafficRecorder(&_recorder);
+    _supabaseClient.setEnergyMonitor(&_energyMonitor);
 }
 
 void Dewab::begin() {
-    Serial.println("Dewab: Initializing...");
-    Serial.println("Dewab: Connecting to WiFi...");
+    DewabLog::write(DEWAB_LOG_INFO, "dewab", "Dewab: Initializing...");
+    registerBuiltinCommands();
+    DewabLog::write(DEWAB_LOG_INFO, "dewab", "Dewab: Connecting to WiFi...");
     _wifiManager.connect();
 
     if (_wifiManager.isConnected()) {
-        Serial.println("Dewab: WiFi connected. Setting up Supabase client callbacks...");
+        DewabLog::write(DEWAB_LOG_INFO, "dewab", "Dewab: WiFi connected. Setting up Supabase client callbacks...");
         
         // Set up Supabase client to call Dewab's own handlers
         // Using [this] to capture the current Dewab instance for the lambda
@@ -398,23 +2707,116 @@ void Dewab::begin() {
         _supabaseClient.onBroadcast([this](const String& t, const String& e, const JsonObjectConst& p){
             this->handleBroadcastCommand(t, e, p);
         });
+        _supabaseClient.onRefused([this](const String& t, const String& e, const JsonObjectConst& p){
+            this->handleRefusedCommand(t, e, p);
+        });
         _supabaseClient.onChannelJoined([this](const String& topic, const String& joinRef){
             this->handleSupabaseChannelJoined(topic, joinRef);
         });
         
-        Serial.println("Dewab: Connecting to Supabase...");
-        _supabaseClient.connect();
+        if (_listenForCommands) {
+            DewabLog::write(DEWAB_LOG_INFO, "dewab", "Dewab: Connecting to Supabase...");
+            _supabaseClient.connect();
+        } else {
+            DewabLog::write(DEWAB_LOG_INFO, "dewab", "Dewab: REST publishing only, WebSocket not opened");
+            if (_stateProvider) {
+                broadcastCurrentState("dewab_started");
+            }
+        }
     } else {
-        Serial.println("Dewab: WiFi connection failed. Dewab cannot operate fully.");
+        DewabLog::write(DEWAB_LOG_ERROR, "dewab", "Dewab: WiFi connection failed. Dewab cannot operate fully.");
     }
 }
 
 void Dewab::loop() {
+    unsigned long started = micros();
+    Tracer::Scope traceScope(&_tracer, DEWAB_TRACE_LOOP, 0, true);
     _wifiManager.loop(); // Handle WiFi connection maintenance
     if (_wifiManager.isConnected()) {
         _supabaseClient.loop(); // Process Supabase messages
+        if (_perfResetPending) {
+            _heapMonitor.resetSiteStats();
+            _supabaseClient.resetFrameStats();
+            _perfResetPending = false;
+        }
+
+        if (_supabaseClient.pendingRestBroadcasts() > 0 && _clock->millis() - _restBatchStarted >= _restFlushInterval) {
+            if (!flush()) {
+                _restBatchStarted = _clock->millis(); // Retry the kept batch one interval later
+            }
+        }
+
+        // Low priority: only when connected and memory is not tight
+        if (_logStreamer.isEnabled() && _logStreamer.batchDue() && _supabaseClient.isConnected() &&
+            _memoryLevel == DEWAB_MEMORY_NORMAL) {
+            JsonDocument batch;
+            batch["device_name"] = _deviceName;
+            _logStreamer.takeBatch(batch);
+            _logStreamer.setPaused(true);
+            _supabaseClient.broadcast(_commandTopic, "DEVICE_LOG", batch);
+            _logStreamer.setPaused(false);
+        }
+
+        if (_trafficReportInterval > 0 && _supabaseClient.isConnected() &&
+            _clock->millis() - _lastTrafficReport >= _trafficReportInterval) {
+            _lastTrafficReport = _clock->millis();
+            JsonDocument report;
+            report["device_name"] = _deviceName;
+            _supabaseClient.bandwidthReport(report);
+            _supabaseClient.broadcast(_commandTopic, "TRAFFIC_STATS", report);
+        }
+    }
+    expireCalls();
+    _heapMonitor.loop();
+    _logStreamer.loop();
+    _profiler.loop();
+    if (_heapMonitor.pressureLevel() != _memoryLevel) {
+        applyMemoryLevel(_heapMonitor.pressureLevel());
+    }
+    _energyMonitor.addCpuMicros(micros() - started);
+    _energyMonitor.loop(_wifiManager.isConnected());
+}
+
+void Dewab::setPublishMode(DewabPublishMode mode, bool listenForCommands) {
+    _publishMode = mode;
+    // Without the WebSocket there is no other way to publish
+    _listenForCommands = (mode == DEWAB_PUBLISH_WEBSOCKET) ? true : listenForCommands;
+}
+
+bool Dewab::flush() {
+    if (!_wifiManager.isConnected()) {
+        DewabLog::write(DEWAB_LOG_WARN, "dewab", "Dewab: Cannot flush state: WiFi not connected");
+        return false;
     }
-    // Specific periodic Dewab tasks could be added here if necessary
+    return _supabaseClient.flushRestBroadcasts();
+}
+
+bool Dewab::setEndpoint(const DewabEndpoint& endpoint) {
+    return _supabaseClient.setEndpoint(endpoint);
+}
+
+bool Dewab::setEndpoints(const DewabEndpoint* endpoints, size_t count) {
+    return _supabaseClient.setEndpoints(endpoints, count);
+}
+
+void Dewab::setFailover(uint8_t failuresBeforeSwitch, unsigned long probeIntervalMs) {
+    _supabaseClient.setFailover(failuresBeforeSwitch, probeIntervalMs);
+}
+
+void Dewab::setAccessToken(const String& token, unsigned long validForMs) {
+    _supabaseClient.setAccessToken(token, validForMs);
+}
+
+void Dewab::onTokenRefresh(TokenRefreshCallback callback) {
+    _supabaseClient.onTokenRefresh(callback);
+}
+
+void Dewab::setCompression(bool enabled, size_t threshold, uint16_t window) {
+    _supabaseClient.setCompression(enabled, threshold, window);
+}
+
+const CompressionStats& Dewab::compressionStats() const {
+    return _supabaseClient.compressionStats();
 }
 
 void Dewab::onStateUpdateRequest(StateProviderCallback callback) {
@@ -424,35 +2826,674 @@ void Dewab::onStateUpdateRequest(StateProviderCallback callback) {
 // New method to register a specific command handler
 void Dewab::registerCommand(const String& commandType, SpecificCommandHandler handler) {
     if (commandType.isEmpty() || !handler) {
-        Serial.printf("Dewab: Invalid attempt to register command: type '%s', handler is %s\n",
+        DewabLog::write(DEWAB_LOG_WARN, "dewab", "Dewab: Invalid attempt to register command: type '%s', handler is %s",
                       commandType.c_str(), handler ? "valid" : "null");
         return;
     }
     _registeredCommands[commandType] = handler;
-    Serial.printf("Dewab: Command '%s' registered.\n", commandType.c_str());
+    DewabLog::write(DEWAB_LOG_INFO, "dewab", "Dewab: Command '%s' registered.", commandType.c_str());
+}
+
+void Dewab::registerBuiltinCommands() {
+    auto addBuiltin = [this](const char* commandType, SpecificCommandHandler handler) {
+        if (_registeredCommands.find(commandType) == _registeredCommands.end()) {
+            _registeredCommands[commandType] = handler;
+        }
+    };
+
+    addBuiltin("HEAP_STATS", [this](const JsonObjectConst&, JsonDocument& reply) {
+        _heapMonitor.report(reply);
+        return true;
+    });
+
+    // {"reset": true} starts a new measurement window
+    addBuiltin("PERF_STATS", [this](const JsonObjectConst& payload, JsonDocument& reply) {
+        JsonObject sites = reply["sites"].to<JsonObject>();
+        for (int i = 0; i < DEWAB_HEAP_SITE_COUNT; i++) {
+            const HeapSiteStats& stats = _heapMonitor.siteStats((DewabHeapSite)i);
+            JsonObject site = sites[HeapMonitor::siteName((DewabHeapSite)i)].to<JsonObject>();
+            site["calls"] = stats.calls;
+            site["mean_micros"] = stats.calls ? stats.totalMicros / stats.calls : 0;
+            site["max_micros"] = stats.maxMicros;
+            site["net_bytes"] = stats.netBytes;
+            site["max_net_bytes"] = stats.maxNetBytes;
+        }
+        JsonObject frames = reply["frames"].to<JsonObject>();
+        for (int i = 0; i < DEWAB_FRAME_TYPE_COUNT; i++) {
+            const FrameSizeStats& stats = _supabaseClient.frameStats((DewabFrameType)i);
+            JsonObject frame = frames[SupabaseRealtimeClient::frameTypeName((DewabFrameType)i)].to<JsonObject>();
+            frame["count"] = stats.count;
+            frame["mean_bytes"] = stats.count ? stats.totalBytes / stats.count : 0;
+            frame["max_bytes"] = stats.maxBytes;
+        }
+        reply["free_bytes"] = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+        reply["largest_free_block"] = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+        // Applied in loop(), so this command's own RX, handling and reply are not counted
+        _perfResetPending = payload["reset"] == true;
+        return true;
+    });
+
+    // {"iterations": 100} runs each benchmark kernel that many times.
+    // loop() is blocked meanwhile, up to about a second at 1000.
+    addBuiltin("BENCH", [this](const JsonObjectConst& payload, JsonDocument& reply) {
+        uint32_t iterations = payload["iterations"].is<uint32_t>() ? payload["iterations"].as<uint32_t>() : 100;
+        if (iterations < 1 || iterations > 1000) {
+            reply["message"] = "iterations must be between 1 and 1000.";
+            return false;
+        }
+        benchmark(reply, iterations);
+        return true;
+    });
+
+    // {"reset": true} starts a new estimation window after replying
+    addBuiltin("ENERGY_STATS", [this](const JsonObjectConst& payload, JsonDocument& reply) {
+        _energyMonitor.report(reply);
+        if (payload["reset"] == true) {
+            _energyMonitor.reset();
+        }
+        return true;
+    });
+
+    // {"level": "debug", "duration_ms": 60000} streams more for a while;
+    // {"tag": "realtime", "sample": 10} keeps one in 10 records of a tag.
+    // Without arguments it only reports the current settings.
+    addBuiltin("LOG_LEVEL", [this](const JsonObjectConst& payload, JsonDocument& reply) {
+        if (!_logStreamer.isEnabled()) {
+            reply["message"] = "Log streaming not enabled.";
+            return false;
+        }
+        if (!payload["level"].isNull()) {
+            // A typo must not switch streaming off; levelFromName() falls back silently
+            const char* name = payload["level"].as<const char*>();
+            DewabLogLevel level = LogStreamer::levelFromName(name, DEWAB_LOG_NONE);
+            if (!name || strcmp(name, LogStreamer::levelName(level)) != 0) {
+                reply["message"] = "Unknown level; use none, error, warn, info or debug.";
+                return false;
+            }
+            unsigned long duration = payload["duration_ms"].is<unsigned long>() ? payload["duration_ms"].as<unsigned long>() : 60000;
+            _logStreamer.raiseLevel(level, duration);
+        }
+        if (payload["tag"].is<const char*>() && payload["sample"].is<uint16_t>()) {
+            if (!_logStreamer.setSampling(payload["tag"], payload["sample"].as<uint16_t>())) {
+                reply["message"] = "No free sampling slot.";
+                return false;
+            }
+        }
+        const LogStreamStats& stats = _logStreamer.stats();
+        reply["level"] = LogStreamer::levelName(_logStreamer.level());
+        reply["raised_for_ms"] = _logStreamer.raisedForMs();
+        reply["queued"] = stats.queued;
+        reply["sent"] = stats.sent;
+        reply["batches"] = stats.batches;
+        reply["sampled_out"] = stats.sampledOut;
+        reply["dropped"] = stats.dropped;
+        return true;
+    });
+
+    // Per topic/event message and byte counts; {"reset": true} starts a new window after replying
+    addBuiltin("TRAFFIC_STATS", [this](const JsonObjectConst& payload, JsonDocument& reply) {
+        _supabaseClient.bandwidthReport(reply);
+        if (payload["reset"] == true) {
+            _supabaseClient.resetBandwidth();
+        }
+        return true;
+    });
+
+    // Configured endpoints with their health and latency, the active one and the switch count
+    addBuiltin("ENDPOINT_STATS", [this](const JsonObjectConst&, JsonDocument& reply) {
+        _supabaseClient.endpointReport(reply);
+        return true;
+    });
+
+    // Stats up to the previous frame (this one is still being handled); {"reset": true} clears them afterwards
+    addBuiltin("RX_STATS", [this](const JsonObjectConst& payload, JsonDocument& reply) {
+        const RxStats& rx = _supabaseClient.rxStats();
+        reply["frames"] = rx.frames;
+        reply["oversize"] = rx.oversize;
+        reply["parse_errors"] = rx.parseErrors;
+        reply["last_micros"] = rx.lastMicros;
+        reply["last_bytes"] = rx.lastBytes;
+        reply["last_parse_bytes"] = rx.lastParseBytes;
+        reply["max_micros"] = rx.maxMicros;
+        reply["max_parse_bytes"] = rx.maxParseBytes;
+        reply["slowest_frame"] = rx.slowestFrame;
+        if (payload["reset"] == true) {
+            _supabaseClient.resetRxStats();
+        }
+        return true;
+    });
+
+    // {"window_ms": 10000, "hz": 1000}; the profile is fetched with PROFILE_DUMP afterwards
+    addBuiltin("PROFILE_START", [this](const JsonObjectConst& payload, JsonDocument& reply) {
+        if (!_profiler.isEnabled()) {
+            reply["message"] = "Profiler not enabled.";
+            return false;
+        }
+        unsigned long windowMs = payload["window_ms"].is<unsigned long>() ? payload["window_ms"].as<unsigned long>() : 10000;
+        uint32_t hz = payload["hz"].is<uint32_t>() ? payload["hz"].as<uint32_t>() : 1000;
+        if (hz == 0 || hz > 10000) {
+            reply["message"] = "hz must be between 1 and 10000.";
+            return false;
+        }
+        if (!_profiler.start(windowMs, hz)) {
+            reply["message"] = "Profiler already running.";
+            return false;
+        }
+        reply["window_ms"] = windowMs;
+        reply["hz"] = hz;
+        return true;
+    });
+
+    // Uploads the profile as PROFILE_DUMP_CHUNK broadcasts, ending a running window early
+    addBuiltin("PROFILE_DUMP", [this](const JsonObjectConst& payload, JsonDocument& reply) {
+        if (!_profiler.isEnabled()) {
+            reply["message"] = "Profiler not enabled.";
+            return false;
+        }
+        _profiler.stop();
+        size_t size = _profiler.captureSize();
+        bool sent = uploadChunked("PROFILE_DUMP_CHUNK", payload["request_id"], size,
+            [this](size_t offset, uint8_t* dest, size_t length) { return _profiler.read(offset, dest, length); });
+        reply["bytes"] = size;
+        reply["samples"] = _profiler.sampleCount();
+        reply["lost"] = _profiler.lostSamples();
+        reply["pcs"] = _profiler.entryCount();
+        return sent;
+    });
+
+    // Uploads the trace as TRACE_DUMP_CHUNK broadcasts; {"clear": true} empties it afterwards
+    addBuiltin("TRACE_DUMP", [this](const JsonObjectConst& payload, JsonDocument& reply) {
+        if (!_tracer.isEnabled()) {
+            reply["message"] = "Tracing not enabled.";
+            return false;
+        }
+        _tracer.setPaused(true); // Keep the upload itself out of the timeline
+        size_t size = _tracer.captureSize();
+        bool sent = uploadChunked("TRACE_DUMP_CHUNK", payload["request_id"], size,
+            [this](size_t offset, uint8_t* dest, size_t length) { return _tracer.read(offset, dest, length); });
+        reply["bytes"] = size;
+        reply["events"] = _tracer.eventCount();
+        reply["overwritten"] = _tracer.overwrittenEvents();
+        if (sent && payload["clear"] == true) {
+            _tracer.clear();
+        }
+        _tracer.setPaused(false);
+        return sent;
+    });
+
+    // Uploads the capture as RECORDER_DUMP_CHUNK broadcasts; {"clear": true} empties it afterwards
+    addBuiltin("RECORDER_DUMP", [this](const JsonObjectConst& payload, JsonDocument& reply) {
+        if (!_recorder.isEnabled()) {
+            reply["message"] = "Traffic recorder not enabled.";
+            return false;
+        }
+        _recorder.setPaused(true); // Keep the chunks themselves out of the ring
+        size_t size = _recorder.captureSize();
+        bool sent = uploadChunked("RECORDER_DUMP_CHUNK", payload["request_id"], size,
+            [this](size_t offset, uint8_t* dest, size_t length) { return _recorder.read(offset, dest, length); });
+        reply["bytes"] = size;
+        reply["records"] = _recorder.recordCount();
+        reply["dropped"] = _recorder.droppedRecords();
+        if (sent && payload["clear"] == true) {
+            _recorder.clear();
+        }
+        _recorder.setPaused(false);
+        return sent;
+    });
+}
+
+bool Dewab::uploadChunked(const String& event, JsonVariantConst requestId, size_t length,
+                          std::function<size_t(size_t offset, uint8_t* dest, size_t length)> reader,
+                          size_t chunkBytes) {
+    uint8_t* buffer = (uint8_t*)malloc(chunkBytes);
+    if (!buffer) {
+        DewabLog::write(DEWAB_LOG_ERROR, "dewab", "Dewab: Upload of %s failed: out of memory", event.c_str());
+        return false;
+    }
+
+    size_t total = (length + chunkBytes - 1) / chunkBytes;
+    bool ok = true;
+    for (size_t seq = 0; seq < total && ok; seq++) {
+        size_t n = reader(seq * chunkBytes, buffer, chunkBytes);
+
+        JsonDocument chunk;
+        chunk["device_name"] = _deviceName;
+        if (!requestId.isNull()) chunk["request_id"] = requestId;
+        chunk["seq"] = seq;
+        chunk["total"] = total;
+        chunk["data"] = base64::encode(buffer, n);
+        ok = _supabaseClient.broadcast(_commandTopic, event, chunk);
+    }
+    free(buffer);
+    DewabLog::write(DEWAB_LOG_INFO, "dewab", "Dewab: Uploaded %u bytes as %u %s chunks%s", (unsigned)length, (unsigned)total, event.c_str(), ok ? "" : " (failed)");
+    return ok;
+}
+
+bool Dewab::enableTrafficRecorder(size_t ringBytes, size_t maxFrameBytes) {
+    return _recorder.begin(ringBytes, maxFrameBytes);
+}
+
+TrafficRecorder& Dewab::trafficRecorder() {
+    return _recorder;
+}
+
+void Dewab::setInputLimits(size_t maxFrameBytes, uint8_t maxNesting) {
+    _supabaseClient.setInputLimits(maxFrameBytes, maxNesting);
+}
+
+const RxStats& Dewab::rxStats() const {
+    return _supabaseClient.rxStats();
+}
+
+void Dewab::setMemoryWatermarks(uint32_t lowBytes, uint32_t criticalBytes, size_t maxCommandBytes) {
+    _heapMonitor.setWatermarks(lowBytes, criticalBytes);
+    _pressureMaxCommandBytes = maxCommandBytes;
+    if (_memoryLevel != DEWAB_MEMORY_NORMAL) {
+        _supabaseClient.setRefuseAbove(_pressureMaxCommandBytes);
+    }
+}
+
+DewabMemoryLevel Dewab::memoryLevel() const {
+    return _memoryLevel;
+}
+
+// Everything here only touches existing state; nothing is allocated
+void Dewab::applyMemoryLevel(DewabMemoryLevel level) {
+    if (_memoryLevel == DEWAB_MEMORY_NORMAL) {
+        // Fingerprints may be stale; the first degraded update is a full state
+        _stateFieldCount = 0;
+    }
+    _memoryLevel = level;
+    switch (level) {
+        case DEWAB_MEMORY_NORMAL:
+            DewabLog::setCeiling(DEWAB_LOG_DEBUG);
+            _supabaseClient.setRestBatchLimit(SupabaseRealtimeClient::restBatchLimitDefault);
+            _supabaseClient.setRefuseAbove(0);
+            break;
+        case DEWAB_MEMORY_LOW:
+            DewabLog::setCeiling(DEWAB_LOG_INFO);
+            _supabaseClient.setRestBatchLimit(4);
+            _supabaseClient.setRefuseAbove(_pressureMaxCommandBytes);
+            break;
+        case DEWAB_MEMORY_CRITICAL:
+            DewabLog::setCeiling(DEWAB_LOG_WARN);
+            _supabaseClient.setRestBatchLimit(1);
+            _supabaseClient.setRefuseAbove(_pressureMaxCommandBytes);
+            break;
+    }
+}
+
+// What devices send on the command topic (replies, state, logs, chunk
+// uploads, call() requests) carries their device_name and no target. It is
+// never a command, and answering it would make every device reply to every
+// other one.
+static bool isDeviceBroadcast(const JsonObjectConst& payload) {
+    return payload && payload["device_name"].is<const char*>() && !payload["target_device_name"].is<const char*>();
+}
+
+void Dewab::handleRefusedCommand(const String& topic, const String& event, const JsonObjectConst& payload) {
+    if (topic != _commandTopic || isDeviceBroadcast(payload)) return;
+    const char* target = payload["target_device_name"].as<const char*>();
+    if (target && strcmp(target, _deviceName) != 0) return;
+
+    _heapMonitor.pressureStats().refusedCommands++;
+    JsonDocument reply;
+    reply["status"] = "error";
+    reply["message"] = "Command refused: device is low on memory.";
+    reply["original_command"] = event;
+    reply["device_name"] = _deviceName;
+    if (!payload["request_id"].isNull()) {
+        reply["request_id"] = payload["request_id"];
+    }
+    _supabaseClient.broadcast(topic, event + "_ERROR", reply);
+}
+
+// FNV-1a over whatever is printed to it, to fingerprint state values without a copy
+class FingerprintPrint : public Print {
+public:
+    uint32_t hash = 2166136261u;
+    size_t write(uint8_t c) override {
+        hash = (hash ^ c) * 16777619u;
+        return 1;
+    }
+};
+
+uint32_t Dewab::call(const char* event, const JsonDocument& payload, CallResponseCallback callback, unsigned long timeoutMs) {
+    if (!_supabaseClient.isConnected()) {
+        DewabLog::write(DEWAB_LOG_WARN, "dewab", "Dewab: Cannot call %s: Supabase not connected", event);
+        return 0;
+    }
+    PendingCall* slot = nullptr;
+    for (size_t i = 0; i < maxPendingCalls && !slot; i++) {
+        if (_pendingCalls[i].id == 0) slot = &_pendingCalls[i];
+    }
+    if (!slot) {
+        DewabLog::write(DEWAB_LOG_WARN, "dewab", "Dewab: Cannot call %s: %u calls already pending", event, (unsigned)maxPendingCalls);
+        return 0;
+    }
+
+    if (_nextCallId == 0) {
+        _nextCallId = esp_random() | 1;
+    }
+    uint32_t id = _nextCallId;
+    if (++_nextCallId == 0) _nextCallId = 1;
+
+    JsonDocument request = payload;
+    request["call_id"] = id;
+    request["device_name"] = _deviceName;
+    if (!_supabaseClient.broadcast(_commandTopic, event, request)) {
+        DewabLog::write(DEWAB_LOG_ERROR, "dewab", "Dewab: Call %s could not be sent", event);
+        return 0;
+    }
+    slot->id = id;
+    slot->sentAt = _clock->millis();
+    slot->timeoutMs = timeoutMs;
+    slot->callback = callback;
+    DewabLog::write(DEWAB_LOG_DEBUG, "dewab", "Dewab: Call %s sent (id %lu)", event, (unsigned long)id);
+    return id;
+}
+
+void Dewab::handleCallResult(const JsonObjectConst& payload) {
+    uint32_t id = payload["call_id"].as<uint32_t>();
+    for (size_t i = 0; i < maxPendingCalls; i++) {
+        PendingCall& pending = _pendingCalls[i];
+        if (id == 0 || pending.id != id) continue;
+        // Free the slot first, the callback may start another call
+        CallResponseCallback callback = pending.callback;
+        pending.id = 0;
+        pending.callback = nullptr;
+        bool ok = payload["status"] != "error";
+        if (callback) callback(ok, ok ? payload["result"] : payload["message"]);
+        return;
+    }
+    DewabLog::write(DEWAB_LOG_DEBUG, "dewab", "Dewab: Result for unknown or expired call %lu ignored", (unsigned long)id);
+}
+
+void Dewab::expireCalls() {
+    unsigned long now = _clock->millis();
+    for (size_t i = 0; i < maxPendingCalls; i++) {
+        PendingCall& pending = _pendingCalls[i];
+        if (pending.id == 0 || now - pending.sentAt < pending.timeoutMs) continue;
+        DewabLog::write(DEWAB_LOG_WARN, "dewab", "Dewab: Call %lu timed out", (unsigned long)pending.id);
+        CallResponseCallback callback = pending.callback;
+        pending.id = 0;
+        pending.callback = nullptr;
+        if (callback) callback(false, JsonVariantConst());
+    }
+}
+
+void Dewab::setCommandShards(uint16_t shards) {
+    if (shards <= 1) {
+        _commandTopic = "realtime:arduino-commands";
+    } else {
+        _commandTopic = "realtime:dewab-cmd-" + String(commandShard(_deviceName, shards));
+    }
+    DewabLog::write(DEWAB_LOG_INFO, "dewab", "Dewab: Command channel: %s", _commandTopic.c_str());
+}
+
+const String& Dewab::commandTopic() const {
+    return _commandTopic;
+}
+
+uint16_t Dewab::commandShard(const char* deviceName, uint16_t shards) {
+    if (shards <= 1) {
+        return 0;
+    }
+    FingerprintPrint hash;
+    hash.print(deviceName);
+    return hash.hash % shards;
+}
+
+bool Dewab::stateFieldChanged(const char* category, const char* name, JsonVariantConst value) {
+    FingerprintPrint key;
+    key.print(category);
+    key.write('/');
+    key.print(name);
+    FingerprintPrint fingerprint;
+    serializeJson(value, fingerprint);
+
+    for (size_t i = 0; i < _stateFieldCount; i++) {
+        if (_stateFields[i].key == key.hash) {
+            bool changed = _stateFields[i].value != fingerprint.hash;
+            _stateFields[i].value = fingerprint.hash;
+            return changed;
+        }
+    }
+    if (_stateFieldCount < _stateFieldSlots) {
+        _stateFields[_stateFieldCount++] = { key.hash, fingerprint.hash };
+    }
+    return true; // New, or untracked because the table is full
+}
+
+// Updates the field fingerprints from a full state. With delta, also copies
+// the top-level values and the changed fields of each category into it.
+// Returns false when no field changed.
+bool Dewab::diffState(const JsonDocument& state, JsonDocument* delta) {
+    bool changed = false;
+    for (JsonPairConst entry : state.as<JsonObjectConst>()) {
+        if (!entry.value().is<JsonObjectConst>()) {
+            if (delta) (*delta)[entry.key()] = entry.value();
+            continue;
+        }
+        for (JsonPairConst field : entry.value().as<JsonObjectConst>()) {
+            if (stateFieldChanged(entry.key().c_str(), field.key().c_str(), field.value())) {
+                if (delta) (*delta)[entry.key()][field.key()] = field.value();
+                changed = true;
+            }
+        }
+    }
+    if (delta) (*delta)["delta"] = true;
+    return changed;
+}
+
+namespace {
+
+// A typical inbound command frame, as the dashboards send it
+const char kBenchFrame[] =
+    "{\"topic\":\"realtime:arduino-commands\",\"event\":\"broadcast\",\"payload\":{\"type\":\"broadcast\","
+    "\"event\":\"set_outputs\",\"payload\":{\"target_device_name\":\"bench\",\"request_id\":\"bench-1\","
+    "\"led\":true,\"brightness\":128,\"color\":[255,128,0],\"label\":\"hello\"}},\"ref\":null}";
+
+// Heap held by a kernel, taken only on its untimed first run
+struct BenchHeap {
+    uint32_t* held;
+    uint32_t freeBefore;
+
+    explicit BenchHeap(uint32_t* heldBytes)
+        : held(heldBytes), freeBefore(heldBytes ? heap_caps_get_free_size(MALLOC_CAP_8BIT) : 0) {}
+
+    // Call where the kernel's allocations peak, before its locals go
+    void mark() {
+        if (!held) return;
+        // Memory freed by another task meanwhile must not wrap the count
+        int32_t drop = (int32_t)freeBefore - (int32_t)heap_caps_get_free_size(MALLOC_CAP_8BIT);
+        *held = drop > 0 ? (uint32_t)drop : 0;
+    }
+};
+
+// Runs `kernel` once untimed, which also warms the flash cache, then
+// `iterations` times timed in CPU cycles
+template <typename Kernel>
+void runBenchKernel(JsonObject out, uint16_t iterations, Kernel kernel) {
+    uint32_t freeBefore = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    uint32_t heldBytes = 0;
+    kernel(&heldBytes);
+
+    uint32_t minCycles = UINT32_MAX;
+    uint32_t maxCycles = 0;
+    uint64_t totalCycles = 0;
+    for (uint16_t i = 0; i < iterations; i++) {
+        uint32_t started = ESP.getCycleCount();
+        kernel(nullptr);
+        uint32_t cycles = ESP.getCycleCount() - started;
+        totalCycles += cycles;
+        if (cycles < minCycles) minCycles = cycles;
+        if (cycles > maxCycles) maxCycles = cycles;
+    }
+
+    out["mean_cycles"] = (uint32_t)(totalCycles / iterations);
+    out["min_cycles"] = minCycles;
+    out["max_cycles"] = maxCycles;
+    out["mean_micros"] = (uint32_t)(totalCycles / iterations / ESP.getCpuFreqMHz());
+    out["held_bytes"] = heldBytes;
+    // Still allocated after all runs, i.e. leaked or cached by the kernel
+    out["net_bytes"] = (int32_t)freeBefore - (int32_t)heap_caps_get_free_size(MALLOC_CAP_8BIT);
+}
+
+} // namespace
+
+void Dewab::benchmark(JsonDocument& report, uint16_t iterations) {
+    if (iterations == 0) {
+        iterations = 1;
+    }
+    report["chip"] = ESP.getChipModel();
+    report["cpu_mhz"] = ESP.getCpuFreqMHz();
+    report["sdk"] = ESP.getSdkVersion();
+    report["sketch_md5"] = ESP.getSketchMD5();
+    report["iterations"] = iterations;
+    JsonObject kernels = report["kernels"].to<JsonObject>();
+
+    // Eight fields in two categories, like the demo sketch's state
+    auto buildState = [this](JsonDocument& doc) {
+        stateAddBool(doc, "outputs", "led", true);
+        stateAddInt(doc, "outputs", "brightness", 128);
+        stateAddString(doc, "outputs", "label", "hello");
+        stateAddInt(doc, "inputs", "button", 0);
+        stateAddInt(doc, "inputs", "potentiometer", 2048);
+        stateAddFloat(doc, "inputs", "temperature", 21.5f);
+        stateAddFloat(doc, "inputs", "humidity", 48.25f);
+        stateAddBool(doc, "inputs", "motion", false);
+        doc["device_name"] = _deviceName;
+        doc["reason"] = "bench";
+    };
+    runBenchKernel(kernels["state_build"].to<JsonObject>(), iterations, [&](uint32_t* held) {
+        BenchHeap heap(held);
+        JsonDocument doc;
+        buildState(doc);
+        heap.mark();
+    });
+
+    JsonDocument state;
+    buildState(state);
+    const String& topic = _commandTopic;
+    const String event = "ARDUINO_STATE_UPDATE";
+    const String ref = "42";
+    const String joinRef = "1";
+    size_t frameBytes = 0;
+    runBenchKernel(kernels["envelope_serialize"].to<JsonObject>(), iterations, [&](uint32_t* held) {
+        BenchHeap heap(held);
+        JsonDocument doc;
+        SupabaseRealtimeClient::buildBroadcastEnvelope(doc, topic, event, state.as<JsonVariantConst>(), ref, joinRef);
+        String frame;
+        frameBytes = serializeJson(doc, frame);
+        heap.mark();
+    });
+    kernels["envelope_serialize"]["bytes"] = frameBytes;
+
+    runBenchKernel(kernels["inbound_parse"].to<JsonObject>(), iterations, [&](uint32_t* held) {
+        BenchHeap heap(held);
+        JsonDocument doc;
+        deserializeJson(doc, kBenchFrame, sizeof(kBenchFrame) - 1, DeserializationOption::NestingLimit(10));
+        heap.mark();
+    });
+    kernels["inbound_parse"]["bytes"] = sizeof(kBenchFrame) - 1;
+
+    // The command lookup of handleBroadcastCommand(). Built-ins are added
+    // here too (a no-op after begin()), so a benchmark run before begin(),
+    // as in tools/qemu-bench, looks up in a map of the usual size.
+    registerBuiltinCommands();
+    JsonDocument frame;
+    deserializeJson(frame, kBenchFrame, sizeof(kBenchFrame) - 1);
+    JsonObjectConst payload = frame["payload"].as<JsonObjectConst>();
+    uint32_t found = 0;
+    runBenchKernel(kernels["dispatch_lookup"].to<JsonObject>(), iterations, [&](uint32_t* held) {
+        BenchHeap heap(held);
+        String commandType = payload["event"].as<String>();
+        found += _registeredCommands.find(commandType) != _registeredCommands.end();
+        heap.mark();
+    });
+    kernels["dispatch_lookup"]["commands"] = _registeredCommands.size();
+    kernels["dispatch_lookup"]["hit"] = found > 0;
+}
+
+bool Dewab::enableProfiler(size_t slots) {
+    return _profiler.begin(slots);
+}
+
+PcSampler& Dewab::profiler() {
+    return _profiler;
+}
+
+CounterInputs& Dewab::counterInputs() {
+    return _counterInputs;
+}
+
+bool Dewab::enableTracing(size_t maxEvents) {
+    return _tracer.begin(maxEvents);
+}
+
+Tracer& Dewab::tracer() {
+    return _tracer;
+}
+
+bool Dewab::enableLogStreaming(DewabLogLevel level, size_t maxRecords) {
+    return _logStreamer.begin(level, maxRecords);
+}
+
+LogStreamer& Dewab::logStreamer() {
+    return _logStreamer;
+}
+
+void Dewab::setTrafficReportInterval(unsigned long intervalMs) {
+    _trafficReportInterval = intervalMs;
+    _lastTrafficReport = _clock->millis();
+}
+
+EnergyMonitor& Dewab::energyMonitor() {
+    return _energyMonitor;
+}
+
+void Dewab::setPowerModel(const DewabPowerModel& model) {
+    _energyMonitor.setPowerModel(model);
+}
+
+HeapMonitor& Dewab::heapMonitor() {
+    return _heapMonitor;
+}
+
+void Dewab::setClock(DewabClock* clock) {
+    _clock = clock ? clock : DewabClock::system();
+    _wifiManager.setClock(_clock);
+    _supabaseClient.setClock(_clock);
+    _heapMonitor.setClock(_clock);
+    _recorder.setClock(_clock);
+    _energyMonitor.setClock(_clock);
+    _logStreamer.setClock(_clock);
+    _profiler.setClock(_clock);
+    _counterInputs.setClock(_clock);
 }
 
 void Dewab::handleSupabaseConnected() {
-    Serial.printf("Dewab: Supabase connected - Device: %s\n", _deviceName);
-    String deviceChannel = "realtime:arduino-commands"; 
-    _supabaseClient.joinChannel(deviceChannel);
+    DewabLog::write(DEWAB_LOG_INFO, "dewab", "Dewab: Supabase connected - Device: %s", _deviceName);
+    _supabaseClient.joinChannel(_commandTopic);
     // Initial state broadcast is now handled by handleSupabaseChannelJoined
 }
 
 void Dewab::handleSupabaseChannelJoined(const String& topic, const String& joinRef) {
-    Serial.printf("Dewab: Supabase channel joined: %s (ref: %s)\n", topic.c_str(), joinRef.c_str());
-    String expectedDeviceChannel = "realtime:arduino-commands";
-    if (topic == expectedDeviceChannel) {
+    DewabLog::write(DEWAB_LOG_INFO, "dewab", "Dewab: Supabase channel joined: %s (ref: %s)", topic.c_str(), joinRef.c_str());
+    if (topic == _commandTopic) {
         if (_stateProvider) {
+            // Dashboards that joined meanwhile have no state to merge a delta into
+            _stateFieldCount = 0;
             broadcastCurrentState("dewab_channel_joined");
         }
     }
 }
 
 void Dewab::handleBroadcastCommand(const String& topic, const String& event, const JsonObjectConst& payload) {
-    String expectedDeviceChannel = "realtime:arduino-commands";
-    if (topic != expectedDeviceChannel) {
-        Serial.printf("Dewab: Broadcast ignored: wrong channel (%s)\n", topic.c_str());
+    HeapMonitor::Scope heapScope(&_heapMonitor, DEWAB_HEAP_SITE_COMMAND);
+    if (topic != _commandTopic) {
+        DewabLog::write(DEWAB_LOG_DEBUG, "dewab", "Dewab: Broadcast ignored: wrong channel (%s)", topic.c_str());
         return;
     }
 
@@ -464,30 +3505,61 @@ void Dewab::handleBroadcastCommand(const String& topic, const String& event, con
         payload["event"].is<JsonVariant>() && payload["payload"].is<JsonVariant>()) {
         actualCommandType = payload["event"].as<String>();
         actualPayload = payload["payload"].as<JsonObjectConst>(); // Get the innermost payload
-        Serial.printf("Dewab: Detected nested broadcast. Actual command: %s\n", actualCommandType.c_str());
+        DewabLog::write(DEWAB_LOG_DEBUG, "dewab", "Dewab: Detected nested broadcast. Actual command: %s", actualCommandType.c_str());
     }
 
-    Serial.printf("Dewab: Command received: %s on topic %s\n", actualCommandType.c_str(), topic.c_str());
+    DewabLog::write(DEWAB_LOG_DEBUG, "dewab", "Dewab: Command received: %s on topic %s", actualCommandType.c_str(), topic.c_str());
+
+    if (isDeviceBroadcast(actualPayload)) {
+        DewabLog::write(DEWAB_LOG_DEBUG, "dewab", "Dewab: Broadcast '%s' from device '%s' ignored", actualCommandType.c_str(),
+                        actualPayload["device_name"].as<const char*>());
+        return;
+    }
 
     // Filter by target_device_name if present in the actual payload
     if (actualPayload && actualPayload["target_device_name"].is<const char*>()) {
         const char* targetDevice = actualPayload["target_device_name"].as<const char*>();
         if (strcmp(targetDevice, _deviceName) != 0) {
-            Serial.printf("Dewab: Command '%s' ignored. Target device '%s' does not match '%s'.\n", actualCommandType.c_str(), targetDevice, _deviceName);
+            DewabLog::write(DEWAB_LOG_DEBUG, "dewab", "Dewab: Command '%s' ignored. Target device '%s' does not match '%s'.", actualCommandType.c_str(), targetDevice, _deviceName);
             return; 
         }
     } else {
-        Serial.printf("Dewab: Command '%s' does not have target_device_name or it's invalid. Processing anyway (for backward compatibility or general commands).\n", actualCommandType.c_str());
+        DewabLog::write(DEWAB_LOG_DEBUG, "dewab", "Dewab: Command '%s' does not have target_device_name or it's invalid. Processing anyway (for backward compatibility or general commands).", actualCommandType.c_str());
     }
 
     String replyEvent = "";
     JsonDocument replyPayloadDoc; 
     JsonObject replyData = replyPayloadDoc.to<JsonObject>();
 
+    JsonDocument signedDoc; // Keeps the verified args alive for the handler
+    if (!_signingKey.isEmpty()) {
+        const char* authError = nullptr;
+        if (!verifySignedCommand(actualCommandType, actualPayload, signedDoc, authError)) {
+            DewabLog::write(DEWAB_LOG_WARN, "dewab", "Dewab: Command '%s' rejected: %s", actualCommandType.c_str(), authError);
+            replyData["status"] = "error";
+            replyData["message"] = authError;
+            replyData["original_command"] = actualCommandType;
+            replyData["device_name"] = _deviceName;
+            _supabaseClient.broadcast(topic, actualCommandType + "_ERROR", replyPayloadDoc);
+            return;
+        }
+        actualPayload = signedDoc["args"].as<JsonObjectConst>();
+    }
+
+    // Answers to call() are routed to their callback, not to a command handler
+    if (actualCommandType == "CALL_RESULT") {
+        handleCallResult(actualPayload);
+        return;
+    }
+
     auto it = _registeredCommands.find(actualCommandType);
     if (it != _registeredCommands.end()) {
         JsonDocument customHandlerDataDoc; 
-        bool success = it->second(actualPayload, customHandlerDataDoc); 
+        bool success;
+        {
+            Tracer::Scope traceScope(&_tracer, DEWAB_TRACE_HANDLER);
+            success = it->second(actualPayload, customHandlerDataDoc);
+        }
 
         replyData["original_command"] = actualCommandType;
         if (!customHandlerDataDoc.isNull()) {
@@ -507,45 +3579,157 @@ void Dewab::handleBroadcastCommand(const String& topic, const String& event, con
             }
         }
     } else {
-        Serial.printf("Dewab: No specific handler for command: %s. Sending default error reply.\n", actualCommandType.c_str());
+        DewabLog::write(DEWAB_LOG_DEBUG, "dewab", "Dewab: No specific handler for command: %s. Sending default error reply.", actualCommandType.c_str());
         replyEvent = actualCommandType + "_ERROR"; 
         replyData["status"] = "error";
         replyData["message"] = "Unknown command type or no handler registered on device.";
         replyData["original_command"] = actualCommandType;
     }
 
+    // Lets dashboards and load tools match the reply to its device and request
+    replyData["device_name"] = _deviceName;
+    if (actualPayload && !actualPayload["request_id"].isNull()) {
+        replyData["request_id"] = actualPayload["request_id"];
+    }
+
     if (!replyEvent.isEmpty()) {
-        // The reply should also go to the "realtime:arduino-commands" topic
+        // The reply goes back to the command channel it came from
         bool broadcastSuccess = _supabaseClient.broadcast(topic, replyEvent, replyPayloadDoc);
         if (broadcastSuccess) {
-            Serial.printf("Dewab: Replied with event '%s' to command '%s'\n", replyEvent.c_str(), actualCommandType.c_str());
+            DewabLog::write(DEWAB_LOG_DEBUG, "dewab", "Dewab: Replied with event '%s' to command '%s'", replyEvent.c_str(), actualCommandType.c_str());
         } else {
-            Serial.printf("Dewab: Failed to send reply event '%s' for command '%s'\n", replyEvent.c_str(), actualCommandType.c_str());
+            DewabLog::write(DEWAB_LOG_ERROR, "dewab", "Dewab: Failed to send reply event '%s' for command '%s'", replyEvent.c_str(), actualCommandType.c_str());
         }
     } else {
-        Serial.printf("Dewab: No reply event generated for command: %s\n", actualCommandType.c_str());
+        DewabLog::write(DEWAB_LOG_DEBUG, "dewab", "Dewab: No reply event generated for command: %s", actualCommandType.c_str());
+    }
+}
+
+void Dewab::setCommandSigningKey(const char* key) {
+    _signingKey = key ? key : "";
+    _recentNonceCount = 0;
+    _newestSignedTs = 0;
+    if (!_signingKey.isEmpty() && time(nullptr) <= 1600000000) {
+        // Syncs in the background once WiFi is up
+        configTime(0, 0, "pool.ntp.org", "time.google.com");
+    }
+}
+
+const CommandAuthStats& Dewab::commandAuthStats() const {
+    return _authStats;
+}
+
+// Checks the HMAC over the exact "signed" string, then the command, target,
+// nonce and timestamp it carries. On success signedDoc holds the parsed body.
+bool Dewab::verifySignedCommand(const String& commandType, const JsonObjectConst& payload, JsonDocument& signedDoc, const char*& error) {
+    unsigned long started = micros();
+    bool ok = false;
+
+    const char* body = payload ? payload["signed"].as<const char*>() : nullptr;
+    const char* sig = payload ? payload["sig"].as<const char*>() : nullptr;
+    if (!body || !sig || strlen(sig) != 64) {
+        error = "Unsigned command.";
+        _authStats.rejected++;
+    } else {
+        uint8_t mac[32];
+        mbedtls_md_hmac(mbedtls_md_info_from_type(MBEDTLS_MD_SHA256),
+                        (const uint8_t*)_signingKey.c_str(), _signingKey.length(),
+                        (const uint8_t*)body, strlen(body), mac);
+
+        // Constant-time compare against the hex signature
+        uint8_t diff = 0;
+        for (int i = 0; i < 32; i++) {
+            uint8_t expected = 0;
+            for (int j = 0; j < 2; j++) {
+                char c = sig[i * 2 + j];
+                uint8_t nibble = (c >= '0' && c <= '9') ? c - '0' : (c >= 'a' && c <= 'f') ? c - 'a' + 10 : (c >= 'A' && c <= 'F') ? c - 'A' + 10 : 0xFF;
+                diff |= nibble >> 4;
+                expected = (expected << 4) | (nibble & 0x0F);
+            }
+            diff |= expected ^ mac[i];
+        }
+
+        if (diff != 0) {
+            error = "Invalid command signature.";
+            _authStats.rejected++;
+        } else if (deserializeJson(signedDoc, body)) {
+            error = "Malformed signed command.";
+            _authStats.rejected++;
+        } else if (commandType != signedDoc["command"].as<const char*>() ||
+                   !signedDoc["target"].is<const char*>() || strcmp(signedDoc["target"].as<const char*>(), _deviceName) != 0) {
+            error = "Signed command does not match command or target.";
+            _authStats.rejected++;
+        } else {
+            uint32_t nonce = signedDoc["nonce"].as<uint32_t>();
+            long ts = signedDoc["ts"].as<long>();
+            time_t now = time(nullptr);
+            // Nonces are kept until their command would fail the window check;
+            // only then can they be forgotten without opening a replay
+            bool seen = false;
+            size_t kept = 0;
+            for (size_t i = 0; i < _recentNonceCount; i++) {
+                if (_recentNonces[i].ts < (long)now - _signatureWindow) continue;
+                if (_recentNonces[i].nonce == nonce) seen = true;
+                _recentNonces[kept++] = _recentNonces[i];
+            }
+            _recentNonceCount = kept;
+
+            if (now <= 1600000000) {
+                error = "Device clock not synced; signed commands are refused.";
+                _authStats.clockUnsynced++;
+                DewabLog::write(DEWAB_LOG_WARN, "dewab", "Dewab: Refusing signed command '%s': clock not synced (SNTP pending)", commandType.c_str());
+            } else if (seen || labs((long)now - ts) > _signatureWindow || ts < _newestSignedTs - _signatureWindow) {
+                error = "Replayed or expired command.";
+                _authStats.replayed++;
+            } else if (_recentNonceCount >= _nonceHistory) {
+                error = "Too many signed commands, retry in a few seconds.";
+                _authStats.rejected++;
+                DewabLog::write(DEWAB_LOG_WARN, "dewab", "Dewab: Refusing signed command '%s': %u nonces within %lds",
+                                commandType.c_str(), (unsigned)_nonceHistory, _signatureWindow);
+            } else {
+                _recentNonces[_recentNonceCount++] = { nonce, ts };
+                if (ts > _newestSignedTs) _newestSignedTs = ts;
+                _authStats.verified++;
+                ok = true;
+            }
+        }
+    }
+
+    uint32_t elapsed = micros() - started;
+    _authStats.lastMicros = elapsed;
+    _authStats.totalMicros += elapsed;
+    if (elapsed > _authStats.maxMicros) _authStats.maxMicros = elapsed;
+    if (elapsed > _verifyBudgetMicros) {
+        _authStats.overBudget++;
+        DewabLog::write(DEWAB_LOG_WARN, "dewab", "Dewab: Command verification took %luus (budget %luus)", (unsigned long)elapsed, _verifyBudgetMicros);
     }
+    return ok;
 }
 
 void Dewab::handleSupabaseDisconnected() {
-    Serial.println("Dewab: Supabase disconnected");
+    DewabLog::write(DEWAB_LOG_WARN, "dewab", "Dewab: Supabase disconnected");
 }
 
 void Dewab::handleSupabaseError(String errorMsg) {
-    Serial.printf("Dewab: Supabase error: %s\n", errorMsg.c_str());
+    DewabLog::write(DEWAB_LOG_ERROR, "dewab", "Dewab: Supabase error: %s", errorMsg.c_str());
 }
 
 void Dewab::broadcastCurrentState(const char* reason) {
-    if (!_supabaseClient.isConnected()) {
-        Serial.printf("Dewab: Cannot send state (%s): Supabase not connected\n", reason);
+    // REST mode still uses the WebSocket when it is already open for commands
+    bool useRest = (_publishMode == DEWAB_PUBLISH_REST) && !_supabaseClient.isConnected();
+
+    if (!useRest && !_supabaseClient.isConnected()) {
+        DewabLog::write(DEWAB_LOG_WARN, "dewab", "Dewab: Cannot send state (%s): Supabase not connected", reason);
         return;
     }
 
     if (!_stateProvider) {
-        Serial.printf("Dewab: Cannot send state (%s): No state provider registered\n", reason);
+        DewabLog::write(DEWAB_LOG_WARN, "dewab", "Dewab: Cannot send state (%s): No state provider registered", reason);
         return;
     }
 
+    HeapMonitor::Scope heapScope(&_heapMonitor, DEWAB_HEAP_SITE_STATE);
+    Tracer::Scope traceScope(&_tracer, DEWAB_TRACE_STATE);
     JsonDocument stateDoc; 
     _stateProvider(stateDoc); 
 
@@ -556,14 +3740,39 @@ void Dewab::broadcastCurrentState(const char* reason) {
         stateDoc["reason"] = reason;
     }
    
-    Serial.printf("Dewab: Broadcasting state update (%s)\n", reason);
+    // Under memory pressure only the fields that changed since the last update
+    // are sent; without fingerprints (after a reset or failed send) the full state
+    JsonDocument deltaDoc;
+    bool sendDelta = _memoryLevel != DEWAB_MEMORY_NORMAL && _stateFieldCount > 0;
+    if (!diffState(stateDoc, sendDelta ? &deltaDoc : nullptr) && sendDelta) {
+        DewabLog::write(DEWAB_LOG_DEBUG, "dewab", "Dewab: State unchanged, delta update skipped (%s)", reason);
+        return;
+    }
+    if (sendDelta) {
+        stateDoc.clear();
+        _heapMonitor.pressureStats().deltaUpdates++;
+    }
+
+    DewabLog::write(DEWAB_LOG_DEBUG, "dewab", "Dewab: Broadcasting state update (%s)", reason);
 
-    String broadcastTopic = "realtime:arduino-commands"; 
+    const String& broadcastTopic = _commandTopic;
     String broadcastEvent = "ARDUINO_STATE_UPDATE";   
 
-    bool success = _supabaseClient.broadcast(broadcastTopic, broadcastEvent, stateDoc);
+    const JsonDocument& payload = sendDelta ? deltaDoc : stateDoc;
+    bool success;
+    if (useRest) {
+        if (_supabaseClient.pendingRestBroadcasts() == 0) {
+            _restBatchStarted = _clock->millis();
+        }
+        success = _supabaseClient.queueRestBroadcast(broadcastTopic, broadcastEvent, payload);
+    } else {
+        success = _supabaseClient.broadcast(broadcastTopic, broadcastEvent, payload);
+    }
     if (!success) {
-        Serial.println("Dewab: State broadcast failed");
+        // The fingerprints already describe this update; forget them so the
+        // fields are sent again
+        _stateFieldCount = 0;
+        DewabLog::write(DEWAB_LOG_ERROR, "dewab", "Dewab: State broadcast failed");
     }
 }
 
@@ -603,4 +3812,31 @@ void Dewab::stateAddDigitalPin(JsonDocument& doc, const char* category, const ch
     JsonObject cat = doc[category].is<JsonObject>() ? doc[category].as<JsonObject>() : doc[category].to<JsonObject>();
     bool pinState = digitalRead(pin);
     cat[name] = activeLow ? !pinState : pinState;
+}
+
+void Dewab::stateAddPulseCount(JsonDocument& doc, const char* category, const char* name, int pin) {
+    JsonObject cat = doc[category].is<JsonObject>() ? doc[category].as<JsonObject>() : doc[category].to<JsonObject>();
+    if (_counterInputs.beginCount(pin)) {
+        cat[name] = _counterInputs.count(pin);
+    } else {
+        cat[name] = nullptr;
+    }
+}
+
+void Dewab::stateAddFrequency(JsonDocument& doc, const char* category, const char* name, int pin, int decimals) {
+    JsonObject cat = doc[category].is<JsonObject>() ? doc[category].as<JsonObject>() : doc[category].to<JsonObject>();
+    if (_counterInputs.beginCapture(pin)) {
+        cat[name] = serialized(String(_counterInputs.frequency(pin), decimals));
+    } else {
+        cat[name] = nullptr;
+    }
+}
+
+void Dewab::stateAddDutyCycle(JsonDocument& doc, const char* category, const char* name, int pin, int decimals) {
+    JsonObject cat = doc[category].is<JsonObject>() ? doc[category].as<JsonObject>() : doc[category].to<JsonObject>();
+    if (_counterInputs.beginCapture(pin)) {
+        cat[name] = serialized(String(_counterInputs.dutyCycle(pin), decimals));
+    } else {
+        cat[name] = nullptr;
+    }
 } 
\ No newline at end of file
@@ -4,10 +4,91 @@
 #include <Arduino.h>
 #include <ArduinoJson.h>
 #include <WiFi.h>
+#include <WiFiClientSecure.h>
+#include <HTTPClient.h>
 #include <WebSocketsClient.h>
+#include <esp_heap_caps.h>
 #include <functional>
 #include <map>
 
+// =================================================================
+// DewabClock: Time source for every timer in the library.
+// Heartbeats, reconnect intervals, batching windows and timeouts all read
+// time through a DewabClock, so a VirtualClock can drive them in tests and
+// benchmarks without waiting in real time. CPU-cost measurements (compression,
+// signature checks) keep using micros(), as they measure real work.
+// =================================================================
+class DewabClock {
+public:
+    virtual ~DewabClock() {}
+    virtual unsigned long millis() = 0;
+    virtual void delay(unsigned long ms) = 0;
+
+    // The hardware clock, used unless setClock() is called
+    static DewabClock* system();
+};
+
+class SystemClock : public DewabClock {
+public:
+    unsigned long millis() override;
+    void delay(unsigned long ms) override;
+};
+
+// Manually advanced clock. delay() returns immediately after advancing
+// time, so blocking waits (e.g. the WiFi connect timeout) take no real time.
+class VirtualClock : public DewabClock {
+public:
+    explicit VirtualClock(unsigned long startMs = 0) : _now(startMs) {}
+    unsigned long millis() override { return _now; }
+    void delay(unsigned long ms) override { _now += ms; }
+
+    void advance(unsigned long ms) { _now += ms; }
+    void set(unsigned long ms) { _now = ms; }
+
+private:
+    unsigned long _now;
+};
+
+
+// =================================================================
+// DewabLog: Leveled, tagged logging to Serial.
+// Records above the current level are dropped before they are formatted,
+// so disabled debug logging costs no heap and almost no time. The ceiling
+// caps the level from outside, e.g. while memory is low. A sink (the
+// LogStreamer) gets the records up to its own level, independently of Serial.
+// =================================================================
+enum DewabLogLevel : uint8_t {
+    DEWAB_LOG_NONE,
+    DEWAB_LOG_ERROR,
+    DEWAB_LOG_WARN,
+    DEWAB_LOG_INFO,
+    DEWAB_LOG_DEBUG
+};
+
+typedef std::function<void(DewabLogLevel level, const char* tag, const char* text)> DewabLogSink;
+
+class DewabLog {
+public:
+    static void setLevel(DewabLogLevel level);
+    static DewabLogLevel level();
+    static void setCeiling(DewabLogLevel ceiling);
+    static void setSink(DewabLogSink sink, DewabLogLevel level);
+    static void setSinkLevel(DewabLogLevel level);
+    static DewabLogLevel sinkLevel();
+    static bool enabled(DewabLogLevel level);
+    // One line per record; the format has no trailing newline
+    static void write(DewabLogLevel level, const char* tag, const char* format, ...) __attribute__((format(printf, 3, 4)));
+
+    static const size_t maxLineBytes = 256; // Longer records are truncated
+
+private:
+    static DewabLogLevel _level;
+    static DewabLogLevel _ceiling;
+    static DewabLogSink _sink;
+    static DewabLogLevel _sinkLevel;
+};
+
+
 // =================================================================
 // WifiManager: Manages WiFi connection and reconnection.
 // (Previously in WifiManager.h)
@@ -26,7 +107,10 @@ public:
     // Handles periodic tasks like reconnection. Should be called in loop().
     void loop();
 
+    void setClock(DewabClock* clock);
+
 private:
+    DewabClock* _clock = DewabClock::system();
     const char* _ssid;
     const char* _password;
     unsigned long _lastReconnectAttempt = 0;
@@ -34,6 +118,608 @@ private:
 };
 
 
+// =================================================================
+// DeflateEncoder: Minimal raw-deflate (RFC 1951) compressor.
+// Fixed Huffman codes and a single-candidate LZ77 hash match keep it
+// small: a 2 KB hash table on the stack and no window buffer, since the
+// whole input is already in RAM. Browsers inflate the output with
+// DecompressionStream('deflate-raw').
+// =================================================================
+class DeflateEncoder {
+public:
+    // Compresses `in` into `out`. Matches are limited to `window` bytes back
+    // (max 32768). Returns the compressed size, or 0 if the output would not
+    // fit in outCapacity (i.e. the data does not compress).
+    static size_t compress(const uint8_t* in, size_t length, uint8_t* out, size_t outCapacity, uint16_t window = 1024);
+};
+
+// Counters for outgoing payload compression
+struct CompressionStats {
+    uint32_t framesCompressed = 0;
+    uint32_t framesSkipped = 0;   // Below the threshold or not worth compressing
+    uint32_t bytesIn = 0;         // Raw payload bytes of compressed frames
+    uint32_t bytesOut = 0;        // Encoded (base64) bytes sent in their place
+    uint32_t cpuMicros = 0;       // Time spent compressing and encoding
+
+    float ratio() const { return bytesIn ? (float)bytesOut / bytesIn : 1.0f; }
+};
+
+
+// =================================================================
+// HeapMonitor: Tracks heap health over long uptimes.
+// Samples the 8-bit capable heap periodically (free bytes, largest free
+// block, live blocks) and keeps the net heap change of each instrumented
+// code site, so String/JsonDocument churn and slow leaks show up in soak
+// tests long before the device runs out of memory.
+// =================================================================
+enum DewabHeapSite {
+    DEWAB_HEAP_SITE_RX,          // Parsing an inbound frame (incl. handlers)
+    DEWAB_HEAP_SITE_COMMAND,     // Dewab::handleBroadcastCommand
+    DEWAB_HEAP_SITE_BROADCAST,   // SupabaseRealtimeClient::broadcast
+    DEWAB_HEAP_SITE_HEARTBEAT,   // SupabaseRealtimeClient::sendHeartbeat
+    DEWAB_HEAP_SITE_STATE,       // Dewab::broadcastCurrentState
+    DEWAB_HEAP_SITE_COUNT
+};
+
+struct HeapSnapshot {
+    uint32_t freeBytes = 0;
+    uint32_t largestFreeBlock = 0;
+    uint32_t minFreeBytes = 0;       // Low-water mark since boot
+    uint32_t allocatedBlocks = 0;
+    uint32_t minStackFree = 0;       // Stack high-water mark of the calling (loop) task
+    unsigned long takenAt = 0;
+
+    // 0 = all free memory is one block, approaching 1 = badly fragmented
+    float fragmentation() const { return freeBytes ? 1.0f - (float)largestFreeBlock / freeBytes : 0.0f; }
+};
+
+struct HeapSiteStats {
+    uint32_t calls = 0;
+    int32_t netBytes = 0;    // Sum of bytes still allocated when the site returned
+    int32_t maxNetBytes = 0; // Largest net change of a single call
+    uint32_t totalMicros = 0;
+    uint32_t maxMicros = 0;
+};
+
+// Memory pressure levels, from free heap against the watermarks
+enum DewabMemoryLevel : uint8_t {
+    DEWAB_MEMORY_NORMAL,
+    DEWAB_MEMORY_LOW,
+    DEWAB_MEMORY_CRITICAL
+};
+
+struct MemoryPressureStats {
+    uint32_t lowEntries = 0;       // NORMAL -> LOW
+    uint32_t criticalEntries = 0;  // Any level -> CRITICAL
+    uint32_t recoveries = 0;       // Back to NORMAL
+    uint32_t degradedMs = 0;       // Time spent in LOW or CRITICAL, up to the last change
+    uint32_t refusedCommands = 0;  // Counted by Dewab while degraded
+    uint32_t deltaUpdates = 0;     // State updates sent as deltas
+    unsigned long changedAt = 0;
+};
+
+class HeapMonitor {
+public:
+    // Brackets one operation and charges its net heap change to `site`
+    class Scope {
+    public:
+        Scope(HeapMonitor* monitor, DewabHeapSite site);
+        ~Scope();
+    private:
+        HeapMonitor* _monitor;
+        DewabHeapSite _site;
+        uint32_t _freeAtStart;
+        unsigned long _startedMicros;
+    };
+
+    static HeapSnapshot snapshot();
+    void setClock(DewabClock* clock);
+
+    // Samples the heap every sampleInterval and checks the leak budget.
+    void loop();
+    // Counts one message in or out, the unit of the leak budget
+    void countMessage();
+
+    // Fails the soak check when live blocks grow by more than
+    // blocksPerMessage per message, measured from the end of the warmup.
+    void setMessageBudget(float blocksPerMessage, uint32_t warmupMessages = 100);
+    bool budgetExceeded() const;
+    float blocksPerMessage() const;
+
+    // Free heap below lowBytes/criticalBytes raises the pressure level at
+    // once; it only drops again when free heap is recoverMargin above the
+    // watermark, so the level does not flap. 0/0 disables the check.
+    void setWatermarks(uint32_t lowBytes, uint32_t criticalBytes, uint32_t recoverMargin = 8192);
+    DewabMemoryLevel pressureLevel() const;
+    MemoryPressureStats& pressureStats();
+    static const char* levelName(DewabMemoryLevel level);
+
+    const HeapSnapshot& lastSample() const;
+    const HeapSiteStats& siteStats(DewabHeapSite site) const;
+    static const char* siteName(DewabHeapSite site);
+    void report(JsonDocument& doc) const;
+    void resetSiteStats();
+
+private:
+    DewabClock* _clock = DewabClock::system();
+    HeapSnapshot _last;
+    HeapSnapshot _baseline;       // Taken when the warmup ends
+    HeapSiteStats _sites[DEWAB_HEAP_SITE_COUNT];
+    uint32_t _messages = 0;
+    uint32_t _baselineMessages = 0;
+    uint32_t _warmupMessages = 100;
+    float _budgetBlocksPerMessage = 0.05f;
+    bool _budgetExceeded = false;
+    unsigned long _lastSampleAt = 0;
+    const unsigned long _sampleInterval = 10000; // heap_caps_get_info walks the heap, so not every loop
+
+    void checkPressure(); // Every loop: heap_caps_get_free_size is a counter read
+    uint32_t _lowWatermark = 32768;
+    uint32_t _criticalWatermark = 16384;
+    uint32_t _recoverMargin = 8192;
+    DewabMemoryLevel _level = DEWAB_MEMORY_NORMAL;
+    MemoryPressureStats _pressure;
+};
+
+
+// =================================================================
+// TrafficRecorder: Captures WebSocket frames into a RAM ring buffer.
+// Each record is a 9-byte header (u32 time ms, u8 direction, u16 stored
+// length, u16 original length; little endian) followed by the frame bytes,
+// truncated to maxFrameBytes. When the ring is full the oldest records are
+// dropped. A capture is the 4-byte magic "DWR1" followed by the records.
+// =================================================================
+class TrafficRecorder {
+public:
+    enum Direction : uint8_t { INBOUND = 0, OUTBOUND = 1 };
+    static const size_t headerSize = 9;
+
+    ~TrafficRecorder();
+
+    // Allocates the ring. Returns false if the memory is not available.
+    bool begin(size_t capacity, size_t maxFrameBytes = 512);
+    void end();
+    bool isEnabled() const;
+    void setClock(DewabClock* clock);
+
+    void record(Direction direction, const uint8_t* data, size_t length);
+    // Stops recording while a capture is being read out
+    void setPaused(bool paused);
+    void clear();
+
+    // Size of the capture, magic included
+    size_t captureSize() const;
+    // Copies capture bytes starting at `offset` (0 = magic); returns the count
+    size_t read(size_t offset, uint8_t* dest, size_t length) const;
+
+    uint32_t recordCount() const { return _records; }
+    uint32_t droppedRecords() const { return _dropped; }
+
+private:
+    void writeBytes(const uint8_t* data, size_t length);
+    void dropOldest();
+
+    DewabClock* _clock = DewabClock::system();
+    uint8_t* _ring = nullptr;
+    size_t _capacity = 0;
+    size_t _maxFrameBytes = 0;
+    size_t _head = 0;      // Oldest record
+    size_t _used = 0;
+    uint32_t _records = 0;
+    uint32_t _dropped = 0;
+    bool _paused = false;
+};
+
+
+// =================================================================
+// Tracer: Span timeline of what Dewab does, for Chrome/Perfetto.
+// Each span start and end is an 8-byte event (u32 CPU cycle count from
+// CCOUNT, u8 span, u8 phase 'B'/'E', u16 argument, e.g. bytes; little
+// endian) in a RAM ring that overwrites the oldest events. A capture is
+// the magic "DWT1", u32 CPU MHz and u32 overwritten events, followed by
+// the events; tools/trace-export turns it into Chrome trace JSON.
+// Loop and WebSocket-loop spans with nothing inside are dropped so idle
+// loops do not flush the ring, except every ~4 s: CCOUNT wraps every 2^32
+// cycles (~18 s at 240 MHz), so consecutive events stay closer than that.
+// =================================================================
+enum DewabTraceSpan : uint8_t {
+    DEWAB_TRACE_LOOP,        // Dewab::loop
+    DEWAB_TRACE_WS_LOOP,     // WebSocketsClient::loop: TLS reads and frame callbacks
+    DEWAB_TRACE_PARSE,       // deserializeJson of an inbound frame (arg: bytes)
+    DEWAB_TRACE_DISPATCH,    // Broadcast callback, i.e. Dewab::handleBroadcastCommand
+    DEWAB_TRACE_HANDLER,     // The registered command handler
+    DEWAB_TRACE_SERIALIZE,   // serializeJson of an outgoing broadcast (arg: bytes)
+    DEWAB_TRACE_SEND,        // sendTXT (arg: bytes)
+    DEWAB_TRACE_HEARTBEAT,   // SupabaseRealtimeClient::sendHeartbeat
+    DEWAB_TRACE_REST,        // REST batch flush, including the HTTPS POST
+    DEWAB_TRACE_STATE,       // Dewab::broadcastCurrentState
+    DEWAB_TRACE_SPAN_COUNT
+};
+
+class Tracer {
+public:
+    static const size_t eventSize = 8;
+    static const size_t headerSize = 12;
+
+    // Closes the span when it goes out of scope
+    class Scope {
+    public:
+        Scope(Tracer* tracer, DewabTraceSpan span, uint32_t arg = 0, bool dropIfEmpty = false);
+        ~Scope();
+        void setArg(uint32_t arg) { _arg = arg; }
+    private:
+        Tracer* _tracer;
+        DewabTraceSpan _span;
+        uint32_t _arg;
+        bool _dropIfEmpty;
+    };
+
+    ~Tracer();
+
+    // Allocates the ring. Returns false if the memory is not available.
+    bool begin(size_t maxEvents = 2048);
+    void end();
+    bool isEnabled() const;
+
+    void record(DewabTraceSpan span, char phase, uint32_t arg = 0);
+    // Removes the span's start event if it is the last one recorded
+    bool dropIfLast(DewabTraceSpan span);
+    // Stops recording while a capture is being read out
+    void setPaused(bool paused);
+    void clear();
+
+    size_t captureSize() const;
+    // Copies capture bytes starting at `offset` (0 = magic); returns the count
+    size_t read(size_t offset, uint8_t* dest, size_t length) const;
+
+    uint32_t eventCount() const { return _used; }
+    uint32_t overwrittenEvents() const { return _overwritten; }
+    static const char* spanName(DewabTraceSpan span);
+
+private:
+    struct Event {
+        uint32_t cycles;
+        uint8_t span;
+        uint8_t phase;
+        uint16_t arg;
+    };
+
+    Event* _events = nullptr;
+    size_t _capacity = 0;
+    size_t _head = 0; // Oldest event
+    size_t _used = 0;
+    uint32_t _overwritten = 0;
+    bool _paused = false;
+};
+
+
+// =================================================================
+// PcSampler: Statistical profiler for the core running loop().
+// A hardware timer interrupts at `hz` and the ISR reads the program
+// counter of the interrupted task from the context FreeRTOS saved on its
+// stack, counting it in an open-addressing table in internal RAM. After
+// the window the table is compacted into a profile: the magic "DWP1",
+// u32 hz, u32 samples, u32 lost (table full or probe limit hit), then
+// (u32 pc, u32 count) pairs; little endian. tools/profiler symbolizes it.
+// Samples that interrupt another ISR are attributed to the task below it.
+// =================================================================
+class PcSampler {
+public:
+    static const size_t headerSize = 16;
+    static const size_t entrySize = 8;
+
+    ~PcSampler();
+
+    // Allocates `slots` (rounded up to a power of two) table entries.
+    // Returns false if the memory is not available.
+    bool begin(size_t slots = 1024);
+    void end();
+    bool isEnabled() const;
+    void setClock(DewabClock* clock);
+
+    // Clears the profile and samples at hz for windowMs
+    bool start(unsigned long windowMs = 10000, uint32_t hz = 1000);
+    void stop();
+    bool isRunning() const;
+    // Stops the sampler when the window has passed
+    void loop();
+
+    size_t captureSize() const;
+    // Copies profile bytes starting at `offset` (0 = magic); returns the
+    // count. Only valid while stopped.
+    size_t read(size_t offset, uint8_t* dest, size_t length) const;
+
+    uint32_t sampleCount() const { return _samples; }
+    uint32_t lostSamples() const { return _lost; }
+    size_t entryCount() const { return _entries; }
+
+private:
+    static void onTimer();
+    static PcSampler* _active; // The ISR takes no argument on all core versions
+
+    DewabClock* _clock = DewabClock::system();
+    uint32_t* _pcs = nullptr;
+    uint32_t* _counts = nullptr;
+    size_t _slots = 0;
+    size_t _entries = 0;      // After stop(): pairs at the front of the table
+    uint32_t _hz = 0;
+    volatile uint32_t _samples = 0;
+    volatile uint32_t _lost = 0;
+    hw_timer_t* _timer = nullptr;
+    unsigned long _startedAt = 0;
+    unsigned long _windowMs = 0;
+};
+
+
+// =================================================================
+// CounterInputs: Pulse counts, frequency and duty cycle measured by the
+// chip's counter peripherals instead of polling in loop(). A PCNT unit
+// counts rising edges, with its 16-bit overflows accumulated to 32 bits.
+// An MCPWM capture channel timestamps both edges, and its ISR keeps the
+// period and high time of the last complete cycle. Reads are O(1); only
+// a stalled duty cycle reads the pin level. Inputs are set up on first
+// use; the chip limits them to maxCounters and maxCaptures (ESP32-S3).
+// Edges shorter than about 1 us are filtered out as glitches; contact
+// bounce is not.
+// =================================================================
+class CounterInputs {
+public:
+    static const size_t maxCounters = 4;  // PCNT units
+    static const size_t maxCaptures = 6;  // 2 MCPWM groups x 3 capture channels
+
+    // Capture state, written by the capture ISR
+    struct Capture {
+        int pin = -1;
+        void* channel = nullptr;        // mcpwm_cap_channel_handle_t on core 3.x
+        volatile uint32_t rise = 0;     // Capture timer ticks of the last edges
+        volatile uint32_t fall = 0;
+        volatile uint32_t period = 0;   // Ticks of the last complete cycle
+        volatile uint32_t high = 0;
+        volatile uint32_t edges = 0;
+        uint32_t seenEdges = 0;         // Stall detection, outside the ISR
+        unsigned long seenAt = 0;
+    };
+
+    ~CounterInputs();
+    void setClock(DewabClock* clock);
+
+    // Start counting rising edges on / capturing both edges of `pin`.
+    // True if the input is running, including when it already was; false
+    // on chips without PCNT (C2) or MCPWM (C2, C3). A pin that failed is
+    // not set up again, and logged once, until end().
+    bool beginCount(int pin);
+    bool beginCapture(int pin);
+    void end();
+
+    // Rising edges since beginCount(); 0 for a pin that is not counted
+    uint32_t count(int pin) const;
+    // Hz of the last complete cycle; 0 after stallTimeoutMs without an edge
+    float frequency(int pin);
+    // Percent of the last cycle spent high; 0 or 100 for a stalled signal
+    float dutyCycle(int pin);
+    void setStallTimeout(unsigned long stallTimeoutMs);
+
+    // Called from the capture ISR
+    static void onEdge(Capture* capture, bool rising, uint32_t ticks);
+
+private:
+    struct Counter {
+        int pin = -1;
+        void* unit = nullptr;           // Core 3.x: pcnt_unit_handle_t and
+        void* channel = nullptr;        // pcnt_channel_handle_t
+        int number = 0;                 // Core 2.x: PCNT unit number
+        volatile int32_t overflows = 0; // Core 2.x: high-limit events
+    };
+
+    static const size_t maxFailedPins = 8;
+
+    bool setUpCounter(int pin);
+    bool setUpCapture(int pin);
+    const Counter* findCounter(int pin) const;
+    Capture* findCapture(int pin);
+    bool isStalled(Capture& capture);
+    static void onOverflow(void* counter);
+
+    DewabClock* _clock = DewabClock::system();
+    Counter _counters[maxCounters];
+    Capture _captures[maxCaptures];
+    size_t _counterCount = 0;
+    size_t _captureCount = 0;
+    int _failedCounters[maxFailedPins];
+    int _failedCaptures[maxFailedPins];
+    size_t _failedCounterCount = 0;
+    size_t _failedCaptureCount = 0;
+    void* _captureTimers[2] = {};      // One capture timer per MCPWM group on core 3.x
+    uint32_t _captureHz = 80000000;    // Capture timer resolution
+    unsigned long _stallTimeoutMs = 2000;
+};
+
+
+// =================================================================
+// LogStreamer: Buffers log records for remote streaming.
+// Records from the DewabLog sink are sampled per tag and kept in a fixed
+// array; the owner takes them as one batch per flush interval and sends it
+// as a low-priority DEVICE_LOG broadcast. When the buffer is full new
+// records are dropped and counted, so a log storm costs at most one
+// batch per interval on the channel.
+// =================================================================
+struct LogStreamStats {
+    uint32_t queued = 0;
+    uint32_t sent = 0;
+    uint32_t batches = 0;
+    uint32_t sampledOut = 0; // Skipped by per-tag sampling
+    uint32_t dropped = 0;    // Buffer full
+};
+
+class LogStreamer {
+public:
+    static const size_t tagBytes = 12;
+    static const size_t textBytes = 112; // Longer records are truncated
+    static const size_t samplingSlots = 8;
+
+    ~LogStreamer();
+
+    // Allocates room for maxRecords and installs the DewabLog sink.
+    // Returns false if the memory is not available.
+    bool begin(DewabLogLevel level, size_t maxRecords = 16);
+    void end();
+    bool isEnabled() const;
+    void setClock(DewabClock* clock);
+
+    // Streams records up to `level` for durationMs, then returns to the
+    // level given to begin(); durationMs is capped at maxRaiseMs.
+    void raiseLevel(DewabLogLevel level, unsigned long durationMs);
+    DewabLogLevel level() const;
+    unsigned long raisedForMs() const;
+    // Keeps one in `oneIn` records of `tag` (1 = all, 0 = none)
+    bool setSampling(const char* tag, uint16_t oneIn);
+
+    void loop();
+    // Ignores records while the owner sends a batch, which logs itself
+    void setPaused(bool paused);
+    // True when a batch is due: records pending and flushInterval passed,
+    // or the buffer is half full and minFlushGap passed.
+    bool batchDue() const;
+    // Moves the pending records into doc["records"] and clears them
+    void takeBatch(JsonDocument& doc);
+    const LogStreamStats& stats() const;
+
+    static const char* levelName(DewabLogLevel level);
+    static DewabLogLevel levelFromName(const char* name, DewabLogLevel fallback);
+
+    unsigned long flushInterval = 5000;
+    unsigned long minFlushGap = 1000;
+    static const unsigned long maxRaiseMs = 600000;
+
+private:
+    struct Record {
+        uint32_t at;
+        DewabLogLevel level;
+        char tag[tagBytes];
+        char text[textBytes];
+    };
+    struct TagSampling {
+        char tag[tagBytes];
+        uint16_t oneIn;
+        uint16_t seen;
+    };
+
+    void add(DewabLogLevel level, const char* tag, const char* text);
+
+    DewabClock* _clock = DewabClock::system();
+    Record* _records = nullptr;
+    size_t _capacity = 0;
+    size_t _count = 0;
+    DewabLogLevel _baseLevel = DEWAB_LOG_WARN;
+    unsigned long _raisedUntil = 0;
+    bool _raised = false;
+    unsigned long _lastBatchAt = 0;
+    bool _paused = false;
+    TagSampling _sampling[samplingSlots] = {};
+    LogStreamStats _stats;
+};
+
+
+// =================================================================
+// EnergyMonitor: Estimates the radio and CPU energy Dewab costs.
+// Counts frames, bytes and estimated airtime in each direction, TLS
+// handshakes, library CPU time and time spent in each Wi-Fi power-save
+// mode, and turns them into an average current and mAh/day through a
+// per-board power model. It is an estimate for comparing settings
+// (heartbeat, batching, power save), not a measurement.
+// =================================================================
+// Outgoing frame kinds, for per-type size and energy accounting
+enum DewabFrameType {
+    DEWAB_FRAME_HEARTBEAT,
+    DEWAB_FRAME_JOIN,
+    DEWAB_FRAME_ACCESS_TOKEN,
+    DEWAB_FRAME_STATE,       // ARDUINO_STATE_UPDATE broadcasts
+    DEWAB_FRAME_ACK,         // <command>_ACK replies
+    DEWAB_FRAME_ERROR,       // <command>_ERROR replies
+    DEWAB_FRAME_CHUNK,       // <event>_CHUNK uploads
+    DEWAB_FRAME_BROADCAST,   // Any other broadcast
+    DEWAB_FRAME_REST,        // REST broadcast batches (HTTPS posts, not WebSocket frames)
+    DEWAB_FRAME_TYPE_COUNT
+};
+
+struct FrameSizeStats {
+    uint32_t count = 0;
+    uint32_t totalBytes = 0;
+    uint32_t lastBytes = 0;
+    uint32_t maxBytes = 0;
+};
+
+// Currents in mA. The defaults are rough Nano ESP32 (ESP32-S3) figures;
+// measure your own board for absolute numbers.
+struct DewabPowerModel {
+    float disconnectedMa = 100.0f;   // Scanning / reconnecting
+    float psNoneMa = 95.0f;          // Connected, radio always listening
+    float psMinModemMa = 40.0f;      // Connected, modem sleep every DTIM (Arduino default)
+    float psMaxModemMa = 30.0f;      // Connected, modem sleep per listen interval
+    float txMa = 250.0f;             // While transmitting
+    float rxMa = 100.0f;             // While receiving
+    float cpuBusyMa = 20.0f;         // On top of the baseline while library code runs
+    float tlsHandshakeMa = 120.0f;
+    uint32_t tlsHandshakeMs = 600;   // CPU and radio time of one handshake
+    float phyRateMbps = 24.0f;       // Typical data rate
+    uint16_t packetOverheadBytes = 110; // 802.11 + IP/TCP + TLS record + WebSocket headers
+    uint16_t packetOverheadMicros = 300; // Preamble, contention and the ACK exchange
+};
+
+enum DewabPowerState {
+    DEWAB_POWER_DISCONNECTED,
+    DEWAB_POWER_PS_NONE,
+    DEWAB_POWER_PS_MIN_MODEM,
+    DEWAB_POWER_PS_MAX_MODEM,
+    DEWAB_POWER_STATE_COUNT
+};
+
+struct TrafficEnergy {
+    uint32_t frames = 0;
+    uint32_t bytes = 0;
+    uint32_t airtimeMicros = 0;
+    float chargeMaMs = 0.0f;       // Above the baseline
+};
+
+class EnergyMonitor {
+public:
+    void setPowerModel(const DewabPowerModel& model);
+    const DewabPowerModel& powerModel() const;
+    void setClock(DewabClock* clock);
+
+    void countTx(DewabFrameType type, size_t bytes);
+    void countRx(size_t bytes);
+    void countTlsHandshake();
+    void addCpuMicros(uint32_t micros);
+
+    // Accumulates power-save residency; call every loop
+    void loop(bool wifiConnected);
+    // Average current and daily charge since the last reset
+    float averageMa() const;
+    float mAhPerDay() const;
+    void report(JsonDocument& doc) const;
+    void reset();
+
+private:
+    uint32_t airtimeMicros(size_t bytes) const;
+    float stateMa(DewabPowerState state) const;
+    float incrementalMa(float activeMa) const;
+    float windowMs() const;
+    float perDay(float chargeMaMs) const;
+
+    DewabClock* _clock = DewabClock::system();
+    DewabPowerModel _model;
+    DewabPowerState _state = DEWAB_POWER_DISCONNECTED;
+    unsigned long _lastLoopAt = 0;
+    uint32_t _residencyMs[DEWAB_POWER_STATE_COUNT] = {};
+    TrafficEnergy _tx[DEWAB_FRAME_TYPE_COUNT];
+    TrafficEnergy _rx;
+    uint32_t _tlsHandshakes = 0;
+    float _tlsChargeMaMs = 0.0f;
+    uint64_t _cpuMicros = 0;
+};
+
+
 // =================================================================
 // SupabaseRealtimeClient: Handles WebSocket communication with Supabase.
 // (Previously in SupabaseRealtimeClient.h)
@@ -44,6 +730,59 @@ typedef std::function<void()> DisconnectedCallback;
 typedef std::function<void(String)> ErrorCallback;
 typedef std::function<void(const String&, const String&, const JsonObjectConst&)> BroadcastCallback;
 typedef std::function<void(const String& topic, const String& joinRef)> ChannelJoinedCallback;
+// Returns a fresh access token (JWT), or an empty string if none is available yet
+typedef std::function<String()> TokenRefreshCallback;
+
+// Cost of inbound frames, for finding and bounding worst-case RX latency.
+// Times cover parsing and the broadcast handler (i.e. the whole command).
+struct RxStats {
+    uint32_t frames = 0;
+    uint32_t oversize = 0;       // Rejected before parsing: over maxFrameBytes
+    uint32_t parseErrors = 0;    // Invalid JSON or nested deeper than maxNesting
+    uint32_t refused = 0;        // Over refuseAbove: only the envelope was parsed
+    uint32_t lastMicros = 0;
+    uint32_t lastBytes = 0;
+    uint32_t lastParseBytes = 0; // Heap taken by the parsed document
+    uint32_t maxMicros = 0;
+    uint32_t maxParseBytes = 0;
+    String slowestFrame;         // First slowFrameKeep bytes of the slowest frame
+
+    static const size_t slowFrameKeep = 256;
+};
+
+// Messages and bytes per topic and event, for finding what uses up the
+// project's message quota. Broadcasts are keyed by their user event.
+struct BandwidthEntry {
+    String topic;
+    String event;
+    uint32_t messagesIn = 0;
+    uint32_t bytesIn = 0;
+    uint32_t messagesOut = 0;
+    uint32_t bytesOut = 0;
+};
+
+// Where the Realtime server is. The defaults are Supabase's hosted endpoint
+// for the project ref; a self-hosted server on the LAN or a local stand-in
+// sets its own host, port, paths and TLS.
+struct DewabEndpoint {
+    const char* host = nullptr;                          // nullptr = "<project ref>.supabase.co"
+    uint16_t port = 443;
+    bool tls = true;                                     // wss:// and https://, or plain ws:// and http://
+    const char* path = "/realtime/v1/websocket";         // Self-hosted Realtime: "/socket/websocket"
+    const char* restPath = "/realtime/v1/api/broadcast"; // Self-hosted Realtime: "/api/broadcast"
+    const char* query = nullptr;                         // Extra query parameters, e.g. "log_level=info"
+};
+
+// Connection health of one endpoint, for failover and latency-based fail-back
+struct EndpointHealth {
+    uint32_t connects = 0;
+    uint32_t failures = 0;             // Failed connects, drops and missed heartbeats
+    uint8_t consecutiveFailures = 0;   // Reset by a heartbeat reply
+    uint32_t connectMs = 0;            // Last time from connect attempt to WebSocket open
+    uint32_t rttMs = 0;                // Smoothed heartbeat round trip
+    uint32_t probeMs = 0;              // Smoothed TCP connect time of fail-back probes, 0 = unmeasured
+    unsigned long lastFailure = 0;
+};
 
 class SupabaseRealtimeClient {
 public:
@@ -55,6 +794,36 @@ public:
     void onError(ErrorCallback callback);
     void onBroadcast(BroadcastCallback callback);
     void onChannelJoined(ChannelJoinedCallback callback);
+    void onTokenRefresh(TokenRefreshCallback callback);
+
+    // Sets the access_token used for joins and pushes it to already joined
+    // channels without reconnecting. For JWTs the lifetime is read from the
+    // exp claim (against the clock once synced, else exp - iat) unless
+    // validForMs is given; the refresh callback is then called
+    // _tokenRefreshMargin ahead of expiry. Without a callback the expiry is
+    // reported once.
+    void setAccessToken(const String& token, unsigned long validForMs = 0);
+
+    // Replaces the hosted Supabase endpoint. The WebSocket and REST URLs are
+    // built once into fixed buffers; returns false, keeping the previous
+    // endpoint, if they do not fit. Call before connect().
+    bool setEndpoint(const DewabEndpoint& endpoint);
+    // Up to maxEndpoints endpoints in order of preference (e.g. regions or
+    // self-hosted fallbacks); their strings must outlive the client. After
+    // failuresBeforeSwitch connect failures, drops or missed heartbeats in a
+    // row the client fails over to the next healthy one. Every
+    // probeIntervalMs (0 = never) one endpoint's TCP connect time is probed,
+    // blocking for at most _probeTimeoutMs; after each round the client
+    // moves to the lowest-latency healthy endpoint if it is clearly faster.
+    // Probes go to a cached address. Each host is resolved in a loop() pass
+    // of its own, once and again after a failed probe; that lookup blocks
+    // for as long as the resolver takes.
+    bool setEndpoints(const DewabEndpoint* endpoints, size_t count);
+    void setFailover(uint8_t failuresBeforeSwitch, unsigned long probeIntervalMs = 60000);
+    size_t activeEndpoint() const;
+    const EndpointHealth& endpointHealth(size_t index) const;
+    void endpointReport(JsonDocument& doc) const;
+    static const size_t maxEndpoints = 4;
 
     void connect();
     void loop();
@@ -62,31 +831,156 @@ public:
 
     void joinChannel(const String& topic);
     bool broadcast(const String& topic, const String& event, const JsonDocument& payload);
+    // The Phoenix frame broadcast() sends, with `payload` as the user payload
+    static void buildBroadcastEnvelope(JsonDocument& doc, const String& topic, const String& event,
+                                       JsonVariantConst payload, const String& ref, const String& joinRef);
+
+    // Connectionless publishing via the Realtime REST broadcast endpoint.
+    // Messages are queued and posted together in one HTTPS request by
+    // flushRestBroadcasts(); the TLS connection is kept alive between flushes.
+    // A failed flush keeps the batch for the next one. When a full batch
+    // cannot be flushed, the oldest messages make room and queueing returns
+    // false, although the new message was queued.
+    bool queueRestBroadcast(const String& topic, const String& event, const JsonDocument& payload);
+    bool flushRestBroadcasts();
+    size_t pendingRestBroadcasts();
+    // Messages per REST request; a full batch is flushed before the next is queued
+    void setRestBatchLimit(size_t limit);
+
+    // Deflates ARDUINO_STATE_UPDATE payloads whose JSON is at least
+    // `threshold` bytes. They are sent as {"_z":"deflate-raw","n":<raw size>,
+    // "d":<base64>,"device_name":...}; smaller payloads, ones that do not
+    // shrink and all other events (replies, chunks, logs) go out unchanged.
+    void setCompression(bool enabled, size_t threshold = 512, uint16_t window = 1024);
+    const CompressionStats& compressionStats() const;
+
+    // Instruments RX, broadcast and heartbeat with the owner's heap monitor
+    void setHeapMonitor(HeapMonitor* monitor);
+    // Adds parse, dispatch, serialize, send, heartbeat and REST spans to the owner's trace
+    void setTracer(Tracer* tracer);
+    void setClock(DewabClock* clock);
+    // Records every frame sent and received
+    void setTrafficRecorder(TrafficRecorder* recorder);
+    // Counts traffic, TLS handshakes and airtime for the energy estimate
+    void setEnergyMonitor(EnergyMonitor* monitor);
+
+    // Frames longer than maxFrameBytes (0 = no limit) are dropped unparsed;
+    // JSON nested deeper than maxNesting fails to parse.
+    void setInputLimits(size_t maxFrameBytes, uint8_t maxNesting = 10);
+    // Frames longer than refuseAbove (0 = off) are only parsed for topic,
+    // event, target_device_name and request_id and handed to the refused
+    // callback, so the owner can answer with a cheap error.
+    void setRefuseAbove(size_t bytes);
+    void onRefused(BroadcastCallback callback);
+    const RxStats& rxStats() const;
+    void resetRxStats();
+    const FrameSizeStats& frameStats(DewabFrameType type) const;
+    void resetFrameStats();
+    static const char* frameTypeName(DewabFrameType type);
+
+    // Traffic by topic and event in a table of bandwidthSlots entries;
+    // pairs seen after it fills up are counted under "other".
+    void bandwidthReport(JsonDocument& doc) const;
+    void resetBandwidth();
+    static const size_t bandwidthSlots = 16;
+    static const size_t restBatchLimitDefault = 16;
 
 private:
-    void buildWebSocketUrl();
+    bool buildUrls(const DewabEndpoint& endpoint);
+    int endpointHost(const DewabEndpoint& endpoint, char* dest, size_t size) const;
+    void startWebSocket();
+    void noteEndpointFailure(const char* reason);
+    size_t nextHealthyEndpoint() const;
+    void switchEndpoint(size_t index);
+    bool probeNextEndpoint();
     void webSocketEvent(WStype_t type, uint8_t * payload, size_t length);
     String getNextMessageRef();
     void sendHeartbeat();
     void _joinChannel(const char* channelTopic);
+    bool sendFrame(String& frame, DewabFrameType type, const char* topic, const char* event);
+    void countFrame(DewabFrameType type, size_t bytes);
+    void accountTraffic(const char* topic, const char* event, bool inbound, size_t bytes);
+    void refuseFrame(uint8_t* frame, size_t length);
+    static DewabFrameType frameTypeFor(const String& event);
+    bool compressPayload(const String& event, const JsonDocument& payload, JsonDocument& envelope);
+    void pushAccessToken();
+    void refreshAccessToken();
+    static unsigned long jwtLifetimeMs(const String& token);
+    void finishRxFrame(unsigned long started, const uint8_t* frame, size_t length, uint32_t parseBytes);
 
     String _projectRef;
     String _apiKey;
-    String _wsHost;
-    String _wsPath;
-    const uint16_t _wsPort = 443;
+    static const size_t hostCapacity = 64;
+    static const size_t pathCapacity = 400;     // Holds the apikey, which can be a long JWT
+    static const size_t restUrlCapacity = 160;
+    char _wsHost[hostCapacity] = {};
+    char _wsPath[pathCapacity] = {};
+    uint16_t _wsPort = 443;
+    bool _tls = true;
+    DewabEndpoint _endpoints[maxEndpoints];
+    EndpointHealth _endpointHealth[maxEndpoints];
+    size_t _endpointCount = 1;
+    size_t _activeEndpoint = 0;
+    size_t _pendingEndpoint = SIZE_MAX;      // Switch requested from a WebSocket event, done in loop()
+    uint32_t _endpointSwitches = 0;
+    uint8_t _failoverAfter = 3;
+    unsigned long _probeInterval = 60000;
+    unsigned long _lastProbe = 0;
+    size_t _nextProbe = 0;
+    IPAddress _probeAddresses[maxEndpoints];   // Resolved once per host, cleared by a failed probe
+    unsigned long _attemptStarted = 0;
+    bool _heartbeatPending = false;
+    bool _switching = false;                 // Our own disconnect is not a failure
+    const unsigned long _connectTimeout = 15000;   // Not connected after this counts as a failure
+    const unsigned long _failoverCooldown = 60000; // A failed endpoint is skipped for this long
+    const int32_t _probeTimeoutMs = 1000;
     WebSocketsClient webSocket;
+    DewabClock* _clock = DewabClock::system();
+    bool _webSocketStarted = false;
+
+    char _restUrl[restUrlCapacity] = {};
+    WiFiClientSecure _restClient;
+    WiFiClient _restPlainClient;
+    HTTPClient _restHttp;
+    JsonDocument _restBatch;
+    size_t _restBatchLimit = restBatchLimitDefault;
+
+    bool _compressionEnabled = false;
+    size_t _compressionThreshold = 512;
+    uint16_t _compressionWindow = 1024;
+    CompressionStats _compressionStats;
+    HeapMonitor* _heapMonitor = nullptr;
+    Tracer* _tracer = nullptr;
+    TrafficRecorder* _recorder = nullptr;
+    EnergyMonitor* _energyMonitor = nullptr;
+
+    size_t _maxFrameBytes = 0;
+    uint8_t _maxNesting = 10; // ArduinoJson's default
+    size_t _refuseAbove = 0;
+    RxStats _rxStats;
+    FrameSizeStats _frameStats[DEWAB_FRAME_TYPE_COUNT];
+    BandwidthEntry _bandwidth[bandwidthSlots];
+    size_t _bandwidthUsed = 0;
+    BandwidthEntry _bandwidthOther;
+    unsigned long _bandwidthSince = 0;
 
     bool _connected = false;
     unsigned long _lastHeartbeatSent = 0;
     const unsigned long _heartbeatInterval = 25000; // 25 seconds
     unsigned int _messageRefCounter = 1;
 
+    String _accessToken;
+    unsigned long _tokenRefreshAt = 0;       // 0 = no refresh scheduled
+    const unsigned long _tokenRefreshMargin = 60000; // Refresh 60 s before expiry
+    const unsigned long _tokenRetryInterval = 10000; // Retry delay after a failed refresh
+
     ConnectedCallback _connectedCallback = nullptr;
     DisconnectedCallback _disconnectedCallback = nullptr;
     ErrorCallback _errorCallback = nullptr;
     BroadcastCallback _broadcastCallback = nullptr;
+    BroadcastCallback _refusedCallback = nullptr;
     ChannelJoinedCallback _channelJoinedCallback = nullptr;
+    TokenRefreshCallback _tokenRefreshCallback = nullptr;
 
     std::map<String, String> _topicJoinRefs;
 };
@@ -97,6 +991,27 @@ private:
 // =================================================================
 typedef std::function<void(JsonDocument& docToPopulate)> StateProviderCallback;
 typedef std::function<bool(const JsonObjectConst& payload, JsonDocument& customReplyData)> SpecificCommandHandler;
+// Result of Dewab::call(): ok with the responder's result, or not ok with
+// its error message, or with null after the timeout
+typedef std::function<void(bool ok, JsonVariantConst result)> CallResponseCallback;
+
+// Counters for signed command verification
+struct CommandAuthStats {
+    uint32_t verified = 0;
+    uint32_t rejected = 0;      // Missing or bad signature, wrong command/target, nonce table full
+    uint32_t replayed = 0;      // Reused nonce or timestamp outside the window
+    uint32_t clockUnsynced = 0; // Refused because the device clock was not set yet
+    uint32_t lastMicros = 0;    // Verification time of the last command
+    uint32_t maxMicros = 0;
+    uint32_t totalMicros = 0;
+    uint32_t overBudget = 0;    // Verifications slower than the budget
+};
+
+// How state updates leave the device.
+enum DewabPublishMode {
+    DEWAB_PUBLISH_WEBSOCKET, // Over the Realtime WebSocket (default)
+    DEWAB_PUBLISH_REST       // Batched HTTPS posts to the REST broadcast endpoint
+};
 
 class Dewab {
 public:
@@ -116,6 +1031,125 @@ public:
     // Call this from the main sketch when you want to send the current state
     void broadcastCurrentState(const char* reason);
 
+    // Asks the cloud side something, e.g. a setpoint or the AI agent. Sends
+    // `event` with `payload` plus call_id and device_name on the command
+    // channel; a dashboard answers with a CALL_RESULT broadcast carrying the
+    // same call_id (DeviceProxy.handleCalls() in dewab/). The callback runs
+    // from loop(), with the result or on timeout. Returns the call id, or 0
+    // if the call was not sent (not connected, or maxPendingCalls in flight).
+    uint32_t call(const char* event, const JsonDocument& payload, CallResponseCallback callback, unsigned long timeoutMs = 10000);
+    static const size_t maxPendingCalls = 8;
+
+    // For sleepy, low-duty-cycle devices: publish state over short HTTPS
+    // requests instead of keeping the WebSocket alive. The WebSocket is only
+    // opened when listenForCommands is true. Call before begin().
+    void setPublishMode(DewabPublishMode mode, bool listenForCommands = true);
+    // Posts queued REST state updates now (e.g. right before deep sleep).
+    bool flush();
+
+    // Talks to a self-hosted Realtime server or local stand-in instead of
+    // <supabaseRef>.supabase.co. Call before begin().
+    bool setEndpoint(const DewabEndpoint& endpoint);
+    // Ordered fallback endpoints with latency-based fail-back, see
+    // SupabaseRealtimeClient::setEndpoints(); health is served by ENDPOINT_STATS.
+    bool setEndpoints(const DewabEndpoint* endpoints, size_t count);
+    void setFailover(uint8_t failuresBeforeSwitch, unsigned long probeIntervalMs = 60000);
+
+    // Spreads a large fleet over `shards` command channels. The device only
+    // joins realtime:dewab-cmd-<shard>, with shard = FNV-1a(deviceName) %
+    // shards, so it sees 1/shards of the fleet's commands while a dashboard
+    // needs just `shards` subscriptions. 0 or 1 keeps the single
+    // realtime:arduino-commands channel. Call before begin().
+    void setCommandShards(uint16_t shards);
+    const String& commandTopic() const;
+    static uint16_t commandShard(const char* deviceName, uint16_t shards);
+
+    // JWT-based keys: refresh the token on joined channels ahead of expiry
+    // instead of reconnecting. See SupabaseRealtimeClient::setAccessToken().
+    void setAccessToken(const String& token, unsigned long validForMs = 0);
+    void onTokenRefresh(TokenRefreshCallback callback);
+
+    // Deflate large outgoing payloads. See SupabaseRealtimeClient::setCompression().
+    void setCompression(bool enabled, size_t threshold = 512, uint16_t window = 1024);
+    const CompressionStats& compressionStats() const;
+
+    // Only accept HMAC-SHA256 signed commands. A signed command payload is
+    // {"signed": "<json>", "sig": "<hex>"}, where <json> carries command,
+    // target, nonce, ts and args; args is what the handler receives. The HMAC
+    // runs on the ESP32 SHA accelerator through mbedTLS. Setting a key starts
+    // SNTP; until the clock is synced every signed command is refused, since
+    // without a timestamp check a recorded command could be replayed after a
+    // reboot. Commands older than the newest accepted ts minus the window
+    // are refused even if the clock is later moved back. Nonces are kept for
+    // the whole window, which caps signed commands at 64 per 30 s.
+    void setCommandSigningKey(const char* key);
+    const CommandAuthStats& commandAuthStats() const;
+
+    // Heap health for soak testing; also served by the HEAP_STATS command.
+    // Per-site time and heap cost and outgoing frame sizes are served by
+    // PERF_STATS, for the budget checks in tools/perf-budget.
+    HeapMonitor& heapMonitor();
+
+    // Bounds inbound frames, see SupabaseRealtimeClient::setInputLimits().
+    // RX cost and the slowest frame so far are served by the RX_STATS command.
+    void setInputLimits(size_t maxFrameBytes, uint8_t maxNesting = 10);
+    const RxStats& rxStats() const;
+
+    // Estimated energy cost (average mA, mAh/day) of Dewab's radio and CPU
+    // use under a per-board power model; also served by ENERGY_STATS.
+    EnergyMonitor& energyMonitor();
+    void setPowerModel(const DewabPowerModel& model);
+
+    // Times Dewab's hot paths on this board: state building with stateAdd*,
+    // broadcast envelope serialization, inbound frame parsing and command
+    // lookup, each `iterations` times, in CPU cycles and heap bytes held.
+    // Blocks until done; also served by the BENCH command.
+    void benchmark(JsonDocument& report, uint16_t iterations = 100);
+
+    // Degrades instead of running out of memory. Below lowBytes of free heap:
+    // no debug logging, REST batches of 4, state updates as deltas (only
+    // changed fields, with "delta": true) and commands over maxCommandBytes
+    // refused with a cheap _ERROR reply. Below criticalBytes: also only
+    // warnings and errors logged and REST messages posted one by one.
+    // Recovers automatically; transitions are in HEAP_STATS under "pressure".
+    void setMemoryWatermarks(uint32_t lowBytes, uint32_t criticalBytes, size_t maxCommandBytes = 1024);
+    DewabMemoryLevel memoryLevel() const;
+
+    // Sampling profiler for the loop() core: PROFILE_START samples the
+    // program counter at up to 10 kHz for a window, PROFILE_DUMP uploads
+    // the PC histogram, and tools/profiler symbolizes it against the ELF.
+    bool enableProfiler(size_t slots = 1024);
+    PcSampler& profiler();
+
+    // Records a span timeline (loop, WebSocket reads, parse, dispatch,
+    // handler, serialize, send, heartbeat, REST, state) into a ring of
+    // maxEvents 8-byte events. The TRACE_DUMP command uploads it in chunks;
+    // tools/trace-export converts it for chrome://tracing and Perfetto.
+    bool enableTracing(size_t maxEvents = 2048);
+    Tracer& tracer();
+
+    // Streams log records up to `level` (independent of the Serial level) as
+    // batched DEVICE_LOG broadcasts, at most one per flush interval and never
+    // while memory is low. The LOG_LEVEL command raises the level for a
+    // bounded time and sets per-tag sampling; tools/log-stream shows them.
+    bool enableLogStreaming(DewabLogLevel level = DEWAB_LOG_WARN, size_t maxRecords = 16);
+    LogStreamer& logStreamer();
+
+    // Messages and bytes per topic/event in both directions, served by the
+    // TRAFFIC_STATS command; with an interval > 0 the same report is also
+    // broadcast periodically as a TRAFFIC_STATS event.
+    void setTrafficReportInterval(unsigned long intervalMs);
+
+    // Captures inbound and outbound frames into a RAM ring of ringBytes, for
+    // replay on the host (tools/traffic-replay). The capture is uploaded in
+    // chunks by the RECORDER_DUMP command.
+    bool enableTrafficRecorder(size_t ringBytes = 16384, size_t maxFrameBytes = 512);
+    TrafficRecorder& trafficRecorder();
+
+    // Replaces the time source of Dewab and its WiFi and Supabase clients,
+    // e.g. with a VirtualClock to run timing scenarios instantly.
+    void setClock(DewabClock* clock);
+
     // These remain for internal use by the SupabaseClient instance owned by Dewab
     void handleSupabaseConnected();
     void handleBroadcastCommand(const String& topic, const String& event, const JsonObjectConst& payload);
@@ -131,17 +1165,92 @@ public:
     void stateAddFloat(JsonDocument& doc, const char* category, const char* name, float value, int decimals = 2);
     void stateAddAnalogPin(JsonDocument& doc, const char* category, const char* name, int pin);
     void stateAddDigitalPin(JsonDocument& doc, const char* category, const char* name, int pin, bool activeLow = false);
+    // Counter-backed inputs (see CounterInputs). The first call sets up the
+    // peripheral for the pin; call counterInputs().beginCount(pin) in setup()
+    // to count from boot instead. The field is null if the pin has none.
+    void stateAddPulseCount(JsonDocument& doc, const char* category, const char* name, int pin);
+    void stateAddFrequency(JsonDocument& doc, const char* category, const char* name, int pin, int decimals = 1);
+    void stateAddDutyCycle(JsonDocument& doc, const char* category, const char* name, int pin, int decimals = 1);
+    CounterInputs& counterInputs();
 
 private:
     const char* _deviceName;
+    DewabClock* _clock = DewabClock::system();
     
     // Dewab now owns these
     WifiManager _wifiManager;
     SupabaseRealtimeClient _supabaseClient;
 
+    DewabPublishMode _publishMode = DEWAB_PUBLISH_WEBSOCKET;
+    bool _listenForCommands = true;
+    unsigned long _restBatchStarted = 0;
+    const unsigned long _restFlushInterval = 2000; // Batching window for REST state updates
+
+    String _commandTopic = "realtime:arduino-commands";
+
+    struct PendingCall {
+        uint32_t id = 0; // 0 = free slot
+        unsigned long sentAt = 0;
+        unsigned long timeoutMs = 0;
+        CallResponseCallback callback;
+    };
+    PendingCall _pendingCalls[maxPendingCalls];
+    uint32_t _nextCallId = 0; // Seeded randomly, so replies to calls from before a reboot do not match
+    void handleCallResult(const JsonObjectConst& payload);
+    void expireCalls();
+
     StateProviderCallback _stateProvider = nullptr;
     // Store registered command handlers
     std::map<String, SpecificCommandHandler> _registeredCommands;
+    // Diagnostics commands that are available unless the sketch overrides them
+    void registerBuiltinCommands();
+
+    HeapMonitor _heapMonitor;
+    TrafficRecorder _recorder;
+    EnergyMonitor _energyMonitor;
+    LogStreamer _logStreamer;
+    Tracer _tracer;
+    PcSampler _profiler;
+    CounterInputs _counterInputs;
+    bool _perfResetPending = false;
+    DewabMemoryLevel _memoryLevel = DEWAB_MEMORY_NORMAL;
+    size_t _pressureMaxCommandBytes = 1024;
+    void applyMemoryLevel(DewabMemoryLevel level);
+    void handleRefusedCommand(const String& topic, const String& event, const JsonObjectConst& payload);
+    // 32-bit fingerprints of the last sent value of each state field, for delta updates
+    struct StateFingerprint {
+        uint32_t key;
+        uint32_t value;
+    };
+    static const size_t _stateFieldSlots = 32;
+    StateFingerprint _stateFields[_stateFieldSlots];
+    size_t _stateFieldCount = 0;
+    bool stateFieldChanged(const char* category, const char* name, JsonVariantConst value);
+    bool diffState(const JsonDocument& state, JsonDocument* delta);
+    unsigned long _trafficReportInterval = 0;
+    unsigned long _lastTrafficReport = 0;
+
+    // Sends `length` bytes as base64 <event> broadcasts of chunkBytes each,
+    // tagged with requestId, seq and total so the receiver can reassemble.
+    bool uploadChunked(const String& event, JsonVariantConst requestId, size_t length,
+                       std::function<size_t(size_t offset, uint8_t* dest, size_t length)> reader,
+                       size_t chunkBytes = 1024);
+
+    bool verifySignedCommand(const String& commandType, const JsonObjectConst& payload, JsonDocument& signedDoc, const char*& error);
+    String _signingKey;
+    CommandAuthStats _authStats;
+    // Nonces of accepted commands still inside the window; when all slots are
+    // taken further signed commands are refused rather than a nonce forgotten
+    struct SeenNonce {
+        uint32_t nonce;
+        long ts;
+    };
+    static const size_t _nonceHistory = 64;
+    SeenNonce _recentNonces[_nonceHistory] = {};
+    size_t _recentNonceCount = 0;
+    long _newestSignedTs = 0;                     // High-water mark of accepted ts
+    const long _signatureWindow = 30;             // Seconds a signed command stays valid
+    const unsigned long _verifyBudgetMicros = 500; // Per-command verification budget
 };
 
 #endif // DEWAB_H 
\ No newline at end of file
@@ -0,0 +1,79 @@
+import { DeviceDiagnostics, downloadFile } from '../common/device-diagnostics.js';
+
+// TODO: Replace with your Supabase credentials (or a local Realtime stand-in)
+const SUPABASE_URL = '';
+const SUPABASE_ANON_KEY = '';
+
+const runBtn = document.getElementById('run-btn');
+const saveBtn = document.getElementById('save-btn');
+const baselineInput = document.getElementById('baseline-file');
+const resultsTable = document.getElementById('results');
+const logBox = document.getElementById('log');
+
+let diagnostics = null;
+let result = null;
+let baseline = null;
+
+async function getDiagnostics() {
+    if (!SUPABASE_URL || !SUPABASE_ANON_KEY) {
+        throw new Error('Set SUPABASE_URL and SUPABASE_ANON_KEY in tools/bench/script.js first.');
+    }
+    if (!diagnostics) {
+        diagnostics = new DeviceDiagnostics(SUPABASE_URL, SUPABASE_ANON_KEY);
+        await diagnostics.connect();
+    }
+    return diagnostics;
+}
+
+async function runBench() {
+    const device = document.getElementById('device').value.trim();
+    runBtn.disabled = true;
+    try {
+        const diag = await getDiagnostics();
+        const { reply } = await diag.request(device, 'BENCH', { iterations: Number(document.getElementById('iterations').value) });
+        result = reply;
+        saveBtn.disabled = false;
+        log(`${reply.chip} at ${reply.cpu_mhz} MHz, SDK ${reply.sdk}, sketch ${reply.sketch_md5}.`);
+        render();
+    } catch (error) {
+        log(error.message);
+    } finally {
+        runBtn.disabled = false;
+    }
+}
+
+/**
+ * Mean cycles per kernel, and the change against the baseline result if
+ * one is loaded. Cycles compare builds on one board; µs compare boards.
+ */
+function render() {
+    if (!result) return;
+    const header = '<tr><th>Kernel</th><th>Mean cycles</th><th>Min</th><th>Max</th><th>µs</th><th>Heap held</th>' +
+        (baseline ? '<th>vs. baseline</th>' : '') + '</tr>';
+    resultsTable.innerHTML = header + Object.entries(result.kernels).map(([name, k]) => {
+        const base = baseline?.kernels?.[name];
+        const change = base ? `<td>${((k.mean_cycles / base.mean_cycles - 1) * 100).toFixed(1)}%</td>` : (baseline ? '<td>-</td>' : '');
+        return `<tr><td>${name}</td><td>${k.mean_cycles}</td><td>${k.min_cycles}</td><td>${k.max_cycles}</td>` +
+            `<td>${k.mean_micros}</td><td>${k.held_bytes}</td>${change}</tr>`;
+    }).join('');
+}
+
+function log(message) {
+    const line = document.createElement('div');
+    line.textContent = `${new Date().toLocaleTimeString()} ${message}`;
+    logBox.prepend(line);
+}
+
+runBtn.addEventListener('click', runBench);
+saveBtn.addEventListener('click', () => downloadFile(JSON.stringify(result, null, 2), `dewab-bench-${Date.now()}.json`, 'application/json'));
+baselineInput.addEventListener('change', async () => {
+    const file = baselineInput.files[0];
+    if (!file) return;
+    try {
+        baseline = JSON.parse(await file.text());
+        log(`Baseline: ${baseline.chip} at ${baseline.cpu_mhz} MHz, sketch ${baseline.sketch_md5}.`);
+        render();
+    } catch (error) {
+        log(`Could not read baseline: ${error.message}`);
+    }
+});
@@ -0,0 +1,55 @@
+/**
+ * Decoder for Dewab traffic captures (TrafficRecorder in dewab_cpp/Dewab.h):
+ * the magic "DWR1" followed by records of
+ *   u32 time ms | u8 direction | u16 stored length | u16 original length | bytes
+ * in little endian.
+ */
+
+export const INBOUND = 0;
+export const OUTBOUND = 1;
+const HEADER_SIZE = 9;
+const MAGIC = 'DWR1';
+
+/**
+ * @param {Uint8Array} bytes - A capture as uploaded by RECORDER_DUMP
+ * @returns {Array<Object>} Records with timeMs, direction, truncated, text and frame (parsed JSON or null)
+ */
+export function parseCapture(bytes) {
+    if (String.fromCharCode(...bytes.slice(0, 4)) !== MAGIC) {
+        throw new Error('Not a Dewab traffic capture (missing DWR1 magic)');
+    }
+    const view = new DataView(bytes.buffer, bytes.byteOffset, bytes.byteLength);
+    const decoder = new TextDecoder();
+    const records = [];
+
+    for (let offset = 4; offset + HEADER_SIZE <= bytes.length;) {
+        const timeMs = view.getUint32(offset, true);
+        const direction = view.getUint8(offset + 4);
+        const stored = view.getUint16(offset + 5, true);
+        const original = view.getUint16(offset + 7, true);
+        const text = decoder.decode(bytes.subarray(offset + HEADER_SIZE, offset + HEADER_SIZE + stored));
+        offset += HEADER_SIZE + stored;
+
+        let frame = null;
+        if (stored === original) {
+            try {
+                frame = JSON.parse(text);
+            } catch {
+                // Not JSON; keep the raw text
+            }
+        }
+        records.push({ timeMs, direction, length: original, truncated: stored < original, text, frame });
+    }
+    return records;
+}
+
+/**
+ * Summarizes a Phoenix frame as "topic event[/inner event]"
+ * @param {Object|null} frame
+ * @returns {string}
+ */
+export function describeFrame(frame) {
+    if (!frame) return '(truncated or not JSON)';
+    const inner = frame.event === 'broadcast' && frame.payload?.event ? `/${frame.payload.event}` : '';
+    return `${frame.topic} ${frame.event}${inner}`;
+}
@@ -0,0 +1,175 @@
+import { createClient } from 'https://cdn.jsdelivr.net/npm/@supabase/supabase-js/+esm';
+
+// Same channels as the Arduino library (Dewab::setCommandShards)
+const COMMANDS_CHANNEL = 'arduino-commands';
+
+/**
+ * Command channel of a device: the single legacy channel, or
+ * "dewab-cmd-<FNV-1a(device name) mod shards>" in a sharded fleet
+ */
+export function commandChannelName(device, shards = 0) {
+    if (!shards || shards <= 1) return COMMANDS_CHANNEL;
+    let hash = 2166136261;
+    for (const byte of new TextEncoder().encode(device)) {
+        hash = Math.imul(hash ^ byte, 16777619) >>> 0;
+    }
+    return `dewab-cmd-${hash % shards}`;
+}
+
+/**
+ * Sends Dewab's built-in diagnostics commands (HEAP_STATS, RECORDER_DUMP, ...)
+ * to a device and collects the replies, reassembling chunked uploads.
+ *
+ * Chunked uploads arrive as broadcasts of the form
+ * { request_id, seq, total, data: <base64> } before the command's _ACK.
+ */
+export class DeviceDiagnostics {
+    /**
+     * @param {string} supabaseUrl
+     * @param {string} supabaseAnonKey
+     * @param {Object} [options]
+     * @param {number} [options.shards=0] - Command channel count of a sharded fleet; all of them are joined
+     */
+    constructor(supabaseUrl, supabaseAnonKey, { shards = 0 } = {}) {
+        this.client = createClient(supabaseUrl, supabaseAnonKey, {
+            realtime: { params: { eventsPerSecond: 100 } },
+        });
+        this.shards = shards;
+        this.channels = new Map();
+        this.pending = new Map();
+        this.listeners = new Map();
+        this.nextId = 1;
+    }
+
+    /**
+     * Calls `callback(payload)` for every broadcast of `event`, e.g. the
+     * DEVICE_LOG batches of devices with log streaming enabled
+     * @param {string} event
+     * @param {Function} callback
+     */
+    on(event, callback) {
+        if (!this.listeners.has(event)) this.listeners.set(event, []);
+        this.listeners.get(event).push(callback);
+    }
+
+    connect() {
+        const names = this.shards > 1
+            ? Array.from({ length: this.shards }, (_, shard) => `dewab-cmd-${shard}`)
+            : [COMMANDS_CHANNEL];
+        return Promise.all(names.map((name) => {
+            const channel = this.client.channel(name);
+            channel.on('broadcast', { event: '*' }, ({ event, payload }) => this._onBroadcast(event, payload));
+            this.channels.set(name, channel);
+            return new Promise((resolve, reject) => {
+                channel.subscribe((status) => {
+                    if (status === 'SUBSCRIBED') resolve();
+                    else if (status === 'CHANNEL_ERROR' || status === 'TIMED_OUT') reject(new Error(`${name}: ${status}`));
+                });
+            });
+        }));
+    }
+
+    /**
+     * Sends a command and waits for its reply
+     * @param {string} device - Target device name
+     * @param {string} command - Command name, e.g. 'RECORDER_DUMP'
+     * @param {Object} [payload={}] - Command arguments
+     * @param {Object} [options]
+     * @param {string} [options.chunkEvent] - Event carrying the upload, e.g. 'RECORDER_DUMP_CHUNK'
+     * @param {number} [options.timeoutMs=30000]
+     * @returns {Promise<{reply: Object, data: Uint8Array|null}>} The _ACK payload and uploaded bytes
+     */
+    request(device, command, payload = {}, { chunkEvent = null, timeoutMs = 30000 } = {}) {
+        const requestId = `diag-${Date.now()}-${this.nextId++}`;
+        return new Promise((resolve, reject) => {
+            const entry = { command, chunkEvent, chunks: [], total: null, reply: null, resolve, reject };
+            entry.timer = setTimeout(() => {
+                this.pending.delete(requestId);
+                reject(new Error(`${command} to ${device} timed out`));
+            }, timeoutMs);
+            this.pending.set(requestId, entry);
+
+            this.channels.get(commandChannelName(device, this.shards)).send({
+                type: 'broadcast',
+                event: command,
+                payload: { ...payload, target_device_name: device, request_id: requestId },
+            }).catch((error) => {
+                clearTimeout(entry.timer);
+                this.pending.delete(requestId);
+                reject(error);
+            });
+        });
+    }
+
+    async disconnect() {
+        await this.client.removeAllChannels();
+    }
+
+    _onBroadcast(event, payload) {
+        (this.listeners.get(event) || []).forEach(callback => callback(payload));
+        const entry = this.pending.get(payload?.request_id);
+        if (!entry) return;
+
+        if (event === entry.chunkEvent) {
+            entry.chunks[payload.seq] = payload.data;
+            entry.total = payload.total;
+        } else if (event === `${entry.command}_ACK`) {
+            entry.reply = payload;
+        } else if (event === `${entry.command}_ERROR`) {
+            this._finish(payload.request_id, entry);
+            entry.reject(new Error(payload.message || `${entry.command} failed on device`));
+            return;
+        } else {
+            return;
+        }
+        this._tryComplete(payload.request_id, entry);
+    }
+
+    _tryComplete(requestId, entry) {
+        if (!entry.reply) return;
+        if (!entry.chunkEvent) {
+            this._finish(requestId, entry);
+            entry.resolve({ reply: entry.reply, data: null });
+            return;
+        }
+        const received = entry.chunks.filter(c => c !== undefined).length;
+        if (entry.total === null && entry.reply.bytes === 0) {
+            entry.total = 0; // Empty upload, no chunks are sent
+        }
+        if (entry.total === null || received < entry.total) return;
+
+        this._finish(requestId, entry);
+        entry.resolve({ reply: entry.reply, data: concatBase64(entry.chunks) });
+    }
+
+    _finish(requestId, entry) {
+        clearTimeout(entry.timer);
+        this.pending.delete(requestId);
+    }
+}
+
+function concatBase64(chunks) {
+    const parts = chunks.map(c => Uint8Array.from(atob(c), ch => ch.charCodeAt(0)));
+    const out = new Uint8Array(parts.reduce((n, p) => n + p.length, 0));
+    let offset = 0;
+    for (const part of parts) {
+        out.set(part, offset);
+        offset += part.length;
+    }
+    return out;
+}
+
+/**
+ * Saves bytes or text as a download
+ * @param {Uint8Array|string} data
+ * @param {string} filename
+ * @param {string} [type='application/octet-stream']
+ */
+export function downloadFile(data, filename, type = 'application/octet-stream') {
+    const blob = new Blob([data], { type });
+    const link = document.createElement('a');
+    link.href = URL.createObjectURL(blob);
+    link.download = filename;
+    link.click();
+    URL.revokeObjectURL(link.href);
+}
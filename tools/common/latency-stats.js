@@ -0,0 +1,107 @@
+/**
+ * Latency and throughput bookkeeping shared by the Dewab host tools.
+ */
+
+/**
+ * Collects latency samples (ms) and reports percentiles.
+ */
+export class LatencyStats {
+    constructor() {
+        this.samples = [];
+        this._sorted = true;
+    }
+
+    /**
+     * Record one sample
+     * @param {number} ms - Latency in milliseconds
+     */
+    add(ms) {
+        this.samples.push(ms);
+        this._sorted = false;
+    }
+
+    get count() {
+        return this.samples.length;
+    }
+
+    /**
+     * Nearest-rank percentile
+     * @param {number} p - Percentile between 0 and 100
+     * @returns {number|null} The sample at that rank, or null without samples
+     */
+    percentile(p) {
+        if (this.samples.length === 0) return null;
+        if (!this._sorted) {
+            this.samples.sort((a, b) => a - b);
+            this._sorted = true;
+        }
+        const rank = Math.ceil((p / 100) * this.samples.length);
+        return this.samples[Math.min(this.samples.length - 1, Math.max(0, rank - 1))];
+    }
+
+    /**
+     * @returns {Object} count, mean and the usual percentiles
+     */
+    summary() {
+        const count = this.samples.length;
+        const mean = count ? this.samples.reduce((sum, v) => sum + v, 0) / count : null;
+        return {
+            count,
+            mean,
+            min: this.percentile(0),
+            p50: this.percentile(50),
+            p90: this.percentile(90),
+            p99: this.percentile(99),
+            p999: this.percentile(99.9),
+            max: this.percentile(100),
+        };
+    }
+
+    reset() {
+        this.samples = [];
+        this._sorted = true;
+    }
+}
+
+/**
+ * Counts events and bytes, and reports the rate since the last call to rate().
+ */
+export class RateCounter {
+    constructor() {
+        this.total = 0;
+        this.bytes = 0;
+        this._windowCount = 0;
+        this._windowStart = performance.now();
+    }
+
+    /**
+     * @param {number} [bytes=0] - Size of the event
+     */
+    add(bytes = 0) {
+        this.total++;
+        this.bytes += bytes;
+        this._windowCount++;
+    }
+
+    /**
+     * Events per second since the previous call
+     * @returns {number}
+     */
+    rate() {
+        const now = performance.now();
+        const elapsed = (now - this._windowStart) / 1000;
+        const rate = elapsed > 0 ? this._windowCount / elapsed : 0;
+        this._windowCount = 0;
+        this._windowStart = now;
+        return rate;
+    }
+}
+
+/**
+ * Formats a latency value for tables
+ * @param {number|null} ms
+ * @returns {string}
+ */
+export function formatMs(ms) {
+    return ms === null || ms === undefined ? '–' : `${ms.toFixed(1)} ms`;
+}
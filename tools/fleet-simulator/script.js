@@ -0,0 +1,344 @@
+import { createClient } from 'https://cdn.jsdelivr.net/npm/@supabase/supabase-js/+esm';
+import { LatencyStats, RateCounter, formatMs } from '../common/latency-stats.js';
+import { commandChannelName } from '../common/device-diagnostics.js';
+
+// TODO: Replace with your Supabase credentials (or a local Realtime stand-in)
+const SUPABASE_URL = '';
+const SUPABASE_ANON_KEY = '';
+
+// Same events as the Arduino library (Dewab.cpp); COMMAND_SHARDS matches
+// Dewab::setCommandShards() on real devices, 0 = the single arduino-commands channel
+const COMMAND_SHARDS = 0;
+const STATE_UPDATE_EVENT = 'ARDUINO_STATE_UPDATE';
+const COMMAND_TIMEOUT_MS = 5000;
+
+const startBtn = document.getElementById('start-btn');
+const stopBtn = document.getElementById('stop-btn');
+const resultsTable = document.getElementById('results');
+const logBox = document.getElementById('log');
+
+/**
+ * Synthetic sensor scripts. Each returns the sensor values of one device
+ * at time t (ms since start); `phase` decorrelates devices.
+ */
+const SENSOR_SCRIPTS = {
+    sine: (t, phase) => ({
+        temperature: +(21 + 3 * Math.sin(t / 60000 + phase) + Math.random() * 0.2).toFixed(2),
+        button_d2: false,
+    }),
+    randomWalk: (t, phase, previous) => ({
+        temperature: +((previous?.temperature ?? 21) + (Math.random() - 0.5) * 0.5).toFixed(2),
+        button_d2: false,
+    }),
+    buttonBursts: (t, phase) => ({
+        temperature: 21,
+        button_d2: Math.sin(t / 5000 + phase) > 0.95,
+    }),
+};
+
+/**
+ * One simulated board. Builds state like the demo sketch and handles
+ * commands the way Dewab::handleBroadcastCommand does.
+ */
+class SimulatedDevice {
+    constructor(name, sensorScript) {
+        this.name = name;
+        this.sensorScript = sensorScript;
+        this.phase = Math.random() * 2 * Math.PI;
+        this.sensors = null;
+        this.outputs = { led_red: false, led_yellow: false };
+    }
+
+    buildState(reason, t) {
+        this.sensors = this.sensorScript(t, this.phase, this.sensors);
+        return {
+            device_name: this.name,
+            reason,
+            inputs: { button_d2: this.sensors.button_d2 },
+            sensors: { temperature: this.sensors.temperature },
+            outputs: { ...this.outputs },
+        };
+    }
+
+    /**
+     * @returns {{event: string, payload: Object, stateChanged: boolean}} The reply
+     */
+    handleCommand(command, payload) {
+        const reply = {
+            original_command: command,
+            device_name: this.name,
+        };
+        if (payload.request_id !== undefined) {
+            reply.request_id = payload.request_id;
+        }
+
+        if (command !== 'set_outputs') {
+            return {
+                event: `${command}_ERROR`,
+                payload: { ...reply, status: 'error', message: 'Unknown command type or no handler registered on device.' },
+                stateChanged: false,
+            };
+        }
+
+        let stateChanged = false;
+        for (const key of Object.keys(this.outputs)) {
+            if (key in payload && payload[key] !== this.outputs[key]) {
+                this.outputs[key] = Boolean(payload[key]);
+                stateChanged = true;
+            }
+        }
+        return {
+            event: `${command}_ACK`,
+            payload: { ...reply, status: 'success', led_red_state: this.outputs.led_red, led_yellow_state: this.outputs.led_yellow },
+            stateChanged,
+        };
+    }
+}
+
+/**
+ * Joins the command channel of each of the given devices on one client.
+ * Resolves to a name -> channel map, or null if any channel failed to join.
+ */
+function joinCommandChannels(client, deviceNames, onMessage) {
+    const channels = new Map();
+    const names = new Set(deviceNames.map(name => commandChannelName(name, COMMAND_SHARDS)));
+    return Promise.all([...names].map((name) => {
+        const channel = client.channel(name);
+        channel.on('broadcast', { event: '*' }, onMessage);
+        channels.set(name, channel);
+        return new Promise((resolve) => {
+            channel.subscribe((status) => {
+                if (status === 'SUBSCRIBED') resolve(true);
+                else if (status === 'CHANNEL_ERROR' || status === 'TIMED_OUT') {
+                    log(`${name} failed to join: ${status}`);
+                    resolve(false);
+                }
+            });
+        });
+    })).then(joined => (joined.every(Boolean) ? channels : null));
+}
+
+/**
+ * One Realtime socket shared by a slice of the simulated fleet, so a
+ * thousand devices do not need a thousand browser WebSockets.
+ */
+class SimulatedConnection {
+    constructor(devices, metrics) {
+        this.devices = new Map(devices.map(d => [d.name, d]));
+        this.metrics = metrics;
+        this.client = null;
+        this.channels = null; // Command channel name -> channel, one per shard in use
+    }
+
+    async connect() {
+        this.client = createClient(SUPABASE_URL, SUPABASE_ANON_KEY, {
+            realtime: { params: { eventsPerSecond: 1000 } },
+        });
+        const started = performance.now();
+        this.channels = await joinCommandChannels(this.client, [...this.devices.keys()],
+            (message) => this._onBroadcast(message));
+        if (!this.channels) {
+            this.metrics.errors++;
+            return false;
+        }
+        this.metrics.joinTimes.add(performance.now() - started);
+        return true;
+    }
+
+    _onBroadcast(message) {
+        const payload = message.payload || {};
+        this.metrics.messagesIn.add(JSON.stringify(payload).length);
+
+        const device = this.devices.get(payload.target_device_name);
+        if (!device || message.event.endsWith('_ACK') || message.event.endsWith('_ERROR')) {
+            return;
+        }
+        const reply = device.handleCommand(message.event, payload);
+        this.send(device, reply.event, reply.payload);
+        if (reply.stateChanged) {
+            this.publishState(device, 'outputs_changed_by_command');
+        }
+    }
+
+    publishState(device, reason) {
+        this.send(device, STATE_UPDATE_EVENT, device.buildState(reason, performance.now() - this.metrics.startedAt));
+        this.metrics.stateUpdates++;
+    }
+
+    send(device, event, payload) {
+        this.metrics.messagesOut.add(JSON.stringify(payload).length);
+        this.channels.get(commandChannelName(device.name, COMMAND_SHARDS))
+            .send({ type: 'broadcast', event, payload }).catch(() => this.metrics.errors++);
+    }
+
+    async disconnect() {
+        if (this.client) {
+            await this.client.removeAllChannels();
+        }
+    }
+}
+
+/**
+ * Plays the dashboard: fires set_outputs at random devices and times the
+ * matching _ACK/_ERROR by request_id.
+ */
+class CommandDriver {
+    constructor(deviceNames, metrics) {
+        this.deviceNames = deviceNames;
+        this.metrics = metrics;
+        this.pending = new Map();
+        this.nextRequestId = 1;
+    }
+
+    async connect() {
+        this.client = createClient(SUPABASE_URL, SUPABASE_ANON_KEY, {
+            realtime: { params: { eventsPerSecond: 1000 } },
+        });
+        this.channels = await joinCommandChannels(this.client, this.deviceNames, ({ event, payload }) => {
+            if (!event.endsWith('_ACK') && !event.endsWith('_ERROR')) return;
+            const sentAt = this.pending.get(payload?.request_id);
+            if (sentAt === undefined) return;
+            this.pending.delete(payload.request_id);
+            this.metrics.commandLatency.add(performance.now() - sentAt);
+            if (event.endsWith('_ERROR')) this.metrics.commandErrors++;
+        });
+        return this.channels !== null;
+    }
+
+    fire() {
+        const target = this.deviceNames[Math.floor(Math.random() * this.deviceNames.length)];
+        const requestId = this.nextRequestId++;
+        this.pending.set(requestId, performance.now());
+        this.metrics.commandsSent++;
+        this.channels.get(commandChannelName(target, COMMAND_SHARDS)).send({
+            type: 'broadcast',
+            event: 'set_outputs',
+            payload: { target_device_name: target, request_id: requestId, led_red: Math.random() < 0.5 },
+        }).catch(() => this.metrics.errors++);
+    }
+
+    expire() {
+        const now = performance.now();
+        for (const [requestId, sentAt] of this.pending) {
+            if (now - sentAt > COMMAND_TIMEOUT_MS) {
+                this.pending.delete(requestId);
+                this.metrics.commandTimeouts++;
+            }
+        }
+    }
+
+    async disconnect() {
+        if (this.client) {
+            await this.client.removeAllChannels();
+        }
+    }
+}
+
+let run = null;
+
+async function start() {
+    if (!SUPABASE_URL || !SUPABASE_ANON_KEY) {
+        log('Set SUPABASE_URL and SUPABASE_ANON_KEY in tools/fleet-simulator/script.js first.');
+        return;
+    }
+    const deviceCount = Number(document.getElementById('device-count').value);
+    const connectionCount = Math.min(deviceCount, Number(document.getElementById('connection-count').value));
+    const stateIntervalMs = Number(document.getElementById('state-interval').value) * 1000;
+    const commandRate = Number(document.getElementById('command-rate').value);
+    const prefix = document.getElementById('device-prefix').value;
+    const sensorScript = SENSOR_SCRIPTS[document.getElementById('sensor-script').value];
+
+    const metrics = {
+        startedAt: performance.now(),
+        joinTimes: new LatencyStats(),
+        commandLatency: new LatencyStats(),
+        messagesIn: new RateCounter(),
+        messagesOut: new RateCounter(),
+        stateUpdates: 0,
+        commandsSent: 0,
+        commandErrors: 0,
+        commandTimeouts: 0,
+        errors: 0,
+    };
+
+    const devices = Array.from({ length: deviceCount }, (_, i) => new SimulatedDevice(`${prefix}-${i + 1}`, sensorScript));
+    const connections = Array.from({ length: connectionCount }, (_, c) =>
+        new SimulatedConnection(devices.filter((_, i) => i % connectionCount === c), metrics));
+    const driver = new CommandDriver(devices.map(d => d.name), metrics);
+
+    run = { metrics, devices, connections, driver, timers: [] };
+    startBtn.disabled = true;
+    stopBtn.disabled = false;
+    log(`Starting ${deviceCount} devices on ${connectionCount} connections...`);
+
+    const joined = await Promise.all(connections.map(c => c.connect()));
+    log(`${joined.filter(Boolean).length}/${connectionCount} connections joined.`);
+    if (!run) return; // Stopped while joining
+
+    // Initial state, like Dewab after channel join
+    connections.forEach(c => c.devices.forEach(d => c.publishState(d, 'dewab_channel_joined')));
+
+    // Spread periodic state updates evenly over the interval
+    const owner = new Map();
+    connections.forEach(c => c.devices.forEach(d => owner.set(d, c)));
+    let nextDevice = 0;
+    const tickMs = 100;
+    const perTick = deviceCount * tickMs / stateIntervalMs;
+    let carry = 0;
+    run.timers.push(setInterval(() => {
+        carry += perTick;
+        for (; carry >= 1; carry--) {
+            const device = devices[nextDevice++ % deviceCount];
+            owner.get(device).publishState(device, 'periodic');
+        }
+    }, tickMs));
+
+    if (commandRate > 0 && await driver.connect()) {
+        run.timers.push(setInterval(() => driver.fire(), 1000 / commandRate));
+    }
+    run.timers.push(setInterval(() => {
+        driver.expire();
+        renderResults();
+    }, 1000));
+}
+
+async function stop() {
+    if (!run) return;
+    const { connections, driver, timers } = run;
+    timers.forEach(clearInterval);
+    renderResults();
+    run = null;
+    await Promise.all([...connections.map(c => c.disconnect()), driver.disconnect()]);
+    startBtn.disabled = false;
+    stopBtn.disabled = true;
+    log('Stopped.');
+}
+
+function renderResults() {
+    const m = run.metrics;
+    const join = m.joinTimes.summary();
+    const latency = m.commandLatency.summary();
+    const rows = [
+        ['Devices', run.devices.length],
+        ['Connections joined', `${join.count}/${run.connections.length}`],
+        ['Join time p50 / p99 / max', `${formatMs(join.p50)} / ${formatMs(join.p99)} / ${formatMs(join.max)}`],
+        ['Messages out / s', m.messagesOut.rate().toFixed(1)],
+        ['Messages in / s', m.messagesIn.rate().toFixed(1)],
+        ['Bytes out / in', `${m.messagesOut.bytes} / ${m.messagesIn.bytes}`],
+        ['State updates sent', m.stateUpdates],
+        ['Commands sent / acked / timed out', `${m.commandsSent} / ${latency.count} / ${m.commandTimeouts}`],
+        ['Command errors', m.commandErrors],
+        ['Command latency p50 / p99 / p99.9', `${formatMs(latency.p50)} / ${formatMs(latency.p99)} / ${formatMs(latency.p999)}`],
+        ['Send errors', m.errors],
+    ];
+    resultsTable.innerHTML = rows.map(([k, v]) => `<tr><td>${k}</td><td>${v}</td></tr>`).join('');
+}
+
+function log(message) {
+    const line = document.createElement('div');
+    line.textContent = `${new Date().toLocaleTimeString()} ${message}`;
+    logBox.prepend(line);
+}
+
+startBtn.addEventListener('click', start);
+stopBtn.addEventListener('click', stop);
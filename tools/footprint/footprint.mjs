@@ -0,0 +1,256 @@
+#!/usr/bin/env node
+/**
+ * Flash and static RAM footprint of Dewab and its dependencies.
+ *
+ * Compiles the reference sketches in sketches/ with arduino-cli, parses the
+ * linker map of each build, and prints:
+ *   - per sketch: flash, IRAM, initialized data and bss, and the delta to
+ *     the bare sketch (the cost of WiFi, TLS, WebSockets, ArduinoJson, Dewab);
+ *   - per component of each Dewab sketch, attributed by object file/archive.
+ * ArduinoJson is header-only, so its code lands in the objects that use it;
+ * its standalone cost is the arduinojson sketch's delta.
+ *
+ * With --port, the Dewab sketches are also uploaded and their FOOTPRINT
+ * serial line (heap and loop stack low-water marks) is added to the table.
+ * Every run appends to a CSV history so footprints can be compared across
+ * versions.
+ *
+ * Usage: node tools/footprint/footprint.mjs [--fqbn arduino:esp32:nano_nora]
+ *        [--sketches bare,dewab] [--port /dev/ttyACM0] [--out report.md]
+ *        [--history tools/footprint/history.csv] [--label v1.2]
+ * Credentials for the runtime measurement come from FOOTPRINT_WIFI_SSID,
+ * FOOTPRINT_WIFI_PASSWORD, FOOTPRINT_SUPABASE_REF and FOOTPRINT_SUPABASE_KEY.
+ */
+import { execFileSync, spawn } from 'node:child_process';
+import { appendFileSync, copyFileSync, existsSync, mkdirSync, mkdtempSync, readFileSync, readdirSync, writeFileSync } from 'node:fs';
+import { tmpdir } from 'node:os';
+import { dirname, join } from 'node:path';
+import { fileURLToPath } from 'node:url';
+
+const TOOL_DIR = dirname(fileURLToPath(import.meta.url));
+const REPO_DIR = join(TOOL_DIR, '..', '..');
+const LIBRARY_FILES = ['Dewab.h', 'Dewab.cpp'];
+const RUNTIME_TIMEOUT_MS = 150000; // The sketches report once a minute
+
+// Object file or archive path → component. First match wins.
+const COMPONENTS = [
+    ['dewab', /Dewab\.cpp\.o/],
+    ['sketch', /\.ino\.cpp\.o/],
+    ['websockets', /[\\/]WebSockets[\\/]/],
+    ['http-client', /[\\/]HTTPClient[\\/]/],
+    ['arduino-tls', /[\\/](WiFiClientSecure|NetworkClientSecure)[\\/]/],
+    ['arduino-wifi', /[\\/](WiFi|Network)[\\/]/],
+    ['mbedtls', /libmbed(tls|crypto|x509)|[\\/]mbedtls[\\/]/],
+    ['lwip', /liblwip/],
+    ['wifi-driver', /lib(net80211|pp|phy|wpa_supplicant|esp_wifi|coexist|mesh|espnow|smartconfig|esp_phy)\.a/],
+    ['freertos', /libfreertos/],
+    ['libc', /lib(c|m|stdc\+\+|gcc|g|newlib)\.a|libc_/],
+    ['arduino-core', /core\.a|[\\/]cores[\\/]esp32[\\/]/],
+];
+
+// Output section → region. Flash image = flash + iram + data; static RAM = iram + data + bss.
+function regionOf(section) {
+    if (section.startsWith('.flash.') && !section.includes('noload')) return 'flash';
+    if (section.startsWith('.iram0.')) return 'iram';
+    if (section === '.dram0.data') return 'data';
+    if (section === '.dram0.bss') return 'bss';
+    return null;
+}
+
+function componentOf(path) {
+    const match = COMPONENTS.find(([, pattern]) => pattern.test(path));
+    return match ? match[0] : 'esp-idf';
+}
+
+/**
+ * Sums input section sizes of a GNU ld map file by region and component
+ * @param {string} text - Map file contents
+ * @returns {{totals: Object, components: Object}} Byte counts per region
+ */
+export function parseMap(text) {
+    const emptyRegions = () => ({ flash: 0, iram: 0, data: 0, bss: 0 });
+    const totals = emptyRegions();
+    const components = {};
+    let region = null;
+    let pendingName = false; // Long input section names put the address on the next line
+
+    for (const line of text.split('\n')) {
+        const output = /^(\.\S+)(\s+0x[0-9a-f]+\s+0x[0-9a-f]+)?/.exec(line);
+        if (output) {
+            region = regionOf(output[1]);
+            continue;
+        }
+        if (!region) continue;
+
+        const input = /^\s*(\S+)?\s+0x([0-9a-f]+)\s+0x([0-9a-f]+)\s*(.*)$/.exec(line);
+        if (input && (input[1] || pendingName)) {
+            const size = parseInt(input[3], 16);
+            const component = input[1] === '*fill*' ? 'padding' : componentOf(input[4]);
+            components[component] ??= emptyRegions();
+            components[component][region] += size;
+            totals[region] += size;
+            pendingName = false;
+        } else {
+            pendingName = /^ \S+$/.test(line);
+        }
+    }
+    return { totals, components };
+}
+
+function parseArgs(argv) {
+    const args = {
+        fqbn: 'arduino:esp32:nano_nora',
+        sketches: null,
+        port: null,
+        out: null,
+        history: join(TOOL_DIR, 'history.csv'),
+        label: null,
+    };
+    for (let i = 0; i < argv.length; i += 2) {
+        const key = argv[i].replace(/^--/, '');
+        if (!(key in args)) throw new Error(`Unknown option ${argv[i]}`);
+        args[key] = argv[i + 1];
+    }
+    args.sketches = args.sketches ? args.sketches.split(',') : readdirSync(join(TOOL_DIR, 'sketches'));
+    args.label ??= gitLabel();
+    return args;
+}
+
+function gitLabel() {
+    try {
+        return execFileSync('git', ['describe', '--always', '--dirty'], { cwd: REPO_DIR }).toString().trim();
+    } catch {
+        return 'unknown';
+    }
+}
+
+/**
+ * Copies a reference sketch and, if it uses Dewab, the library sources
+ * into a temporary sketch folder, as the Arduino IDE expects
+ */
+function prepareSketch(name) {
+    const dir = join(mkdtempSync(join(tmpdir(), 'dewab-footprint-')), name);
+    mkdirSync(dir);
+    const source = readFileSync(join(TOOL_DIR, 'sketches', name, `${name}.ino`), 'utf8');
+    writeFileSync(join(dir, `${name}.ino`), source);
+    if (source.includes('"Dewab.h"')) {
+        LIBRARY_FILES.forEach(f => copyFileSync(join(REPO_DIR, 'dewab_cpp', f), join(dir, f)));
+        const env = process.env;
+        writeFileSync(join(dir, 'footprint_config.h'), [
+            '#pragma once',
+            `#define FOOTPRINT_WIFI_SSID ${JSON.stringify(env.FOOTPRINT_WIFI_SSID || 'ssid')}`,
+            `#define FOOTPRINT_WIFI_PASSWORD ${JSON.stringify(env.FOOTPRINT_WIFI_PASSWORD || 'password')}`,
+            `#define FOOTPRINT_SUPABASE_REF ${JSON.stringify(env.FOOTPRINT_SUPABASE_REF || 'project-ref')}`,
+            `#define FOOTPRINT_SUPABASE_KEY ${JSON.stringify(env.FOOTPRINT_SUPABASE_KEY || 'anon-key')}`,
+            '',
+        ].join('\n'));
+    }
+    return { dir, reportsRuntime: source.includes('FOOTPRINT {') };
+}
+
+function compile(name, dir, fqbn) {
+    const buildPath = join(dir, 'build');
+    process.stderr.write(`Compiling ${name}...\n`);
+    execFileSync('arduino-cli', ['compile', '--fqbn', fqbn, '--build-path', buildPath, dir], { stdio: ['ignore', 'ignore', 'inherit'] });
+    const mapFile = join(buildPath, `${name}.ino.map`);
+    if (!existsSync(mapFile)) throw new Error(`No linker map at ${mapFile}`);
+    return parseMap(readFileSync(mapFile, 'utf8'));
+}
+
+/**
+ * Uploads the sketch and waits for its FOOTPRINT {...} serial line
+ */
+function measureRuntime(name, dir, fqbn, port) {
+    process.stderr.write(`Uploading ${name} to ${port} and waiting for its FOOTPRINT line...\n`);
+    execFileSync('arduino-cli', ['upload', '--fqbn', fqbn, '--port', port, '--input-dir', join(dir, 'build'), dir], { stdio: ['ignore', 'ignore', 'inherit'] });
+    return new Promise((resolve, reject) => {
+        const monitor = spawn('arduino-cli', ['monitor', '--port', port, '--config', 'baudrate=115200']);
+        let buffered = '';
+        const timer = setTimeout(() => {
+            monitor.kill();
+            reject(new Error(`${name} printed no FOOTPRINT line within ${RUNTIME_TIMEOUT_MS / 1000} s`));
+        }, RUNTIME_TIMEOUT_MS);
+        monitor.stdout.on('data', (chunk) => {
+            buffered += chunk;
+            const match = /FOOTPRINT (\{.*\})/.exec(buffered);
+            if (match) {
+                clearTimeout(timer);
+                monitor.kill();
+                resolve(JSON.parse(match[1]));
+            }
+        });
+    });
+}
+
+function kb(bytes) {
+    return bytes === undefined ? '–' : (bytes / 1024).toFixed(1);
+}
+
+function delta(value, base) {
+    if (base === undefined) return '';
+    const d = value - base;
+    return ` (${d >= 0 ? '+' : ''}${kb(d)})`;
+}
+
+function report(results, label) {
+    const base = results.find(r => r.name === 'bare');
+    const lines = [
+        `# Dewab footprint (${label})`,
+        '',
+        'KiB; deltas are relative to the bare sketch. Flash image = flash + IRAM + data; static RAM = IRAM + data + bss.',
+        '',
+        '| Sketch | Flash image | Static RAM | IRAM | Data + bss | Min free heap | Min loop stack free |',
+        '| --- | ---: | ---: | ---: | ---: | ---: | ---: |',
+    ];
+    for (const r of results) {
+        const image = r.totals.flash + r.totals.iram + r.totals.data;
+        const ram = r.totals.iram + r.totals.data + r.totals.bss;
+        const baseImage = base && base.totals.flash + base.totals.iram + base.totals.data;
+        const baseRam = base && base.totals.iram + base.totals.data + base.totals.bss;
+        lines.push(`| ${r.name} | ${kb(image)}${delta(image, baseImage)} | ${kb(ram)}${delta(ram, baseRam)} | ${kb(r.totals.iram)} | ` +
+            `${kb(r.totals.data + r.totals.bss)} | ${kb(r.runtime?.min_free_bytes)} | ${kb(r.runtime?.min_stack_free)} |`);
+    }
+
+    for (const r of results.filter(r => r.name.startsWith('dewab'))) {
+        lines.push('', `## Components of ${r.name}`, '', '| Component | Flash | IRAM | Data | Bss |', '| --- | ---: | ---: | ---: | ---: |');
+        Object.entries(r.components)
+            .sort(([, a], [, b]) => (b.flash + b.iram) - (a.flash + a.iram))
+            .forEach(([name, c]) => lines.push(`| ${name} | ${kb(c.flash)} | ${kb(c.iram)} | ${kb(c.data)} | ${kb(c.bss)} |`));
+    }
+    return lines.join('\n') + '\n';
+}
+
+function appendHistory(file, label, results) {
+    if (!existsSync(file)) {
+        writeFileSync(file, 'label,date,sketch,flash,iram,data,bss,min_free_heap,min_stack_free\n');
+    }
+    const date = new Date().toISOString().slice(0, 10);
+    const rows = results.map(r => [label, date, r.name, r.totals.flash, r.totals.iram, r.totals.data, r.totals.bss,
+        r.runtime?.min_free_bytes ?? '', r.runtime?.min_stack_free ?? ''].join(','));
+    appendFileSync(file, rows.join('\n') + '\n');
+}
+
+async function main() {
+    const args = parseArgs(process.argv.slice(2));
+    const results = [];
+    for (const name of args.sketches) {
+        const { dir, reportsRuntime } = prepareSketch(name);
+        const result = { name, ...compile(name, dir, args.fqbn) };
+        if (args.port && reportsRuntime) {
+            result.runtime = await measureRuntime(name, dir, args.fqbn, args.port);
+        }
+        results.push(result);
+    }
+
+    const markdown = report(results, args.label);
+    process.stdout.write(markdown);
+    if (args.out) writeFileSync(args.out, markdown);
+    appendHistory(args.history, args.label, results);
+}
+
+if (process.argv[1] === fileURLToPath(import.meta.url)) {
+    main().catch((error) => {
+        process.stderr.write(`${error.message}\n`);
+        process.exit(1);
+    });
+}
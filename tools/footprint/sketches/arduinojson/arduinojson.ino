@@ -0,0 +1,15 @@
+// ArduinoJson parse and serialize, without networking
+#include <Arduino.h>
+#include <ArduinoJson.h>
+
+void setup() {
+    Serial.begin(115200);
+}
+
+void loop() {
+    JsonDocument doc;
+    deserializeJson(doc, "{\"topic\":\"realtime:arduino-commands\",\"event\":\"broadcast\",\"payload\":{\"led_red\":true}}");
+    doc["payload"]["value"] = millis();
+    serializeJson(doc, Serial);
+    delay(1000);
+}
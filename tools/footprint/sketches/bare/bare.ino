@@ -0,0 +1,10 @@
+// Baseline: Arduino core, FreeRTOS and the ESP-IDF startup code only
+#include <Arduino.h>
+
+void setup() {
+    Serial.begin(115200);
+}
+
+void loop() {
+    delay(1000);
+}
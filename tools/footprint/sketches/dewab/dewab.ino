@@ -0,0 +1,36 @@
+// Dewab with the defaults of the demo sketch: WebSocket publishing, one
+// command and a state provider. Prints a FOOTPRINT line with runtime heap
+// and stack low-water marks once a minute.
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include "Dewab.h"
+#include "footprint_config.h" // Written by footprint.mjs
+
+Dewab dewab("footprint", FOOTPRINT_WIFI_SSID, FOOTPRINT_WIFI_PASSWORD, FOOTPRINT_SUPABASE_REF, FOOTPRINT_SUPABASE_KEY);
+bool ledOn = false;
+unsigned long lastReport = 0;
+
+void setup() {
+    Serial.begin(115200);
+    dewab.onStateUpdateRequest([](JsonDocument& doc) {
+        dewab.stateAddBool(doc, "outputs", "led", ledOn);
+        dewab.stateAddInt(doc, "sensors", "uptime", millis() / 1000);
+    });
+    dewab.registerCommand("set_outputs", [](const JsonObjectConst& payload, JsonDocument& reply) {
+        if (payload["led"].is<bool>()) ledOn = payload["led"].as<bool>();
+        reply["led_state"] = ledOn;
+        dewab.broadcastCurrentState("outputs_changed_by_command");
+        return true;
+    });
+    dewab.begin();
+}
+
+void loop() {
+    dewab.loop();
+    if (millis() - lastReport >= 60000) {
+        lastReport = millis();
+        const HeapSnapshot& heap = dewab.heapMonitor().lastSample();
+        Serial.printf("FOOTPRINT {\"min_free_bytes\":%lu,\"largest_free_block\":%lu,\"min_stack_free\":%lu}\n",
+                      (unsigned long)heap.minFreeBytes, (unsigned long)heap.largestFreeBlock, (unsigned long)heap.minStackFree);
+    }
+}
@@ -0,0 +1,19 @@
+// WiFi plus a TLS connection (mbedTLS), as used by the REST publisher
+#include <Arduino.h>
+#include <WiFi.h>
+#include <WiFiClientSecure.h>
+
+WiFiClientSecure client;
+
+void setup() {
+    Serial.begin(115200);
+    WiFi.begin("ssid", "password");
+    client.setInsecure();
+}
+
+void loop() {
+    if (WiFi.status() == WL_CONNECTED && client.connect("example.com", 443)) {
+        client.stop();
+    }
+    delay(1000);
+}
@@ -0,0 +1,19 @@
+// WiFi plus a TLS WebSocket (links2004 WebSockets), as used by SupabaseRealtimeClient
+#include <Arduino.h>
+#include <WiFi.h>
+#include <WebSocketsClient.h>
+
+WebSocketsClient webSocket;
+
+void setup() {
+    Serial.begin(115200);
+    WiFi.begin("ssid", "password");
+    webSocket.beginSSL("example.com", 443, "/socket");
+    webSocket.onEvent([](WStype_t type, uint8_t* payload, size_t length) {
+        if (type == WStype_TEXT) Serial.write(payload, length);
+    });
+}
+
+void loop() {
+    webSocket.loop();
+}
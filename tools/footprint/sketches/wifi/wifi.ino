@@ -0,0 +1,14 @@
+// WiFi station, as used by WifiManager
+#include <Arduino.h>
+#include <WiFi.h>
+
+void setup() {
+    Serial.begin(115200);
+    WiFi.mode(WIFI_STA);
+    WiFi.begin("ssid", "password");
+}
+
+void loop() {
+    Serial.println(WiFi.status());
+    delay(1000);
+}
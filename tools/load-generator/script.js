@@ -0,0 +1,300 @@
+import { createClient } from 'https://cdn.jsdelivr.net/npm/@supabase/supabase-js/+esm';
+import { LatencyStats, formatMs } from '../common/latency-stats.js';
+import { commandChannelName } from '../common/device-diagnostics.js';
+
+// TODO: Replace with your Supabase credentials (or a local Realtime stand-in)
+const SUPABASE_URL = '';
+const SUPABASE_ANON_KEY = '';
+
+// Same as Dewab::setCommandShards() on the devices; 0 = the single arduino-commands channel
+const COMMAND_SHARDS = 0;
+const BASELINE_STORAGE_KEY = 'dewabLoadBaseline';
+// A step "holds" while less than 1% of commands time out and at least 90%
+// of the offered rate is actually achieved.
+const MAX_TIMEOUT_RATE = 0.01;
+const MIN_ACHIEVED_RATIO = 0.9;
+const SCHEDULER_TICK_MS = 10;
+
+const startBtn = document.getElementById('start-btn');
+const stopBtn = document.getElementById('stop-btn');
+const baselineBtn = document.getElementById('baseline-btn');
+const exportBtn = document.getElementById('export-btn');
+const resultsTable = document.getElementById('results');
+const logBox = document.getElementById('log');
+
+/**
+ * Sends commands over one Realtime connection and matches the device's
+ * _ACK/_ERROR replies to them by request_id.
+ */
+class CommandLoadGenerator {
+    constructor() {
+        this.client = null;
+        this.channels = new Map(); // Command channel name -> channel, one per shard in use
+        this.pending = new Map();
+        this.runId = Math.random().toString(36).slice(2, 8);
+        this.nextId = 1;
+        this.step = null;
+    }
+
+    /**
+     * Joins the command channel of every target device
+     * @param {string[]} devices - Target device names
+     */
+    connect(devices) {
+        this.client = createClient(SUPABASE_URL, SUPABASE_ANON_KEY, {
+            realtime: { params: { eventsPerSecond: 1000 } },
+        });
+        const names = new Set(devices.map(device => commandChannelName(device, COMMAND_SHARDS)));
+        return Promise.all([...names].map((name) => {
+            const channel = this.client.channel(name);
+            channel.on('broadcast', { event: '*' }, ({ event, payload }) => this._onReply(event, payload));
+            this.channels.set(name, channel);
+            return new Promise((resolve, reject) => {
+                channel.subscribe((status) => {
+                    if (status === 'SUBSCRIBED') resolve();
+                    else if (status === 'CHANNEL_ERROR' || status === 'TIMED_OUT') reject(new Error(`${name}: ${status}`));
+                });
+            });
+        }));
+    }
+
+    /**
+     * Runs one load step at a fixed offered rate
+     * @param {Object} options - devices, command, payload, rate, concurrency, durationMs, timeoutMs
+     * @returns {Promise<Object>} Step results
+     */
+    runStep(options) {
+        const step = {
+            options,
+            latency: new LatencyStats(),
+            sent: 0,
+            acked: 0,
+            errors: 0,
+            timeouts: 0,
+            skipped: 0, // Send slots lost to the concurrency limit
+            startedAt: performance.now(),
+        };
+        this.step = step;
+
+        let credit = 0;
+        return new Promise((resolve) => {
+            step.resolve = resolve;
+            step.timer = setInterval(() => {
+                const now = performance.now();
+                this._expire(now);
+
+                if (now - step.startedAt < options.durationMs) {
+                    credit += options.rate * SCHEDULER_TICK_MS / 1000;
+                    for (; credit >= 1; credit--) {
+                        if (this.pending.size >= options.concurrency) {
+                            step.skipped++;
+                        } else {
+                            this._send(now);
+                        }
+                    }
+                } else if (this.pending.size === 0) {
+                    // Drained: every command was answered or timed out
+                    clearInterval(step.timer);
+                    this.step = null;
+                    resolve(summarizeStep(step));
+                }
+            }, SCHEDULER_TICK_MS);
+        });
+    }
+
+    /**
+     * Ends the running step early; it resolves with what was measured so far
+     */
+    abort() {
+        const step = this.step;
+        this.step = null;
+        this.pending.clear();
+        if (step) {
+            clearInterval(step.timer);
+            step.resolve(summarizeStep(step));
+        }
+    }
+
+    _send(now) {
+        const { devices, command, payload } = this.step.options;
+        const requestId = `lg-${this.runId}-${this.nextId++}`;
+        const target = devices[this.step.sent % devices.length];
+        this.pending.set(requestId, now);
+        this.step.sent++;
+        this.channels.get(commandChannelName(target, COMMAND_SHARDS)).send({
+            type: 'broadcast',
+            event: command,
+            payload: { ...payload, target_device_name: target, request_id: requestId },
+        }).catch(() => {
+            this.pending.delete(requestId);
+            if (this.step) this.step.errors++;
+        });
+    }
+
+    _onReply(event, payload) {
+        const sentAt = this.pending.get(payload?.request_id);
+        if (sentAt === undefined || !this.step) return;
+        this.pending.delete(payload.request_id);
+        this.step.latency.add(performance.now() - sentAt);
+        if (event.endsWith('_ACK')) this.step.acked++;
+        else if (event.endsWith('_ERROR')) this.step.errors++;
+    }
+
+    _expire(now) {
+        for (const [requestId, sentAt] of this.pending) {
+            if (now - sentAt > this.step.options.timeoutMs) {
+                this.pending.delete(requestId);
+                this.step.timeouts++;
+            }
+        }
+    }
+
+    async disconnect() {
+        this.abort();
+        if (this.client) {
+            await this.client.removeAllChannels();
+        }
+    }
+}
+
+function summarizeStep(step) {
+    const latency = step.latency.summary();
+    const completed = latency.count;
+    return {
+        offeredRate: step.options.rate,
+        concurrency: step.options.concurrency,
+        sent: step.sent,
+        acked: step.acked,
+        errors: step.errors,
+        timeouts: step.timeouts,
+        skipped: step.skipped,
+        throughput: completed / (Math.min(step.options.durationMs, performance.now() - step.startedAt) / 1000),
+        timeoutRate: step.sent ? step.timeouts / step.sent : 0,
+        p50: latency.p50,
+        p99: latency.p99,
+        p999: latency.p999,
+        max: latency.max,
+    };
+}
+
+function stepHolds(result) {
+    return result.timeoutRate < MAX_TIMEOUT_RATE && result.throughput >= MIN_ACHIEVED_RATIO * result.offeredRate;
+}
+
+let generator = null;
+let lastReport = null;
+
+async function start() {
+    if (!SUPABASE_URL || !SUPABASE_ANON_KEY) {
+        log('Set SUPABASE_URL and SUPABASE_ANON_KEY in tools/load-generator/script.js first.');
+        return;
+    }
+    let payload;
+    try {
+        payload = JSON.parse(document.getElementById('payload').value || '{}');
+    } catch (error) {
+        log(`Invalid payload JSON: ${error.message}`);
+        return;
+    }
+    const devices = document.getElementById('devices').value.split(',').map(d => d.trim()).filter(Boolean);
+    const command = document.getElementById('command').value;
+    const steps = Number(document.getElementById('steps').value);
+    const rampFactor = Number(document.getElementById('ramp-factor').value);
+    let rate = Number(document.getElementById('rate').value);
+    const options = {
+        devices,
+        command,
+        payload,
+        concurrency: Number(document.getElementById('concurrency').value),
+        durationMs: Number(document.getElementById('duration').value) * 1000,
+        timeoutMs: Number(document.getElementById('timeout').value),
+    };
+
+    startBtn.disabled = true;
+    stopBtn.disabled = false;
+    generator = new CommandLoadGenerator();
+    const report = { command, devices, startedAt: new Date().toISOString(), steps: [], ceiling: null };
+
+    try {
+        await generator.connect(devices);
+        for (let i = 0; i < steps && generator; i++) {
+            log(`Step ${i + 1}/${steps}: ${rate.toFixed(1)} cmd/s, concurrency ${options.concurrency}`);
+            const result = await generator.runStep({ ...options, rate });
+            report.steps.push(result);
+            if (stepHolds(result)) {
+                report.ceiling = result.throughput;
+            } else if (steps > 1) {
+                log(`Throughput ceiling reached at ${rate.toFixed(1)} cmd/s offered.`);
+                break;
+            }
+            renderReport(report);
+            rate *= rampFactor;
+        }
+    } catch (error) {
+        log(`Run failed: ${error.message}`);
+    }
+
+    lastReport = report;
+    renderReport(report);
+    baselineBtn.disabled = exportBtn.disabled = report.steps.length === 0;
+    await stop();
+}
+
+async function stop() {
+    if (generator) {
+        const g = generator;
+        generator = null;
+        await g.disconnect();
+    }
+    startBtn.disabled = false;
+    stopBtn.disabled = true;
+}
+
+/**
+ * Renders one row per step, and flags steps whose p99 is more than 20%
+ * above the saved baseline at the same offered rate.
+ */
+function renderReport(report) {
+    const baseline = JSON.parse(localStorage.getItem(BASELINE_STORAGE_KEY) || 'null');
+    const header = ['Offered/s', 'Achieved/s', 'Sent', 'Acked', 'Errors', 'Timeouts', 'p50', 'p99', 'p99.9', 'Max'];
+    const rows = report.steps.map((r) => {
+        const base = baseline?.steps.find(b => Math.abs(b.offeredRate - r.offeredRate) < 1e-6);
+        const regression = base && r.p99 !== null && base.p99 !== null && r.p99 > base.p99 * 1.2;
+        return `<tr>
+            <td>${r.offeredRate.toFixed(1)}</td><td>${r.throughput.toFixed(1)}</td>
+            <td>${r.sent}</td><td>${r.acked}</td><td>${r.errors}</td>
+            <td>${r.timeouts} (${(r.timeoutRate * 100).toFixed(1)}%)</td>
+            <td>${formatMs(r.p50)}</td>
+            <td class="${regression ? 'regression' : ''}" title="${base ? `baseline ${formatMs(base.p99)}` : ''}">${formatMs(r.p99)}</td>
+            <td>${formatMs(r.p999)}</td><td>${formatMs(r.max)}</td>
+        </tr>`;
+    });
+    const ceiling = report.ceiling === null ? '–' : `${report.ceiling.toFixed(1)} cmd/s`;
+    resultsTable.innerHTML = `<tr>${header.map(h => `<th>${h}</th>`).join('')}</tr>${rows.join('')}
+        <tr><td colspan="${header.length}">Throughput ceiling: ${ceiling}${baseline ? ` (baseline ${baseline.ceiling?.toFixed(1) ?? '–'} cmd/s)` : ''}</td></tr>`;
+}
+
+function saveBaseline() {
+    localStorage.setItem(BASELINE_STORAGE_KEY, JSON.stringify(lastReport));
+    log('Baseline saved. Later runs flag p99 regressions against it.');
+}
+
+function exportReport() {
+    const blob = new Blob([JSON.stringify(lastReport, null, 2)], { type: 'application/json' });
+    const link = document.createElement('a');
+    link.href = URL.createObjectURL(blob);
+    link.download = `dewab-load-${lastReport.startedAt.replace(/[:.]/g, '-')}.json`;
+    link.click();
+    URL.revokeObjectURL(link.href);
+}
+
+function log(message) {
+    const line = document.createElement('div');
+    line.textContent = `${new Date().toLocaleTimeString()} ${message}`;
+    logBox.prepend(line);
+}
+
+startBtn.addEventListener('click', start);
+stopBtn.addEventListener('click', stop);
+baselineBtn.addEventListener('click', saveBaseline);
+exportBtn.addEventListener('click', exportReport);
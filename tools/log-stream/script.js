@@ -0,0 +1,98 @@
+import { DeviceDiagnostics, downloadFile } from '../common/device-diagnostics.js';
+
+// TODO: Replace with your Supabase credentials (or a local Realtime stand-in)
+const SUPABASE_URL = '';
+const SUPABASE_ANON_KEY = '';
+
+const MAX_SHOWN = 2000; // Older lines are removed from the page, not from the saved log
+
+const connectBtn = document.getElementById('connect-btn');
+const raiseBtn = document.getElementById('raise-btn');
+const sampleBtn = document.getElementById('sample-btn');
+const saveBtn = document.getElementById('save-btn');
+const statusEl = document.getElementById('status');
+const recordsBox = document.getElementById('records');
+
+let diagnostics = null;
+const received = []; // Every record, for saving
+const lastDropped = new Map(); // Device → dropped count of its previous batch
+
+async function connect() {
+    if (!SUPABASE_URL || !SUPABASE_ANON_KEY) {
+        statusEl.textContent = 'Set SUPABASE_URL and SUPABASE_ANON_KEY in tools/log-stream/script.js first.';
+        return;
+    }
+    connectBtn.disabled = true;
+    try {
+        diagnostics = new DeviceDiagnostics(SUPABASE_URL, SUPABASE_ANON_KEY);
+        diagnostics.on('DEVICE_LOG', onBatch);
+        await diagnostics.connect();
+        statusEl.textContent = 'Listening for DEVICE_LOG batches.';
+        raiseBtn.disabled = false;
+        sampleBtn.disabled = false;
+    } catch (error) {
+        statusEl.textContent = `Connection failed: ${error.message}`;
+        connectBtn.disabled = false;
+    }
+}
+
+/**
+ * One batch per flush interval per device. Device times are millis() since
+ * boot, so lines show both the arrival time and the device uptime.
+ */
+function onBatch(batch) {
+    const device = document.getElementById('device').value.trim();
+    if (device && batch.device_name !== device) return;
+
+    const tagFilter = document.getElementById('tag-filter').value.trim();
+    const arrived = new Date().toLocaleTimeString();
+    const dropped = batch.dropped - (lastDropped.get(batch.device_name) ?? batch.dropped);
+    lastDropped.set(batch.device_name, batch.dropped);
+    if (dropped > 0) {
+        show('warn', `${arrived} ${batch.device_name} … ${dropped} records dropped on device (buffer full)`);
+    }
+
+    for (const record of batch.records) {
+        received.push({ device: batch.device_name, ...record });
+        if (tagFilter && record.tag !== tagFilter) continue;
+        show(record.level, `${arrived} ${batch.device_name} +${(record.t / 1000).toFixed(3)}s ${record.level.toUpperCase()} [${record.tag}] ${record.msg}`);
+    }
+    saveBtn.disabled = received.length === 0;
+}
+
+function show(level, text) {
+    const line = document.createElement('div');
+    line.className = level;
+    line.textContent = text;
+    recordsBox.append(line);
+    while (recordsBox.childElementCount > MAX_SHOWN) recordsBox.firstElementChild.remove();
+    recordsBox.scrollTop = recordsBox.scrollHeight;
+}
+
+async function sendLogLevel(payload) {
+    const device = document.getElementById('device').value.trim();
+    if (!device) {
+        statusEl.textContent = 'LOG_LEVEL needs a device name.';
+        return;
+    }
+    try {
+        const { reply } = await diagnostics.request(device, 'LOG_LEVEL', payload, { timeoutMs: 10000 });
+        statusEl.textContent = `${device}: streaming ${reply.level}` +
+            (reply.raised_for_ms ? ` for ${Math.round(reply.raised_for_ms / 1000)} s more` : '') +
+            `, ${reply.sent} sent in ${reply.batches} batches, ${reply.sampled_out} sampled out, ${reply.dropped} dropped.`;
+    } catch (error) {
+        statusEl.textContent = error.message;
+    }
+}
+
+connectBtn.addEventListener('click', connect);
+raiseBtn.addEventListener('click', () => sendLogLevel({
+    level: document.getElementById('level').value,
+    duration_ms: Number(document.getElementById('duration').value) * 1000,
+}));
+sampleBtn.addEventListener('click', () => sendLogLevel({
+    tag: document.getElementById('sample-tag').value.trim(),
+    sample: Number(document.getElementById('sample-rate').value),
+}));
+saveBtn.addEventListener('click', () => downloadFile(received.map(r => JSON.stringify(r)).join('\n') + '\n',
+    `dewab-log-${Date.now()}.jsonl`, 'application/x-ndjson'));
@@ -0,0 +1,116 @@
+import { DeviceDiagnostics, downloadFile } from '../common/device-diagnostics.js';
+
+// TODO: Replace with your Supabase credentials (or a local Realtime stand-in)
+const SUPABASE_URL = '';
+const SUPABASE_ANON_KEY = '';
+
+const runBtn = document.getElementById('run-btn');
+const exportBtn = document.getElementById('export-btn');
+const verdictEl = document.getElementById('verdict');
+const resultsTable = document.getElementById('results');
+const logBox = document.getElementById('log');
+
+let diagnostics = null;
+let lastStats = null;
+
+async function getDiagnostics() {
+    if (!SUPABASE_URL || !SUPABASE_ANON_KEY) {
+        throw new Error('Set SUPABASE_URL and SUPABASE_ANON_KEY in tools/perf-budget/script.js first.');
+    }
+    if (!diagnostics) {
+        diagnostics = new DeviceDiagnostics(SUPABASE_URL, SUPABASE_ANON_KEY);
+        await diagnostics.connect();
+    }
+    return diagnostics;
+}
+
+/**
+ * Runs a fixed workload and compares the device's PERF_STATS against
+ * budgets.json. The workload is set_outputs commands spread over the
+ * duration: each one is a full RX → handler → ACK cycle and, in the demo
+ * sketch, a state broadcast. 30 s covers at least one heartbeat.
+ */
+async function runCheck() {
+    const device = document.getElementById('device').value.trim();
+    const commands = Number(document.getElementById('commands').value);
+    const durationMs = Number(document.getElementById('duration').value) * 1000;
+
+    runBtn.disabled = true;
+    verdictEl.textContent = 'Running...';
+    verdictEl.className = '';
+    try {
+        const budgets = await (await fetch('budgets.json')).json();
+        const diag = await getDiagnostics();
+
+        await diag.request(device, 'PERF_STATS', { reset: true });
+        log(`Sending ${commands} commands to ${device} over ${durationMs / 1000} s...`);
+        const started = performance.now();
+        for (let i = 0; i < commands; i++) {
+            await diag.request(device, 'set_outputs', { led_red: i % 2 === 0, led_yellow: i % 2 === 1 }, { timeoutMs: 5000 });
+            const wait = started + (durationMs * (i + 1)) / commands - performance.now();
+            if (wait > 0) await new Promise(r => setTimeout(r, wait));
+        }
+
+        const { reply } = await diag.request(device, 'PERF_STATS', {});
+        lastStats = reply;
+        exportBtn.disabled = false;
+        const violations = render(reply, budgets);
+        verdictEl.textContent = violations.length ? `FAIL: ${violations.join(', ')}` : 'PASS';
+        verdictEl.className = violations.length ? 'fail' : 'pass';
+    } catch (error) {
+        verdictEl.textContent = `Error: ${error.message}`;
+        verdictEl.className = 'fail';
+    } finally {
+        runBtn.disabled = false;
+    }
+}
+
+/**
+ * One row per budgeted metric. A budget {"max_micros": 30000} under
+ * sites.rx means the reported sites.rx.max_micros must not exceed 30000.
+ * @returns {string[]} The metrics over budget
+ */
+function render(stats, budgets) {
+    const violations = [];
+    const rows = [];
+    for (const group of ['sites', 'frames']) {
+        for (const [name, limits] of Object.entries(budgets[group] || {})) {
+            const measured = stats[group]?.[name] || {};
+            for (const [metric, limit] of Object.entries(limits)) {
+                const value = measured[metric];
+                const over = value !== undefined && value > limit;
+                if (over) violations.push(`${group}.${name}.${metric}`);
+                rows.push(`<tr><td>${group}.${name}</td><td>${metric}</td>
+                    <td class="${over ? 'over-budget' : ''}">${value ?? '–'}</td><td>${limit}</td>
+                    <td>${measured.calls ?? measured.count ?? 0}</td></tr>`);
+            }
+        }
+    }
+    resultsTable.innerHTML = `<tr><th>Operation</th><th>Metric</th><th>Measured</th><th>Budget</th><th>Samples</th></tr>${rows.join('')}`;
+    return violations;
+}
+
+/**
+ * Writes the last measurement, times the headroom factor, as a budgets.json
+ * to commit after an intended change
+ */
+function exportBudgets() {
+    const headroom = Number(document.getElementById('headroom').value);
+    const scale = (metrics, keys) => Object.fromEntries(keys.map(k => [k, Math.ceil(Math.max(metrics[k], 1) * headroom)]));
+    const budgets = {
+        sites: Object.fromEntries(Object.entries(lastStats.sites).filter(([, m]) => m.calls > 0)
+            .map(([name, m]) => [name, scale(m, ['max_micros', 'mean_micros', 'max_net_bytes'])])),
+        frames: Object.fromEntries(Object.entries(lastStats.frames).filter(([, m]) => m.count > 0)
+            .map(([name, m]) => [name, scale(m, ['max_bytes'])])),
+    };
+    downloadFile(JSON.stringify(budgets, null, 4) + '\n', 'budgets.json', 'application/json');
+}
+
+function log(message) {
+    const line = document.createElement('div');
+    line.textContent = `${new Date().toLocaleTimeString()} ${message}`;
+    logBox.prepend(line);
+}
+
+runBtn.addEventListener('click', runCheck);
+exportBtn.addEventListener('click', exportBudgets);
@@ -0,0 +1,86 @@
+import { DeviceDiagnostics, downloadFile } from '../common/device-diagnostics.js';
+
+// TODO: Replace with your Supabase credentials (or a local Realtime stand-in)
+const SUPABASE_URL = '';
+const SUPABASE_ANON_KEY = '';
+
+const SHOWN_PCS = 20;
+
+const startBtn = document.getElementById('start-btn');
+const fetchBtn = document.getElementById('fetch-btn');
+const saveBtn = document.getElementById('save-btn');
+const resultsTable = document.getElementById('results');
+const logBox = document.getElementById('log');
+
+let diagnostics = null;
+let profile = null;
+
+async function getDiagnostics() {
+    if (!SUPABASE_URL || !SUPABASE_ANON_KEY) {
+        throw new Error('Set SUPABASE_URL and SUPABASE_ANON_KEY in tools/profiler/script.js first.');
+    }
+    if (!diagnostics) {
+        diagnostics = new DeviceDiagnostics(SUPABASE_URL, SUPABASE_ANON_KEY);
+        await diagnostics.connect();
+    }
+    return diagnostics;
+}
+
+async function startSampling() {
+    const device = document.getElementById('device').value.trim();
+    const windowMs = Number(document.getElementById('window').value) * 1000;
+    startBtn.disabled = true;
+    try {
+        const diag = await getDiagnostics();
+        const { reply } = await diag.request(device, 'PROFILE_START', { window_ms: windowMs, hz: Number(document.getElementById('hz').value) });
+        log(`${device} is sampling at ${reply.hz} Hz for ${reply.window_ms / 1000} s. Download the profile afterwards.`);
+    } catch (error) {
+        log(error.message);
+    } finally {
+        startBtn.disabled = false;
+    }
+}
+
+async function fetchProfile() {
+    const device = document.getElementById('device').value.trim();
+    fetchBtn.disabled = true;
+    try {
+        const diag = await getDiagnostics();
+        const { reply, data } = await diag.request(device, 'PROFILE_DUMP', {},
+            { chunkEvent: 'PROFILE_DUMP_CHUNK', timeoutMs: 60000 });
+        log(`Received ${reply.samples} samples over ${reply.pcs} PCs (${reply.lost} lost).`);
+        profile = data;
+        saveBtn.disabled = false;
+        render(data);
+    } catch (error) {
+        log(error.message);
+    } finally {
+        fetchBtn.disabled = false;
+    }
+}
+
+/**
+ * Raw PCs only; symbolize the saved profile with symbolize.mjs for
+ * function and line names.
+ */
+function render(bytes) {
+    const view = new DataView(bytes.buffer, bytes.byteOffset, bytes.byteLength);
+    const samples = view.getUint32(8, true);
+    const entries = [];
+    for (let offset = 16; offset + 8 <= bytes.length; offset += 8) {
+        entries.push([view.getUint32(offset, true), view.getUint32(offset + 4, true)]);
+    }
+    entries.sort((a, b) => b[1] - a[1]);
+    resultsTable.innerHTML = '<tr><th>PC</th><th>Samples</th><th>Share</th></tr>' + entries.slice(0, SHOWN_PCS).map(([pc, count]) =>
+        `<tr><td>0x${pc.toString(16).padStart(8, '0')}</td><td>${count}</td><td>${(100 * count / samples).toFixed(1)}%</td></tr>`).join('');
+}
+
+function log(message) {
+    const line = document.createElement('div');
+    line.textContent = `${new Date().toLocaleTimeString()} ${message}`;
+    logBox.prepend(line);
+}
+
+startBtn.addEventListener('click', startSampling);
+fetchBtn.addEventListener('click', fetchProfile);
+saveBtn.addEventListener('click', () => downloadFile(profile, `dewab-profile-${Date.now()}.bin`));
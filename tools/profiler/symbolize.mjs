@@ -0,0 +1,108 @@
+#!/usr/bin/env node
+/**
+ * Symbolizes a PROFILE_DUMP profile against the sketch's ELF file.
+ *
+ * The profile is a histogram of program counters sampled on the loop()
+ * core (see PcSampler in Dewab.h). Each PC is resolved with the
+ * toolchain's addr2line, and samples are summed per function and per
+ * source line. PCs in ROM or in code without debug info show as "??".
+ *
+ * Usage: node tools/profiler/symbolize.mjs --profile dewab-profile.bin
+ *        --elf build/dewab_demo.ino.elf [--addr2line xtensa-esp32s3-elf-addr2line]
+ *        [--top 25] [--out report.md]
+ * The ELF is in the build folder; `arduino-cli compile --build-path build`
+ * or the IDE's "Export Compiled Binary" puts it there.
+ */
+import { execFileSync } from 'node:child_process';
+import { readFileSync, writeFileSync } from 'node:fs';
+import { fileURLToPath } from 'node:url';
+
+const MAGIC = 'DWP1';
+const ADDR2LINE_BATCH = 500; // Addresses per addr2line call, to stay under argv limits
+
+/**
+ * @param {Buffer} bytes - PROFILE_DUMP capture
+ * @returns {{hz: number, samples: number, lost: number, entries: Array<[number, number]>}}
+ */
+export function parseProfile(bytes) {
+    if (bytes.length < 16 || bytes.toString('latin1', 0, 4) !== MAGIC) {
+        throw new Error('Not a Dewab profile (missing DWP1 header).');
+    }
+    const entries = [];
+    for (let offset = 16; offset + 8 <= bytes.length; offset += 8) {
+        entries.push([bytes.readUInt32LE(offset), bytes.readUInt32LE(offset + 4)]);
+    }
+    return { hz: bytes.readUInt32LE(4), samples: bytes.readUInt32LE(8), lost: bytes.readUInt32LE(12), entries };
+}
+
+/**
+ * Resolves PCs to function and file:line with addr2line -a -f -C, which
+ * prints three lines per address
+ * @returns {Map<number, {func: string, line: string}>}
+ */
+function symbolize(pcs, elf, addr2line) {
+    const symbols = new Map();
+    for (let i = 0; i < pcs.length; i += ADDR2LINE_BATCH) {
+        const batch = pcs.slice(i, i + ADDR2LINE_BATCH).map(pc => `0x${pc.toString(16)}`);
+        const output = execFileSync(addr2line, ['-a', '-f', '-C', '-e', elf, ...batch]).toString().trim().split('\n');
+        for (let j = 0; j + 2 < output.length; j += 3) {
+            const line = output[j + 2].replace(/ \(discriminator \d+\)$/, '');
+            symbols.set(parseInt(output[j], 16), { func: output[j + 1], line: line.replace(/^.*[\\/](libraries|cores|sketch)[\\/]/, '$1/') });
+        }
+    }
+    return symbols;
+}
+
+function table(title, totals, samples, top) {
+    const rows = [...totals.entries()].sort((a, b) => b[1] - a[1]).slice(0, top);
+    return [`## ${title}`, '', '| Samples | Share | Location |', '| ---: | ---: | --- |',
+        ...rows.map(([name, count]) => `| ${count} | ${(100 * count / samples).toFixed(1)}% | \`${name}\` |`), ''];
+}
+
+function parseArgs(argv) {
+    const args = { profile: null, elf: null, addr2line: 'xtensa-esp32s3-elf-addr2line', top: '25', out: null };
+    for (let i = 0; i < argv.length; i += 2) {
+        const key = argv[i].replace(/^--/, '');
+        if (!(key in args)) throw new Error(`Unknown option ${argv[i]}`);
+        args[key] = argv[i + 1];
+    }
+    if (!args.profile || !args.elf) throw new Error('--profile and --elf are required');
+    return args;
+}
+
+function main() {
+    const args = parseArgs(process.argv.slice(2));
+    const profile = parseProfile(readFileSync(args.profile));
+    const symbols = symbolize(profile.entries.map(([pc]) => pc), args.elf, args.addr2line);
+
+    const byFunction = new Map();
+    const byLine = new Map();
+    for (const [pc, count] of profile.entries) {
+        const symbol = symbols.get(pc) ?? { func: '??', line: '??' };
+        const func = symbol.func === '??' ? `?? (0x${pc.toString(16)})` : symbol.func;
+        byFunction.set(func, (byFunction.get(func) ?? 0) + count);
+        byLine.set(symbol.line, (byLine.get(symbol.line) ?? 0) + count);
+    }
+
+    const seconds = profile.samples / profile.hz;
+    const markdown = [
+        '# Dewab CPU profile',
+        '',
+        `${profile.samples} samples at ${profile.hz} Hz (${seconds.toFixed(1)} s), ${profile.entries.length} distinct PCs, ` +
+            `${profile.lost} samples lost to a full table.`,
+        '',
+        ...table('By function', byFunction, profile.samples, Number(args.top)),
+        ...table('By source line', byLine, profile.samples, Number(args.top)),
+    ].join('\n');
+    process.stdout.write(markdown);
+    if (args.out) writeFileSync(args.out, markdown);
+}
+
+if (process.argv[1] === fileURLToPath(import.meta.url)) {
+    try {
+        main();
+    } catch (error) {
+        process.stderr.write(`${error.message}\n`);
+        process.exit(1);
+    }
+}
@@ -0,0 +1,190 @@
+#!/usr/bin/env node
+/**
+ * Dewab's RX and TX path benchmarks on an emulated ESP32, without hardware.
+ *
+ * Compiles the benchmark firmware in qemu_bench/ with arduino-cli, boots
+ * the flash image in Espressif's QEMU fork (qemu-system-xtensa) and reads
+ * the QEMU_BENCH line that Dewab::benchmark() prints. QEMU runs with
+ * -icount, so its clock advances with executed instructions. CCOUNT
+ * readings are then deterministic, and the instruction count of each kernel
+ * can be derived from them. They compare firmware builds, not boards: the
+ * emulator has no cache or flash wait states.
+ *
+ * Every run appends to a CSV history, labelled with `git describe`.
+ *
+ * Usage: node tools/qemu-bench/qemu-bench.mjs [--target esp32s3]
+ *        [--iterations 200] [--qemu qemu-system-xtensa] [--out report.md]
+ *        [--history tools/qemu-bench/history.csv] [--label v1.2]
+ */
+import { execFileSync, spawn } from 'node:child_process';
+import { appendFileSync, copyFileSync, existsSync, mkdirSync, mkdtempSync, readFileSync, writeFileSync } from 'node:fs';
+import { tmpdir } from 'node:os';
+import { dirname, join } from 'node:path';
+import { fileURLToPath } from 'node:url';
+
+const TOOL_DIR = dirname(fileURLToPath(import.meta.url));
+const REPO_DIR = join(TOOL_DIR, '..', '..');
+const SKETCH = 'qemu_bench';
+const LIBRARY_FILES = ['Dewab.h', 'Dewab.cpp'];
+const FLASH_BYTES = 4 * 1024 * 1024; // QEMU only accepts 2, 4, 8 or 16 MB flash images
+const ICOUNT_SHIFT = 0;              // One instruction per 2^shift ns of emulated time
+const BOOT_TIMEOUT_MS = 120000;
+
+// Board package, QEMU machine and second-stage bootloader offset per chip
+const TARGETS = {
+    esp32s3: { fqbn: 'esp32:esp32:esp32s3', machine: 'esp32s3', bootloader: '0x0' },
+    esp32: { fqbn: 'esp32:esp32:esp32', machine: 'esp32', bootloader: '0x1000' },
+};
+
+// Which side of the library each BENCH kernel stands for
+const PATHS = {
+    inbound_parse: 'RX',
+    dispatch_lookup: 'RX',
+    state_build: 'TX',
+    envelope_serialize: 'TX',
+};
+
+function parseArgs(argv) {
+    const args = {
+        target: 'esp32s3',
+        iterations: '200',
+        qemu: 'qemu-system-xtensa',
+        out: null,
+        history: join(TOOL_DIR, 'history.csv'),
+        label: null,
+    };
+    for (let i = 0; i < argv.length; i += 2) {
+        const key = argv[i].replace(/^--/, '');
+        if (!(key in args)) throw new Error(`Unknown option ${argv[i]}`);
+        args[key] = argv[i + 1];
+    }
+    if (!TARGETS[args.target]) throw new Error(`--target must be one of ${Object.keys(TARGETS).join(', ')}`);
+    args.label ??= gitLabel();
+    return args;
+}
+
+function gitLabel() {
+    try {
+        return execFileSync('git', ['describe', '--always', '--dirty'], { cwd: REPO_DIR }).toString().trim();
+    } catch {
+        return 'unknown';
+    }
+}
+
+/**
+ * Copies the firmware and the library sources into a temporary sketch
+ * folder, as the Arduino IDE expects
+ */
+function prepareSketch(iterations) {
+    const dir = join(mkdtempSync(join(tmpdir(), 'dewab-qemu-')), SKETCH);
+    mkdirSync(dir);
+    copyFileSync(join(TOOL_DIR, SKETCH, `${SKETCH}.ino`), join(dir, `${SKETCH}.ino`));
+    LIBRARY_FILES.forEach(f => copyFileSync(join(REPO_DIR, 'dewab_cpp', f), join(dir, f)));
+    writeFileSync(join(dir, 'qemu_bench_config.h'), `#pragma once\n#define QEMU_BENCH_ITERATIONS ${Number(iterations)}\n`);
+    return dir;
+}
+
+/**
+ * Builds the firmware and returns a full-size flash image. Arduino-ESP32 3.x
+ * already writes a merged image; older cores are merged with esptool.
+ */
+function buildImage(dir, target) {
+    const buildPath = join(dir, 'build');
+    process.stderr.write(`Compiling ${SKETCH} for ${target.fqbn}...\n`);
+    execFileSync('arduino-cli', ['compile', '--fqbn', target.fqbn, '--build-path', buildPath, dir], { stdio: ['ignore', 'ignore', 'inherit'] });
+
+    const merged = join(buildPath, `${SKETCH}.ino.merged.bin`);
+    if (!existsSync(merged)) {
+        const part = suffix => join(buildPath, `${SKETCH}.ino.${suffix}`);
+        execFileSync('esptool.py', ['--chip', target.machine, 'merge_bin', '-o', merged,
+            target.bootloader, part('bootloader.bin'), '0x8000', part('partitions.bin'), '0x10000', part('bin')],
+            { stdio: ['ignore', 'ignore', 'inherit'] });
+    }
+    const image = Buffer.alloc(FLASH_BYTES, 0xff);
+    readFileSync(merged).copy(image);
+    const imagePath = join(dir, 'flash.bin');
+    writeFileSync(imagePath, image);
+    return imagePath;
+}
+
+/**
+ * Boots the image and waits for the QEMU_BENCH {...} line
+ */
+function runEmulator(qemu, machine, imagePath) {
+    process.stderr.write(`Booting in ${qemu} -machine ${machine}...\n`);
+    const emulator = spawn(qemu, ['-nographic', '-machine', machine,
+        '-icount', `shift=${ICOUNT_SHIFT},align=off,sleep=off`,
+        '-drive', `file=${imagePath},if=mtd,format=raw`]);
+    return new Promise((resolve, reject) => {
+        let buffered = '';
+        const fail = (message) => {
+            clearTimeout(timer);
+            emulator.kill();
+            reject(new Error(`${message}\n--- last output ---\n${buffered.slice(-2000)}`));
+        };
+        const timer = setTimeout(() => fail(`No QEMU_BENCH line within ${BOOT_TIMEOUT_MS / 1000} s`), BOOT_TIMEOUT_MS);
+        emulator.on('error', error => fail(`Could not start ${qemu}: ${error.message}`));
+        emulator.stdout.on('data', (chunk) => {
+            buffered += chunk;
+            const match = /QEMU_BENCH (\{.*\})/.exec(buffered);
+            if (match) {
+                clearTimeout(timer);
+                emulator.kill();
+                resolve(JSON.parse(match[1]));
+            } else if (/Guru Meditation|abort\(\) was called/.test(buffered)) {
+                fail('The firmware crashed');
+            }
+        });
+    });
+}
+
+// CCOUNT advances cpu_mhz per emulated µs, and each instruction takes 2^shift ns
+function instructions(cycles, cpuMhz) {
+    return Math.round(cycles * 1000 / (cpuMhz * (1 << ICOUNT_SHIFT)));
+}
+
+function report(result, args) {
+    const lines = [
+        `# Dewab QEMU benchmark (${args.label}, ${args.target})`,
+        '',
+        `${result.iterations} iterations per kernel, ${result.sdk}, -icount shift=${ICOUNT_SHIFT}. ` +
+            'Counts are deterministic per build; they do not model cache or flash timing.',
+        '',
+        '| Path | Kernel | Instructions | Mean cycles | Max cycles | Heap held | Net bytes |',
+        '| --- | --- | ---: | ---: | ---: | ---: | ---: |',
+    ];
+    for (const [name, k] of Object.entries(result.kernels)) {
+        lines.push(`| ${PATHS[name] ?? '–'} | ${name} | ${instructions(k.mean_cycles, result.cpu_mhz)} | ${k.mean_cycles} | ` +
+            `${k.max_cycles} | ${k.held_bytes} | ${k.net_bytes} |`);
+    }
+    return lines.join('\n') + '\n';
+}
+
+function appendHistory(file, args, result) {
+    if (!existsSync(file)) {
+        writeFileSync(file, 'label,date,target,kernel,instructions,mean_cycles,held_bytes\n');
+    }
+    const date = new Date().toISOString().slice(0, 10);
+    const rows = Object.entries(result.kernels).map(([name, k]) => [args.label, date, args.target, name,
+        instructions(k.mean_cycles, result.cpu_mhz), k.mean_cycles, k.held_bytes].join(','));
+    appendFileSync(file, rows.join('\n') + '\n');
+}
+
+async function main() {
+    const args = parseArgs(process.argv.slice(2));
+    const target = TARGETS[args.target];
+    const imagePath = buildImage(prepareSketch(args.iterations), target);
+    const result = await runEmulator(args.qemu, target.machine, imagePath);
+
+    const markdown = report(result, args);
+    process.stdout.write(markdown);
+    if (args.out) writeFileSync(args.out, markdown);
+    appendHistory(args.history, args, result);
+}
+
+if (process.argv[1] === fileURLToPath(import.meta.url)) {
+    main().catch((error) => {
+        process.stderr.write(`${error.message}\n`);
+        process.exit(1);
+    });
+}
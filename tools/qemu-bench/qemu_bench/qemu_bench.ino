@@ -0,0 +1,31 @@
+// Benchmark firmware for Espressif's QEMU. QEMU has no WiFi, so begin() is
+// never called; the sketch runs Dewab::benchmark() once and prints a
+// QEMU_BENCH line for qemu-bench.mjs.
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include "Dewab.h"
+#include "qemu_bench_config.h" // Written by qemu-bench.mjs
+
+Dewab dewab("qemu-bench", "ssid", "password", "project-ref", "anon-key");
+bool ledOn = false;
+
+void setup() {
+    Serial.begin(115200);
+    DewabLog::setLevel(DEWAB_LOG_WARN);
+    // The demo sketch's command, so the lookup runs against the usual set
+    dewab.registerCommand("set_outputs", [](const JsonObjectConst& payload, JsonDocument& reply) {
+        if (payload["led"].is<bool>()) ledOn = payload["led"].as<bool>();
+        reply["led_state"] = ledOn;
+        return true;
+    });
+
+    JsonDocument report;
+    dewab.benchmark(report, QEMU_BENCH_ITERATIONS);
+    Serial.print("QEMU_BENCH ");
+    serializeJson(report, Serial);
+    Serial.println();
+}
+
+void loop() {
+    delay(1000);
+}
@@ -0,0 +1,328 @@
+import { DeviceDiagnostics, downloadFile } from '../common/device-diagnostics.js';
+
+// TODO: Replace with your Supabase credentials (or a local Realtime stand-in)
+const SUPABASE_URL = '';
+const SUPABASE_ANON_KEY = '';
+
+const PROBE_TIMEOUT_MS = 3000;
+// A replayed input regresses when it gets this much slower than recorded
+const REGRESSION_FACTOR = 1.5;
+
+const startBtn = document.getElementById('start-btn');
+const regressBtn = document.getElementById('regress-btn');
+const stopBtn = document.getElementById('stop-btn');
+const exportBtn = document.getElementById('export-btn');
+const corpusFile = document.getElementById('corpus-file');
+const resultsTable = document.getElementById('results');
+const corpusBox = document.getElementById('corpus');
+const logBox = document.getElementById('log');
+
+const SEEDS = [
+    {},
+    { led_red: true, led_yellow: false },
+    { value: 42, label: 'seed', list: [1, 2, 3] },
+];
+
+/**
+ * Mutators that grow the shapes known to be expensive for ArduinoJson and
+ * the command handler: nesting, many keys, long strings, escapes, long
+ * arrays and long numbers. Each inserts into a random container of the value.
+ */
+const MUTATORS = {
+    deepen: () => {
+        let value = randomInt(100);
+        for (let i = randomInt(4) + 1; i > 0; i--) value = Math.random() < 0.5 ? [value] : { n: value };
+        return value;
+    },
+    widen: () => Object.fromEntries(Array.from({ length: randomInt(64) + 1 }, (_, i) => [`k${i}_${randomInt(1e6)}`, i])),
+    lengthen: () => 'x'.repeat(1 << (randomInt(10) + 1)),
+    escapes: () => '"\\\n\t\u0001é'.repeat(randomInt(128) + 1),
+    longArray: () => Array.from({ length: 1 << (randomInt(8) + 1) }, () => randomInt(1000)),
+    longNumber: () => Number(`1.${'3'.repeat(randomInt(16) + 1)}e-${randomInt(300)}`),
+};
+
+function randomInt(n) {
+    return Math.floor(Math.random() * n);
+}
+
+function containers(value, out = []) {
+    if (value && typeof value === 'object') {
+        out.push(value);
+        Object.values(value).forEach(v => containers(v, out));
+    }
+    return out;
+}
+
+function mutate(payload) {
+    const child = structuredClone(payload);
+    for (let n = randomInt(3) + 1; n > 0; n--) {
+        const names = Object.keys(MUTATORS);
+        const addition = MUTATORS[names[randomInt(names.length)]]();
+        const all = containers(child);
+        const target = all[randomInt(all.length)];
+        if (Array.isArray(target)) target.push(addition);
+        else target[`f${randomInt(1e6)}`] = addition;
+    }
+    return child;
+}
+
+function depth(value) {
+    if (!value || typeof value !== 'object') return 0;
+    return 1 + Math.max(0, ...Object.values(value).map(depth));
+}
+
+/**
+ * Cost-guided search in the spirit of PerfFuzz: inputs are bucketed by
+ * frame size (log2) and nesting depth, and an input joins the corpus when
+ * it is the most expensive one seen in its bucket. The device has no
+ * coverage instrumentation, so cost is the only feedback.
+ */
+class RxFuzzer {
+    constructor(diag, options) {
+        this.diag = diag;
+        this.options = options;
+        this.buckets = new Map();
+        this.executions = 0;
+        this.rejected = 0;
+        this.lost = 0;
+        this.stopped = false;
+        this.startedAt = performance.now();
+        this.deviceStats = null;
+    }
+
+    /**
+     * Sends one input and reads its cost back through RX_STATS, whose
+     * last_* fields describe the frame handled just before it.
+     * @returns {Promise<Object>} {status: 'ok'|'rejected'|'lost', frameBytes, micros, parseBytes}
+     */
+    async measure(payload) {
+        const before = this.deviceStats;
+        let status = 'ok';
+        try {
+            await this.diag.request(this.options.device, this.options.command, payload, { timeoutMs: PROBE_TIMEOUT_MS });
+        } catch (error) {
+            // An _ERROR reply still means the frame was parsed and dispatched
+            if (error.message.includes('timed out')) status = 'lost';
+        }
+        const { reply } = await this.diag.request(this.options.device, 'RX_STATS', {}, { timeoutMs: PROBE_TIMEOUT_MS });
+        this.deviceStats = reply;
+        this.executions++;
+
+        if (before && (reply.oversize > before.oversize || reply.parse_errors > before.parse_errors)) {
+            this.rejected++;
+            return { status: 'rejected' };
+        }
+        if (status === 'lost') {
+            this.lost++;
+            return { status };
+        }
+        return { status, frameBytes: reply.last_bytes, micros: reply.last_micros, parseBytes: reply.last_parse_bytes };
+    }
+
+    score(result) {
+        return this.options.objective === 'heap' ? result.parseBytes : result.micros;
+    }
+
+    async run(onProgress) {
+        this.deviceStats = (await this.diag.request(this.options.device, 'RX_STATS', { reset: true })).reply;
+        for (const seed of SEEDS) {
+            await this.consider(seed);
+        }
+        for (let i = 0; i < this.options.iterations && !this.stopped; i++) {
+            const entries = [...this.buckets.values()];
+            const parent = entries[randomInt(entries.length)] || { payload: {} };
+            const child = mutate(parent.payload);
+            if (JSON.stringify(child).length > this.options.maxBytes) continue;
+            await this.consider(child);
+            onProgress();
+        }
+    }
+
+    async consider(payload) {
+        const result = await this.measure(payload);
+        if (result.status !== 'ok') return;
+        const entry = { payload, depth: depth(payload), ...result };
+        const key = `${Math.floor(Math.log2(entry.frameBytes))}:${Math.min(entry.depth, 16)}`;
+        const best = this.buckets.get(key);
+        if (!best || this.score(entry) > this.score(best)) {
+            this.buckets.set(key, entry);
+        }
+    }
+
+    get corpus() {
+        return [...this.buckets.values()].sort((a, b) => this.score(b) - this.score(a));
+    }
+}
+
+let diagnostics = null;
+let fuzzer = null;
+let corpus = [];
+
+async function getDiagnostics() {
+    if (!SUPABASE_URL || !SUPABASE_ANON_KEY) {
+        throw new Error('Set SUPABASE_URL and SUPABASE_ANON_KEY in tools/rx-fuzzer/script.js first.');
+    }
+    if (!diagnostics) {
+        diagnostics = new DeviceDiagnostics(SUPABASE_URL, SUPABASE_ANON_KEY);
+        await diagnostics.connect();
+    }
+    return diagnostics;
+}
+
+function readOptions() {
+    return {
+        device: document.getElementById('device').value.trim(),
+        command: document.getElementById('command').value.trim(),
+        objective: document.getElementById('objective').value,
+        iterations: Number(document.getElementById('iterations').value),
+        maxBytes: Number(document.getElementById('max-bytes').value),
+        budgetMicros: Number(document.getElementById('budget').value) * 1000,
+    };
+}
+
+async function start() {
+    let diag;
+    try {
+        diag = await getDiagnostics();
+    } catch (error) {
+        log(error.message);
+        return;
+    }
+    fuzzer = new RxFuzzer(diag, readOptions());
+    setRunning(true);
+    log(`Fuzzing ${fuzzer.options.command} on ${fuzzer.options.device} for ${fuzzer.options.iterations} iterations...`);
+    try {
+        await fuzzer.run(() => render(fuzzer.corpus, fuzzer.options.budgetMicros));
+    } catch (error) {
+        log(`Fuzzing stopped: ${error.message}`);
+    }
+    corpus = fuzzer.corpus;
+    render(corpus, fuzzer.options.budgetMicros);
+    log(`Done: ${fuzzer.executions} executions, ${corpus.length} corpus entries. ${suggestLimits(corpus, fuzzer.options.budgetMicros)}`);
+    fuzzer = null;
+    setRunning(false);
+}
+
+/**
+ * Replays a saved corpus and flags inputs that now exceed the latency
+ * budget or got markedly slower than when they were recorded. Inputs the
+ * device now rejects are what input limits are for, and count as passing.
+ */
+async function replayCorpus() {
+    let diag;
+    try {
+        diag = await getDiagnostics();
+    } catch (error) {
+        log(error.message);
+        return;
+    }
+    const options = readOptions();
+    fuzzer = new RxFuzzer(diag, options);
+    setRunning(true);
+    const results = [];
+    let failures = 0;
+    try {
+        fuzzer.deviceStats = (await diag.request(options.device, 'RX_STATS', {})).reply;
+        for (const recorded of corpus) {
+            if (fuzzer.stopped) break;
+            const now = { ...recorded, ...(await fuzzer.measure(recorded.payload)) };
+            now.regressed = now.status === 'ok' &&
+                (now.micros > options.budgetMicros || now.micros > recorded.micros * REGRESSION_FACTOR);
+            if (now.regressed) failures++;
+            results.push(now);
+            render(results, options.budgetMicros);
+        }
+    } catch (error) {
+        log(`Replay stopped: ${error.message}`);
+    }
+    const rejected = results.filter(r => r.status === 'rejected').length;
+    log(`Replay ${failures ? 'FAILED' : 'passed'}: ${results.length} inputs, ${failures} over budget or slower than recorded, ${rejected} rejected by input limits.`);
+    fuzzer = null;
+    setRunning(false);
+}
+
+/**
+ * Largest frame size seen within the budget, below the smallest frame seen
+ * over it. A nesting limit is only suggested when inputs under that size
+ * still blew the budget, i.e. when depth rather than size was the cause.
+ */
+function suggestLimits(entries, budgetMicros) {
+    const over = entries.filter(e => e.micros > budgetMicros);
+    if (over.length === 0) return 'No input exceeded the latency budget.';
+    const minBytesOver = Math.min(...over.map(e => e.frameBytes));
+    const under = entries.filter(e => e.micros <= budgetMicros && e.frameBytes < minBytesOver);
+    const maxBytes = under.length ? Math.max(...under.map(e => e.frameBytes)) : minBytesOver - 1;
+
+    let nesting = 10; // ArduinoJson's default
+    const slowButSmall = over.filter(e => e.frameBytes <= maxBytes);
+    if (slowButSmall.length) {
+        // The command payload sits two levels below the frame root
+        nesting = Math.max(Math.min(...slowButSmall.map(e => e.depth)) + 1, 4);
+    }
+    return `Suggested limits: dewab.setInputLimits(${maxBytes}, ${nesting}).`;
+}
+
+function render(entries, budgetMicros) {
+    const stats = fuzzer?.deviceStats;
+    const elapsedS = fuzzer ? (performance.now() - fuzzer.startedAt) / 1000 : 0;
+    const rows = [
+        ['Executions', fuzzer ? `${fuzzer.executions} (${(fuzzer.executions / elapsedS).toFixed(1)}/s)` : '–'],
+        ['Rejected / lost', fuzzer ? `${fuzzer.rejected} / ${fuzzer.lost}` : '–'],
+        ['Device max RX time', stats ? `${stats.max_micros} µs` : '–'],
+        ['Device max parse heap', stats ? `${stats.max_parse_bytes} bytes` : '–'],
+    ];
+    resultsTable.innerHTML = rows.map(([k, v]) => `<tr><td>${k}</td><td>${v}</td></tr>`).join('');
+
+    const header = '<tr><th>Frame bytes</th><th>Depth</th><th>RX µs</th><th>Parse heap</th><th>Payload</th></tr>';
+    corpusBox.innerHTML = `<table>${header}${entries.map(e => `<tr>
+        <td>${e.frameBytes ?? '–'}</td><td>${e.depth}</td>
+        <td class="${e.micros > budgetMicros || e.regressed ? 'over-budget' : ''}">${e.status === 'rejected' ? 'rejected' : e.micros}</td>
+        <td>${e.parseBytes ?? '–'}</td><td>${escapeHtml(JSON.stringify(e.payload).slice(0, 80))}</td>
+    </tr>`).join('')}</table>`;
+}
+
+function exportCorpus() {
+    const options = readOptions();
+    const data = {
+        device: options.device,
+        command: options.command,
+        objective: options.objective,
+        createdAt: new Date().toISOString(),
+        entries: corpus.map(({ payload, frameBytes, depth, micros, parseBytes }) => ({ payload, frameBytes, depth, micros, parseBytes })),
+    };
+    downloadFile(JSON.stringify(data, null, 2), `dewab-rx-corpus-${Date.now()}.json`, 'application/json');
+}
+
+function setRunning(running) {
+    startBtn.disabled = running;
+    regressBtn.disabled = running || corpus.length === 0;
+    stopBtn.disabled = !running;
+    exportBtn.disabled = running || corpus.length === 0;
+}
+
+function escapeHtml(text) {
+    return text.replace(/[&<>]/g, c => ({ '&': '&amp;', '<': '&lt;', '>': '&gt;' }[c]));
+}
+
+function log(message) {
+    const line = document.createElement('div');
+    line.textContent = `${new Date().toLocaleTimeString()} ${message}`;
+    logBox.prepend(line);
+}
+
+startBtn.addEventListener('click', start);
+regressBtn.addEventListener('click', replayCorpus);
+stopBtn.addEventListener('click', () => { if (fuzzer) fuzzer.stopped = true; });
+exportBtn.addEventListener('click', exportCorpus);
+corpusFile.addEventListener('change', async () => {
+    const file = corpusFile.files[0];
+    if (!file) return;
+    try {
+        corpus = JSON.parse(await file.text()).entries;
+        render(corpus, readOptions().budgetMicros);
+        log(`Loaded ${corpus.length} corpus entries.`);
+    } catch (error) {
+        log(`Invalid corpus file: ${error.message}`);
+    }
+    setRunning(false);
+});
@@ -0,0 +1,246 @@
+import { createClient } from 'https://cdn.jsdelivr.net/npm/@supabase/supabase-js/+esm';
+import { commandChannelName } from '../common/device-diagnostics.js';
+
+// TODO: Replace with your Supabase credentials (or a local Realtime stand-in)
+const SUPABASE_URL = '';
+const SUPABASE_ANON_KEY = '';
+
+// Same as Dewab::setCommandShards() on the device; 0 = the single arduino-commands channel
+const COMMAND_SHARDS = 0;
+const HEAP_STATS_COMMAND = 'HEAP_STATS';
+
+const startBtn = document.getElementById('start-btn');
+const stopBtn = document.getElementById('stop-btn');
+const exportBtn = document.getElementById('export-btn');
+const verdictEl = document.getElementById('verdict');
+const resultsTable = document.getElementById('results');
+const chart = document.getElementById('chart');
+const logBox = document.getElementById('log');
+
+/**
+ * Keeps a device busy with commands (each one also triggers a state
+ * broadcast in the demo sketch) and polls its HeapMonitor through the
+ * built-in HEAP_STATS command.
+ */
+class SoakRun {
+    constructor(options) {
+        this.options = options;
+        this.samples = [];
+        this.commandsSent = 0;
+        this.repliesReceived = 0;
+        this.missedPolls = 0;
+        this.pendingPoll = null;
+        this.timers = [];
+        this.startedAt = Date.now();
+        this.failure = null;
+    }
+
+    async start() {
+        this.client = createClient(SUPABASE_URL, SUPABASE_ANON_KEY);
+        this.channel = this.client.channel(commandChannelName(this.options.device, COMMAND_SHARDS));
+        this.channel.on('broadcast', { event: '*' }, ({ event, payload }) => this._onReply(event, payload));
+        await new Promise((resolve, reject) => {
+            this.channel.subscribe((status) => {
+                if (status === 'SUBSCRIBED') resolve();
+                else if (status === 'CHANNEL_ERROR' || status === 'TIMED_OUT') reject(new Error(status));
+            });
+        });
+
+        let ledOn = false;
+        if (this.options.commandRate > 0) {
+            this.timers.push(setInterval(() => {
+                ledOn = !ledOn;
+                this._send('set_outputs', { led_red: ledOn, led_yellow: !ledOn });
+                this.commandsSent++;
+            }, 1000 / this.options.commandRate));
+        }
+        this._poll();
+        this.timers.push(setInterval(() => this._poll(), this.options.pollIntervalMs));
+    }
+
+    async stop() {
+        this.timers.forEach(clearInterval);
+        this.timers = [];
+        if (this.client) {
+            await this.client.removeAllChannels();
+        }
+    }
+
+    get finished() {
+        return Date.now() - this.startedAt >= this.options.durationMs;
+    }
+
+    _send(command, payload) {
+        this.channel.send({
+            type: 'broadcast',
+            event: command,
+            payload: { ...payload, target_device_name: this.options.device },
+        }).catch(() => {});
+    }
+
+    _poll() {
+        if (this.pendingPoll) {
+            this.missedPolls++; // Device did not answer the previous poll in time
+        }
+        this.pendingPoll = `soak-${Date.now()}`;
+        this._send(HEAP_STATS_COMMAND, { request_id: this.pendingPoll });
+    }
+
+    _onReply(event, payload) {
+        if (payload?.device_name !== this.options.device) return;
+        if (event === `${HEAP_STATS_COMMAND}_ACK` && payload.request_id === this.pendingPoll) {
+            this.pendingPoll = null;
+            this._addSample(payload);
+        } else if (event.startsWith('set_outputs_')) {
+            this.repliesReceived++;
+        }
+    }
+
+    _addSample(stats) {
+        const sample = {
+            elapsedS: (Date.now() - this.startedAt) / 1000,
+            uptimeS: stats.uptime_ms / 1000,
+            freeBytes: stats.free_bytes,
+            largestFreeBlock: stats.largest_free_block,
+            minFreeBytes: stats.min_free_bytes,
+            allocatedBlocks: stats.allocated_blocks,
+            fragmentation: Number(stats.fragmentation),
+            messages: stats.messages,
+            blocksPerMessage: Number(stats.blocks_per_message),
+            budgetExceeded: stats.budget_exceeded,
+            sites: stats.sites,
+        };
+
+        const previous = this.samples[this.samples.length - 1];
+        if (previous && sample.uptimeS < previous.uptimeS) {
+            this.failure = `Device rebooted after ${previous.uptimeS.toFixed(0)} s of uptime`;
+        } else if (sample.budgetExceeded) {
+            this.failure = `Steady-state allocations over budget: ${sample.blocksPerMessage} blocks/message`;
+        } else if (sample.largestFreeBlock < this.options.minLargestBlock) {
+            this.failure = `Largest free block fell to ${sample.largestFreeBlock} bytes`;
+        }
+        this.samples.push(sample);
+    }
+}
+
+let run = null;
+
+async function start() {
+    if (!SUPABASE_URL || !SUPABASE_ANON_KEY) {
+        log('Set SUPABASE_URL and SUPABASE_ANON_KEY in tools/soak-test/script.js first.');
+        return;
+    }
+    run = new SoakRun({
+        device: document.getElementById('device').value.trim(),
+        durationMs: Number(document.getElementById('duration').value) * 3600 * 1000,
+        commandRate: Number(document.getElementById('command-rate').value),
+        pollIntervalMs: Number(document.getElementById('poll-interval').value) * 1000,
+        minLargestBlock: Number(document.getElementById('min-block').value),
+    });
+    startBtn.disabled = true;
+    stopBtn.disabled = false;
+    exportBtn.disabled = false;
+    verdictEl.textContent = 'Running...';
+    verdictEl.className = '';
+
+    try {
+        await run.start();
+    } catch (error) {
+        log(`Could not join ${commandChannelName(run.options.device, COMMAND_SHARDS)}: ${error.message}`);
+        await stop();
+        return;
+    }
+    log(`Soak test started against ${run.options.device}.`);
+
+    run.timers.push(setInterval(() => {
+        render();
+        if (run.failure || run.finished) stop();
+    }, 1000));
+}
+
+async function stop() {
+    if (!run) return;
+    await run.stop();
+    render();
+    const passed = !run.failure && run.samples.length > 0;
+    verdictEl.textContent = passed ? 'PASS' : `FAIL: ${run.failure || 'no heap samples received'}`;
+    verdictEl.className = passed ? 'pass' : 'fail';
+    log('Soak test stopped.');
+    startBtn.disabled = false;
+    stopBtn.disabled = true;
+}
+
+function render() {
+    const last = run.samples[run.samples.length - 1];
+    const first = run.samples[0];
+    const rows = [
+        ['Elapsed', `${((Date.now() - run.startedAt) / 3600000).toFixed(2)} h`],
+        ['Commands sent / replies', `${run.commandsSent} / ${run.repliesReceived}`],
+        ['Heap samples (missed)', `${run.samples.length} (${run.missedPolls})`],
+    ];
+    if (last) {
+        rows.push(
+            ['Free heap (start → now)', `${first.freeBytes} → ${last.freeBytes} bytes`],
+            ['Largest free block', `${last.largestFreeBlock} bytes`],
+            ['Min free heap since boot', `${last.minFreeBytes} bytes`],
+            ['Fragmentation', `${(last.fragmentation * 100).toFixed(1)}%`],
+            ['Live blocks (start → now)', `${first.allocatedBlocks} → ${last.allocatedBlocks}`],
+            ['Retained blocks / message', last.blocksPerMessage.toFixed(4)],
+            ...Object.entries(last.sites || {}).map(([site, s]) =>
+                [`Net bytes @ ${site}`, `${s.net_bytes} over ${s.calls} calls`]),
+        );
+    }
+    resultsTable.innerHTML = rows.map(([k, v]) => `<tr><td>${k}</td><td>${v}</td></tr>`).join('');
+    drawChart(run.samples);
+}
+
+/**
+ * Free heap and largest free block (left scale) and fragmentation
+ * (right scale, 0–100%) over elapsed time.
+ */
+function drawChart(samples) {
+    const ctx = chart.getContext('2d');
+    chart.width = chart.clientWidth;
+    chart.height = chart.clientHeight;
+    ctx.clearRect(0, 0, chart.width, chart.height);
+    if (samples.length < 2) return;
+
+    const maxT = samples[samples.length - 1].elapsedS;
+    const maxBytes = Math.max(...samples.map(s => s.freeBytes));
+    const x = t => (t / maxT) * (chart.width - 10) + 5;
+    const plot = (color, value, scale) => {
+        ctx.strokeStyle = color;
+        ctx.beginPath();
+        samples.forEach((s, i) => {
+            const y = chart.height - 5 - (value(s) / scale) * (chart.height - 10);
+            if (i === 0) ctx.moveTo(x(s.elapsedS), y);
+            else ctx.lineTo(x(s.elapsedS), y);
+        });
+        ctx.stroke();
+    };
+    plot('#007bff', s => s.freeBytes, maxBytes);
+    plot('#4CAF50', s => s.largestFreeBlock, maxBytes);
+    plot('#f44336', s => s.fragmentation, 1);
+}
+
+function exportCsv() {
+    const header = 'elapsed_s,uptime_s,free_bytes,largest_free_block,min_free_bytes,allocated_blocks,fragmentation,messages,blocks_per_message';
+    const lines = run.samples.map(s => [s.elapsedS, s.uptimeS, s.freeBytes, s.largestFreeBlock, s.minFreeBytes,
+        s.allocatedBlocks, s.fragmentation, s.messages, s.blocksPerMessage].join(','));
+    const blob = new Blob([[header, ...lines].join('\n')], { type: 'text/csv' });
+    const link = document.createElement('a');
+    link.href = URL.createObjectURL(blob);
+    link.download = `dewab-soak-${run.options.device}.csv`;
+    link.click();
+    URL.revokeObjectURL(link.href);
+}
+
+function log(message) {
+    const line = document.createElement('div');
+    line.textContent = `${new Date().toLocaleTimeString()} ${message}`;
+    logBox.prepend(line);
+}
+
+startBtn.addEventListener('click', start);
+stopBtn.addEventListener('click', stop);
+exportBtn.addEventListener('click', exportCsv);
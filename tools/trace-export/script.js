@@ -0,0 +1,168 @@
+import { DeviceDiagnostics, downloadFile } from '../common/device-diagnostics.js';
+
+// TODO: Replace with your Supabase credentials (or a local Realtime stand-in)
+const SUPABASE_URL = '';
+const SUPABASE_ANON_KEY = '';
+
+// Same order as DewabTraceSpan in Dewab.h
+const SPAN_NAMES = ['loop', 'ws_loop', 'parse', 'dispatch', 'handler', 'serialize', 'send', 'heartbeat', 'rest', 'state'];
+// Spans whose argument is a byte count
+const BYTE_SPANS = new Set(['parse', 'serialize', 'send']);
+const MAGIC = 'DWT1';
+const HEADER_SIZE = 12;
+const EVENT_SIZE = 8;
+
+const fetchBtn = document.getElementById('fetch-btn');
+const saveBtn = document.getElementById('save-btn');
+const exportBtn = document.getElementById('export-btn');
+const fileInput = document.getElementById('trace-file');
+const resultsTable = document.getElementById('results');
+const logBox = document.getElementById('log');
+
+let diagnostics = null;
+let raw = null;
+let trace = null;
+
+async function getDiagnostics() {
+    if (!SUPABASE_URL || !SUPABASE_ANON_KEY) {
+        throw new Error('Set SUPABASE_URL and SUPABASE_ANON_KEY in tools/trace-export/script.js first.');
+    }
+    if (!diagnostics) {
+        diagnostics = new DeviceDiagnostics(SUPABASE_URL, SUPABASE_ANON_KEY);
+        await diagnostics.connect();
+    }
+    return diagnostics;
+}
+
+async function fetchTrace() {
+    const device = document.getElementById('device').value.trim();
+    fetchBtn.disabled = true;
+    try {
+        const diag = await getDiagnostics();
+        log(`Requesting trace from ${device}...`);
+        const { reply, data } = await diag.request(device, 'TRACE_DUMP',
+            { clear: document.getElementById('clear-after').checked },
+            { chunkEvent: 'TRACE_DUMP_CHUNK', timeoutMs: 60000 });
+        log(`Received ${reply.bytes} bytes, ${reply.events} events (${reply.overwritten} overwritten on device).`);
+        loadTrace(data);
+    } catch (error) {
+        log(error.message);
+    } finally {
+        fetchBtn.disabled = false;
+    }
+}
+
+/**
+ * Decodes a TRACE_DUMP capture. Cycle counts are unwrapped into
+ * microseconds from the first event; the device keeps consecutive events
+ * less than one CCOUNT wrap apart.
+ * @param {Uint8Array} bytes
+ * @returns {{cpuMhz: number, overwritten: number, events: Array}}
+ */
+export function parseTrace(bytes) {
+    if (bytes.length < HEADER_SIZE || String.fromCharCode(...bytes.slice(0, 4)) !== MAGIC) {
+        throw new Error('Not a Dewab trace (missing DWT1 header).');
+    }
+    const view = new DataView(bytes.buffer, bytes.byteOffset, bytes.byteLength);
+    const cpuMhz = view.getUint32(4, true) || 240;
+    const overwritten = view.getUint32(8, true);
+    const events = [];
+    let cycles = 0;
+    let previous = null;
+    for (let offset = HEADER_SIZE; offset + EVENT_SIZE <= bytes.length; offset += EVENT_SIZE) {
+        const count = view.getUint32(offset, true);
+        if (previous !== null) cycles += (count - previous) >>> 0;
+        previous = count;
+        events.push({
+            ts: cycles / cpuMhz,
+            span: SPAN_NAMES[view.getUint8(offset + 4)] ?? `span_${view.getUint8(offset + 4)}`,
+            phase: String.fromCharCode(view.getUint8(offset + 5)),
+            arg: view.getUint16(offset + 6, true),
+        });
+    }
+    return { cpuMhz, overwritten, events };
+}
+
+/**
+ * Chrome trace event format, which chrome://tracing and ui.perfetto.dev both
+ * open. End events whose start was overwritten in the ring are left out.
+ */
+export function toChromeTrace({ events }, deviceName) {
+    const traceEvents = [{ name: 'process_name', ph: 'M', pid: 1, args: { name: deviceName } },
+        { name: 'thread_name', ph: 'M', pid: 1, tid: 1, args: { name: 'loop' } }];
+    const open = [];
+    for (const e of events) {
+        if (e.phase === 'E') {
+            const at = open.lastIndexOf(e.span);
+            if (at < 0) continue;
+            open.length = at;
+        } else {
+            open.push(e.span);
+        }
+        const event = { name: e.span, ph: e.phase, ts: e.ts, pid: 1, tid: 1 };
+        if (BYTE_SPANS.has(e.span) && e.arg) event.args = { bytes: e.arg };
+        traceEvents.push(event);
+    }
+    return { traceEvents, displayTimeUnit: 'ms' };
+}
+
+function summarize({ events }) {
+    const stats = {};
+    const starts = [];
+    for (const e of events) {
+        if (e.phase === 'B') {
+            starts.push(e);
+            continue;
+        }
+        const at = starts.map(s => s.span).lastIndexOf(e.span);
+        if (at < 0) continue;
+        const duration = e.ts - starts[at].ts;
+        starts.length = at;
+        const s = stats[e.span] ??= { count: 0, total: 0, max: 0 };
+        s.count++;
+        s.total += duration;
+        s.max = Math.max(s.max, duration);
+    }
+    return stats;
+}
+
+function loadTrace(bytes) {
+    try {
+        trace = parseTrace(bytes);
+    } catch (error) {
+        log(error.message);
+        return;
+    }
+    raw = bytes;
+    saveBtn.disabled = false;
+    exportBtn.disabled = trace.events.length === 0;
+
+    const stats = summarize(trace);
+    const span = trace.events.length ? trace.events[trace.events.length - 1].ts : 0;
+    resultsTable.innerHTML = `<tr><th>Span</th><th>Count</th><th>Mean (µs)</th><th>Max (µs)</th></tr>` +
+        SPAN_NAMES.filter(name => stats[name]).map((name) => {
+            const s = stats[name];
+            return `<tr><td>${name}</td><td>${s.count}</td><td>${(s.total / s.count).toFixed(1)}</td><td>${s.max.toFixed(1)}</td></tr>`;
+        }).join('');
+    log(`${trace.events.length} events over ${(span / 1000).toFixed(1)} ms at ${trace.cpuMhz} MHz.`);
+}
+
+function exportChromeTrace() {
+    const device = document.getElementById('device').value.trim() || 'dewab';
+    const json = JSON.stringify(toChromeTrace(trace, device));
+    downloadFile(json, `dewab-trace-${Date.now()}.json`, 'application/json');
+}
+
+function log(message) {
+    const line = document.createElement('div');
+    line.textContent = `${new Date().toLocaleTimeString()} ${message}`;
+    logBox.prepend(line);
+}
+
+fetchBtn.addEventListener('click', fetchTrace);
+saveBtn.addEventListener('click', () => downloadFile(raw, `dewab-trace-${Date.now()}.bin`));
+exportBtn.addEventListener('click', exportChromeTrace);
+fileInput.addEventListener('change', async () => {
+    const file = fileInput.files[0];
+    if (file) loadTrace(new Uint8Array(await file.arrayBuffer()));
+});
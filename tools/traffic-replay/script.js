@@ -0,0 +1,163 @@
+import { DeviceDiagnostics, downloadFile } from '../common/device-diagnostics.js';
+import { parseCapture, describeFrame, INBOUND } from '../common/capture.js';
+import { LatencyStats, formatMs } from '../common/latency-stats.js';
+
+// TODO: Replace with your Supabase credentials (or a local Realtime stand-in)
+const SUPABASE_URL = '';
+const SUPABASE_ANON_KEY = '';
+
+const fetchBtn = document.getElementById('fetch-btn');
+const saveBtn = document.getElementById('save-btn');
+const replayBtn = document.getElementById('replay-btn');
+const stopBtn = document.getElementById('stop-btn');
+const fileInput = document.getElementById('capture-file');
+const resultsTable = document.getElementById('results');
+const framesBox = document.getElementById('frames');
+const logBox = document.getElementById('log');
+
+let diagnostics = null;
+let capture = null;   // Raw bytes
+let records = [];
+let replay = null;
+
+async function getDiagnostics() {
+    if (!SUPABASE_URL || !SUPABASE_ANON_KEY) {
+        throw new Error('Set SUPABASE_URL and SUPABASE_ANON_KEY in tools/traffic-replay/script.js first.');
+    }
+    if (!diagnostics) {
+        diagnostics = new DeviceDiagnostics(SUPABASE_URL, SUPABASE_ANON_KEY);
+        await diagnostics.connect();
+    }
+    return diagnostics;
+}
+
+async function fetchCapture() {
+    const device = document.getElementById('source-device').value.trim();
+    fetchBtn.disabled = true;
+    try {
+        const diag = await getDiagnostics();
+        log(`Requesting capture from ${device}...`);
+        const { reply, data } = await diag.request(device, 'RECORDER_DUMP',
+            { clear: document.getElementById('clear-after').checked },
+            { chunkEvent: 'RECORDER_DUMP_CHUNK', timeoutMs: 60000 });
+        log(`Received ${reply.bytes} bytes, ${reply.records} records (${reply.dropped} dropped on device).`);
+        loadCapture(data);
+    } catch (error) {
+        log(error.message);
+    } finally {
+        fetchBtn.disabled = false;
+    }
+}
+
+function loadCapture(bytes) {
+    try {
+        records = parseCapture(bytes);
+    } catch (error) {
+        log(error.message);
+        return;
+    }
+    capture = bytes;
+    saveBtn.disabled = false;
+    replayBtn.disabled = commandRecords().length === 0;
+    renderCapture();
+}
+
+/**
+ * Inbound broadcasts that are commands to a device, i.e. not replies or
+ * state updates. These are what gets replayed.
+ */
+function commandRecords() {
+    return records.filter((r) => {
+        const inner = r.frame?.payload;
+        return r.direction === INBOUND && r.frame?.event === 'broadcast' && inner?.event &&
+            !inner.event.endsWith('_ACK') && !inner.event.endsWith('_ERROR') && inner.event !== 'ARDUINO_STATE_UPDATE';
+    });
+}
+
+function renderCapture() {
+    const start = records.length ? records[0].timeMs : 0;
+    const span = records.length ? records[records.length - 1].timeMs - start : 0;
+    const inbound = records.filter(r => r.direction === INBOUND);
+    const rows = [
+        ['Records (in / out)', `${records.length} (${inbound.length} / ${records.length - inbound.length})`],
+        ['Time span', `${(span / 1000).toFixed(1)} s`],
+        ['Bytes (in / out)', `${sum(inbound)} / ${sum(records) - sum(inbound)}`],
+        ['Truncated frames', records.filter(r => r.truncated).length],
+        ['Replayable commands', commandRecords().length],
+    ];
+    resultsTable.innerHTML = rows.map(([k, v]) => `<tr><td>${k}</td><td>${v}</td></tr>`).join('');
+    framesBox.innerHTML = records.map(r =>
+        `<div class="${r.direction === INBOUND ? 'inbound' : 'outbound'}">+${((r.timeMs - start) / 1000).toFixed(3)}s ${r.direction === INBOUND ? '←' : '→'} ${r.length}B ${escapeHtml(describeFrame(r.frame))}</div>`
+    ).join('');
+}
+
+/**
+ * Re-sends the captured commands to the target device, keeping their
+ * original spacing divided by the speed factor, and times the replies.
+ */
+async function startReplay() {
+    const target = document.getElementById('target-device').value.trim();
+    const speed = Number(document.getElementById('speed').value);
+    const commands = commandRecords();
+    let diag;
+    try {
+        diag = await getDiagnostics();
+    } catch (error) {
+        log(error.message);
+        return;
+    }
+
+    replay = { stopped: false, latency: new LatencyStats(), errors: 0 };
+    replayBtn.disabled = true;
+    stopBtn.disabled = false;
+    log(`Replaying ${commands.length} commands to ${target} at ${speed ? `${speed}×` : 'full speed'}...`);
+
+    const started = performance.now();
+    const origin = commands[0].timeMs;
+    const inFlight = [];
+    for (const record of commands) {
+        if (replay.stopped) break;
+        const due = speed ? (record.timeMs - origin) / speed : 0;
+        const wait = due - (performance.now() - started);
+        if (wait > 0) await new Promise(r => setTimeout(r, wait));
+
+        const { event, payload } = record.frame.payload;
+        const args = { ...payload };
+        delete args.target_device_name;
+        delete args.request_id;
+        const sentAt = performance.now();
+        inFlight.push(diag.request(target, event, args, { timeoutMs: 10000 })
+            .then(() => replay.latency.add(performance.now() - sentAt))
+            .catch(() => replay.errors++));
+    }
+    await Promise.all(inFlight);
+
+    const s = replay.latency.summary();
+    log(`Replay done: ${s.count} replies, ${replay.errors} errors/timeouts, p50 ${formatMs(s.p50)}, p99 ${formatMs(s.p99)}, max ${formatMs(s.max)}.`);
+    replay = null;
+    replayBtn.disabled = false;
+    stopBtn.disabled = true;
+}
+
+function sum(list) {
+    return list.reduce((n, r) => n + r.length, 0);
+}
+
+function escapeHtml(text) {
+    return text.replace(/[&<>]/g, c => ({ '&': '&amp;', '<': '&lt;', '>': '&gt;' }[c]));
+}
+
+function log(message) {
+    const line = document.createElement('div');
+    line.textContent = `${new Date().toLocaleTimeString()} ${message}`;
+    logBox.prepend(line);
+}
+
+fetchBtn.addEventListener('click', fetchCapture);
+saveBtn.addEventListener('click', () => downloadFile(capture, `dewab-capture-${Date.now()}.bin`));
+replayBtn.addEventListener('click', startReplay);
+stopBtn.addEventListener('click', () => { if (replay) replay.stopped = true; });
+fileInput.addEventListener('change', async () => {
+    const file = fileInput.files[0];
+    if (file) loadCapture(new Uint8Array(await file.arrayBuffer()));
+});